@@ -0,0 +1,74 @@
+#!/bin/bash
+
+# Async GET. Two cold-cache workloads, each run on a lightfs.ko built
+# with -DASYNC_GET and on one built without it:
+#   stat    parallel ls -l over directories where half of the entries are
+#           hardlinks, whose targets are fetched from the device
+#   sparse  parallel sequential reads of files of which every other page
+#           is already cached, so readpages gets lists with holes
+# The async gets are in the cheeze path, so the modules must not be built
+# with -DEMULATION or -DNULL_IO. /dev/loop3 is set up as in kevinfs/run.sh.
+#
+#   ./async.sh <lightfs.ko with ASYNC_GET> <lightfs.ko without>
+
+target_dir=/bench
+jobs=${JOBS:-16}
+dirs=${DIRS:-64}
+files=${FILES:-1000}
+size=${SIZE:-1G}
+
+if [ $# -ne 2 ]; then
+    echo "usage: $0 <lightfs.ko with ASYNC_GET> <lightfs.ko without>"
+    exit 1
+fi
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+remount() {
+    sync
+    umount $target_dir || exit 1
+    echo 3 > /proc/sys/vm/drop_caches
+    mount -t lightfs /dev/loop3 $target_dir || exit 1
+}
+
+run() {
+    local name=$1 module=$2 t0 t1
+
+    insmod $module || exit 1
+    mount -t lightfs /dev/loop3 $target_dir || exit 1
+
+    mkdir -p $target_dir/files
+    for d in $(seq $dirs); do
+        mkdir $target_dir/d$d
+        for f in $(seq $files); do
+            touch $target_dir/files/f$d.$f
+            ln $target_dir/files/f$d.$f $target_dir/d$d/l$f
+            touch $target_dir/d$d/f$f
+        done
+    done
+    remount
+    t0=$(now_ms)
+    ls -d $target_dir/d* | xargs -P $jobs -n 1 ls -l > /dev/null
+    t1=$(now_ms)
+    echo "$name stat: $((t1 - t0)) ms"
+    rm -rf $target_dir/*
+
+    fio --name=sparse --directory=$target_dir --numjobs=$jobs --size=$size \
+        --rw=write --bs=1M --end_fsync=1 > /dev/null || exit 1
+    remount
+    # every other page, without readahead filling the holes
+    fio --name=sparse --directory=$target_dir --numjobs=$jobs --size=$size \
+        --rw=read:4k --bs=4k --fadvise_hint=random > /dev/null || exit 1
+    echo "$name sparse:"
+    fio --name=sparse --directory=$target_dir --numjobs=$jobs --size=$size \
+        --rw=read --bs=128k --group_reporting | grep -E "READ:"
+
+    rm -rf $target_dir/*
+    umount $target_dir
+    rmmod lightfs
+}
+
+run async $1
+run sync $2
@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# Kernel memory of the metadata cache per cached file. mkfiles (../mount)
+# builds trees of 10^5..10^7 files and /sys/kernel/debug/lightfs/cache is
+# read after each: bytes_per_item is what the cache takes now,
+# legacy_bytes_per_item the same entries with a kmalloc'd key and a full
+# struct lightfs_metadata each.
+
+dev=${1:-/dev/loop3}
+target_dir=${2:-/bench}
+sizes=${SIZES:-"100000 1000000 10000000"}
+stats=/sys/kernel/debug/lightfs/cache
+
+make -C $(dirname $0)/../mount mkfiles || exit 1
+mkfiles=$(dirname $0)/../mount/mkfiles
+
+mountpoint -q /sys/kernel/debug || mount -t debugfs none /sys/kernel/debug
+
+for n in $sizes; do
+    mount -t lightfs $dev $target_dir || exit 1
+    $mkfiles $target_dir/tree $n > /dev/null || exit 1
+    echo "== $n files"
+    cat $stats
+    grep -E "lightfs_ht_item|lightfs_dcache" /proc/slabinfo
+    rm -rf $target_dir/tree
+    umount $target_dir
+done
@@ -0,0 +1,48 @@
+#!/bin/bash
+
+# GET coalescing: N readers of the same cold file. fio starts N jobs on
+# one prewritten file after the page cache is dropped, so their reads of
+# each range reach lightfs at about the same time. Run for 1..32 readers
+# on a lightfs.ko built with -DGET_COALESCE and on one built without it;
+# the coalesced get and get_multi counts are printed at rmmod.
+#
+# Coalescing is in the cheeze path, so the modules must not be built with
+# -DEMULATION or -DNULL_IO. /dev/loop3 is set up as in kevinfs/run.sh.
+#
+#   ./coalesce.sh <lightfs.ko with GET_COALESCE> <lightfs.ko without>
+
+target_dir=/bench
+size=${SIZE:-2G}
+
+if [ $# -ne 2 ]; then
+    echo "usage: $0 <lightfs.ko with GET_COALESCE> <lightfs.ko without>"
+    exit 1
+fi
+
+run() {
+    local name=$1 module=$2
+
+    insmod $module || exit 1
+    mount -t lightfs /dev/loop3 $target_dir || exit 1
+
+    fio --name=prefill --filename=$target_dir/shared --size=$size \
+        --rw=write --bs=1M --end_fsync=1 > /dev/null || exit 1
+
+    echo "== $name"
+    for readers in 1 4 16 32; do
+        sync
+        echo 3 > /proc/sys/vm/drop_caches
+        echo "readers $readers"
+        fio --name=shared --filename=$target_dir/shared --size=$size \
+            --rw=read --bs=128k --numjobs=$readers --group_reporting \
+            | grep -E "READ:"
+    done
+
+    rm -f $target_dir/shared
+    umount $target_dir
+    rmmod lightfs
+    dmesg | grep "LIGHTFS COALESCE SUMMARY" | tail -n 1
+}
+
+run coalesce $1
+run plain $2
@@ -0,0 +1,58 @@
+#!/bin/bash
+
+# Data page compression on the emulator: a lightfs.ko built with
+# -DEMULATION -DCOMPRESS -DMONITOR, written and read back by fio with
+# buffers that are 0, 50 and 90 percent compressible. For every mix the
+# fio "cpu" line gives the cost and the module's COMP SUMMARY at rmmod
+# gives the bytes that went to the store against the bytes written.
+# Every mix is also written once more with fio checksums and read back
+# through the page cache and with O_DIRECT.
+# Run it once more with a build without -DCOMPRESS for the baseline.
+#
+# /dev/loop3 is set up as in kevinfs/run.sh.
+#
+#   ./compress.sh <lightfs.ko>
+
+module=${1:?usage: $0 <lightfs.ko>}
+target_dir=/bench
+size=${SIZE:-4GB}
+jobs=/tmp/compress_fio
+
+flush() {
+    sync
+    echo 3 > /proc/sys/vm/drop_caches
+}
+
+for pct in 0 50 90; do
+    rm -rf $jobs
+    cp -r $(dirname $0)/../fio $jobs
+    sed -i "s|^filename=.*|filename=$target_dir/file2|; s|^size=.*|size=$size|" $jobs/global.fio
+    printf "buffer_compress_percentage=%d\nrefill_buffers=1\n" $pct >> $jobs/global.fio
+
+    insmod $module || exit 1
+    mount -t lightfs /dev/loop3 $target_dir || exit 1
+    for workload in seqwrite seqread; do
+        flush
+        echo "== compress $pct% $workload"
+        (cd $jobs && fio $workload.fio) | grep -E "IOPS=|cpu *:"
+    done
+    rm -f $target_dir/file2
+
+    # read-back: buffered (readpages) and O_DIRECT reads must see the data
+    verify="--name=verify --filename=$target_dir/verify --size=256M --bs=1M
+            --buffer_compress_percentage=$pct --refill_buffers --verify=crc32c"
+    fio $verify --rw=write --do_verify=0 > /dev/null || exit 1
+    for direct in 0 1; do
+        flush
+        if fio $verify --rw=write --verify_only=1 --direct=$direct > /dev/null; then
+            echo "== compress $pct% read-back direct=$direct ok"
+        else
+            echo "== compress $pct% read-back direct=$direct FAILED"
+        fi
+    done
+    rm -f $target_dir/verify
+    umount $target_dir
+    rmmod lightfs
+    dmesg | grep "LIGHTFS COMP SUMMARY" | tail -n 1
+done
+rm -rf $jobs
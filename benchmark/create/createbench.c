@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Create storm: every thread creates empty files in its own directory
+ * (or all in one with -s) as fast as it can. Reports creates/s and the
+ * create latency tail, where inode number refills show up.
+ *
+ *   ./createbench [-s] <dir> <threads> <files per thread>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+static const char *root;
+static int shared_dir;
+static uint64_t nr_files;
+
+struct worker {
+	pthread_t thread;
+	int id;
+	uint32_t *lat_us;
+};
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	char dir[2048], path[4096];
+	uint64_t i, start;
+	int fd;
+
+	if (shared_dir) {
+		snprintf(dir, sizeof(dir), "%s/shared", root);
+	} else {
+		snprintf(dir, sizeof(dir), "%s/t%03d", root, w->id);
+		if (mkdir(dir, 0755)) {
+			perror(dir);
+			exit(1);
+		}
+	}
+	for (i = 0; i < nr_files; i++) {
+		snprintf(path, sizeof(path), "%s/f%03d.%lu", dir, w->id, i);
+		start = now_ns();
+		fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+		if (fd < 0) {
+			perror(path);
+			exit(1);
+		}
+		w->lat_us[i] = (now_ns() - start) / 1000;
+		close(fd);
+	}
+	return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+	struct worker *workers;
+	char path[4096];
+	uint32_t *all;
+	uint64_t start, elapsed, n;
+	int nr_threads, opt, i;
+
+	while ((opt = getopt(argc, argv, "s")) != -1) {
+		if (opt != 's')
+			return 1;
+		shared_dir = 1;
+	}
+	if (optind + 3 > argc) {
+		fprintf(stderr, "usage: %s [-s] <dir> <threads> <files per thread>\n",
+		        argv[0]);
+		return 1;
+	}
+	root = argv[optind];
+	nr_threads = atoi(argv[optind + 1]);
+	nr_files = strtoull(argv[optind + 2], NULL, 0);
+
+	if (mkdir(root, 0755)) {
+		perror(root);
+		return 1;
+	}
+	if (shared_dir) {
+		snprintf(path, sizeof(path), "%s/shared", root);
+		if (mkdir(path, 0755)) {
+			perror(path);
+			return 1;
+		}
+	}
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	start = now_ns();
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].id = i;
+		workers[i].lat_us = malloc(nr_files * sizeof(uint32_t));
+		pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i]);
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+	elapsed = now_ns() - start;
+
+	n = nr_files * nr_threads;
+	all = malloc(n * sizeof(uint32_t));
+	for (i = 0; i < nr_threads; i++)
+		memcpy(all + nr_files * i, workers[i].lat_us,
+		       nr_files * sizeof(uint32_t));
+	qsort(all, n, sizeof(uint32_t), cmp_u32);
+
+	printf("%-6s %8s %12s %12s %10s %10s %10s\n", "dir", "threads", "files",
+	       "creates/s", "p50(us)", "p99.9(us)", "max(us)");
+	printf("%-6s %8d %12lu %12.0f %10u %10u %10u\n",
+	       shared_dir ? "shared" : "own", nr_threads, n,
+	       n * 1e9 / elapsed, all[n / 2], all[n * 999 / 1000], all[n - 1]);
+	return 0;
+}
@@ -0,0 +1,37 @@
+#!/bin/bash
+
+# Buffered vs O_DIRECT on kevinfs with the benchmark/fio jobs. Every job
+# runs twice on a fresh file: as shipped (direct=0) and switched to
+# direct=1, buffered=0. lightfs.ko must be loaded and mounted on /bench.
+#
+# For tpcc, set "innodb_flush_method = O_DIRECT" in the [mysqld] section
+# of my.cnf and run benchmark/application/tpcc/kevin/tpcc.sh.
+
+target_dir=${1:-/bench}
+size=${SIZE:-32GB}
+jobs=/tmp/dio_fio
+
+flush() {
+    sync
+    echo 3 > /proc/sys/vm/drop_caches
+}
+
+for mode in buffered direct; do
+    rm -rf $jobs
+    cp -r $(dirname $0)/../fio $jobs
+    sed -i "s|^filename=.*|filename=$target_dir/file2|; s|^size=.*|size=$size|" $jobs/global.fio
+    if [ $mode = direct ]; then
+        sed -i "s|^direct=0|direct=1|; s|^buffered=1|buffered=0|" $jobs/global.fio
+    fi
+
+    for pair in "seqwrite seqread" "seqwrite randread" "randwrite seqread" "randwrite randread"; do
+        rm -f $target_dir/file2
+        flush
+        for workload in $pair; do
+            echo "== $mode $workload"
+            (cd $jobs && fio $workload.fio) | grep -E "IOPS|cpu"
+            flush
+        done
+    done
+done
+rm -rf $jobs $target_dir/file2
@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Sequential write and read of kevinfs with and without extent records.
+# Run once with a lightfs.ko built from the default flags and once with
+# -DEXTENT added, both with -DMONITOR, on the emulator (-DEMULATION) or a
+# device that understands DATA_SEQ_SET extents. The key count is read
+# from the LIGHTFS IO SUMMARY printed at rmmod: DATA_SET_WB records one
+# key per page, DATA_EXT_WB one key per LIGHTFS_EXTENT_PAGES pages.
+#
+# /dev/loop3 is set up as in kevinfs/run.sh.
+#
+#   ./extent.sh <lightfs.ko> [mount point] [size]
+
+module=${1:?usage: $0 <lightfs.ko> [mount point] [size]}
+target_dir=${2:-/bench}
+size=${3:-4G}
+
+insmod $module || exit 1
+mount -t lightfs /dev/loop3 $target_dir || exit 1
+
+fio --name=seqwrite --directory=$target_dir --rw=write --bs=1M --size=$size \
+    --ioengine=psync --end_fsync=1 | grep -E "WRITE:"
+sync
+echo 3 > /proc/sys/vm/drop_caches
+fio --name=seqwrite --directory=$target_dir --rw=read --bs=1M --size=$size \
+    --ioengine=psync | grep -E "READ:"
+
+umount $target_dir
+dmesg -c > /dev/null
+rmmod lightfs
+dmesg | grep -E "DATA_SET_WB|DATA_EXT_WB|DATA_DEL_MULTI|GET_MULTI\]"
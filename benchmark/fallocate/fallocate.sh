@@ -0,0 +1,30 @@
+#!/bin/bash
+
+# fallocate on the emulator: a lightfs.ko built with -DEMULATION and
+# -DMONITOR. falloctest checks the contents after every punch, zero and
+# preallocation, from the page cache and again after dropping caches.
+# The LIGHTFS IO SUMMARY printed at rmmod gives the key counts: the
+# punched blocks show up as DEL_MULTI_REAL, and preallocation adds no
+# DATA_SET records.
+#
+# /dev/loop3 is set up as in kevinfs/run.sh.
+#
+#   ./fallocate.sh <lightfs.ko> [mount point]
+
+module=${1:?usage: $0 <lightfs.ko> [mount point]}
+target_dir=${2:-/bench}
+
+make -C $(dirname $0) falloctest || exit 1
+falloctest=$(dirname $0)/falloctest
+
+insmod $module || exit 1
+mount -t lightfs /dev/loop3 $target_dir || exit 1
+dmesg -c > /dev/null
+
+$falloctest $target_dir/falloc
+ret=$?
+
+umount $target_dir
+rmmod lightfs
+dmesg | sed -n '/LIGHTFS IO SUMMARY/,/=====$/p' | grep -E "SET|DEL"
+exit $ret
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * fallocate checks for kevinfs: fill a file with a pattern, then punch a
+ * hole, zero a range and preallocate with and without FALLOC_FL_KEEP_SIZE.
+ * After every step the whole file is compared with the expected contents,
+ * once from the page cache and once more after dropping caches (as root),
+ * so the blocks are read back from the device.
+ *
+ *   ./falloctest <file>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define FILE_SIZE (256 * 4096 + 1000)
+#define MAX_SIZE (1024 * 4096)
+
+static char expect[MAX_SIZE], buf[MAX_SIZE];
+static off_t expect_size;
+static int fd, failed;
+
+static void drop_caches(void)
+{
+	int dfd;
+
+	fsync(fd);
+	sync();
+	dfd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (dfd < 0)
+		return;
+	if (write(dfd, "3", 1) != 1)
+		perror("drop_caches");
+	close(dfd);
+}
+
+static void check(const char *step, const char *from)
+{
+	struct stat st;
+	ssize_t n;
+	off_t i;
+
+	if (fstat(fd, &st)) {
+		perror("fstat");
+		exit(1);
+	}
+	if (st.st_size != expect_size) {
+		printf("%-24s %-6s FAIL size %ld, expected %ld\n",
+		       step, from, (long)st.st_size, (long)expect_size);
+		failed = 1;
+		return;
+	}
+	n = pread(fd, buf, expect_size, 0);
+	if (n != expect_size) {
+		printf("%-24s %-6s FAIL read %ld bytes\n", step, from, (long)n);
+		failed = 1;
+		return;
+	}
+	for (i = 0; i < expect_size; i++) {
+		if (buf[i] != expect[i]) {
+			printf("%-24s %-6s FAIL byte %ld is %#x, expected %#x\n",
+			       step, from, (long)i, buf[i] & 0xff, expect[i] & 0xff);
+			failed = 1;
+			return;
+		}
+	}
+	printf("%-24s %-6s ok (size %ld, %ld blocks)\n",
+	       step, from, (long)st.st_size, (long)st.st_blocks);
+}
+
+static void step(const char *name, int mode, off_t off, off_t len)
+{
+	if (fallocate(fd, mode, off, len)) {
+		perror(name);
+		exit(1);
+	}
+	if (mode & (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE)) {
+		off_t end = off + len < expect_size ? off + len : expect_size;
+
+		if (off < end)
+			memset(expect + off, 0, end - off);
+	}
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && off + len > expect_size)
+		expect_size = off + len;
+	check(name, "cache");
+	drop_caches();
+	check(name, "device");
+}
+
+int main(int argc, char *argv[])
+{
+	off_t i;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <file>\n", argv[0]);
+		return 1;
+	}
+	fd = open(argv[1], O_CREAT | O_TRUNC | O_RDWR, 0644);
+	if (fd < 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	for (i = 0; i < FILE_SIZE; i++)
+		expect[i] = 'a' + i % 26;
+	expect_size = FILE_SIZE;
+	if (pwrite(fd, expect, FILE_SIZE, 0) != FILE_SIZE) {
+		perror("pwrite");
+		return 1;
+	}
+	check("write", "cache");
+	drop_caches();
+	check("write", "device");
+
+	step("punch inside a block", FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	     4096 + 100, 200);
+	step("punch unaligned", FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	     3 * 4096 + 100, 40 * 4096);
+	step("punch aligned", FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	     64 * 4096, 64 * 4096);
+	step("zero range", FALLOC_FL_ZERO_RANGE, 200 * 4096 + 7, 10 * 4096);
+	step("punch to eof", FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	     250 * 4096 + 10, 100 * 4096);
+	step("keep size prealloc", FALLOC_FL_KEEP_SIZE, 0, MAX_SIZE);
+	step("prealloc", 0, FILE_SIZE, 512 * 4096);
+	step("zero range past eof", FALLOC_FL_ZERO_RANGE, 700 * 4096, 300 * 4096);
+
+	close(fd);
+	printf("%s\n", failed ? "FAILED" : "PASSED");
+	return failed;
+}
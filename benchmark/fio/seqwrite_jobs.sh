@@ -0,0 +1,14 @@
+#!/bin/bash
+
+# Sequential write throughput of kevinfs for 1..16 writers.
+# lightfs.ko must be loaded and mounted on $1 (default /bench).
+
+target_dir=${1:-/bench}
+
+for jobs in 1 2 4 8 16; do
+    rm -rf $target_dir/*
+    sync
+    echo 3 > /proc/sys/vm/drop_caches
+    echo "== $jobs jobs"
+    JOBS=$jobs fio --directory=$target_dir $(dirname $0)/seqwrite_jobs.fio | grep -E "WRITE:|bw="
+done
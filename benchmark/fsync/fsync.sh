@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# fsync/fdatasync latency on kevinfs: the OLTP-style loop of fsyncbench
+# for 1..32 threads, then filebench varmail and oltp.
+
+target_dir=${1:-/bench}
+workloads=$(dirname $0)/../filebench/workloads
+
+make -C $(dirname $0) fsyncbench || exit 1
+fsyncbench=$(dirname $0)/fsyncbench
+
+for flags in "" "-d" "-a" "-d -a"; do
+    for threads in 1 4 16 32; do
+        rm -f $target_dir/fsync.*
+        $fsyncbench $flags $target_dir $threads | tail -n 1
+    done
+done
+rm -f $target_dir/fsync.*
+
+for workload in real_varmail.f real_oltp.f; do
+    rm -rf $target_dir/*
+    sed "s|^set \$dir=.*|set \$dir=$target_dir|" $workloads/$workload > /tmp/$workload
+    filebench -f /tmp/$workload
+done
@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * OLTP-style sync loop: every thread overwrites random 8K blocks of its
+ * own preallocated file and syncs after each write, like a database log
+ * or page flush. Reports ops/s and sync latency percentiles.
+ *
+ *   ./fsyncbench [-d] [-a] <dir> [threads]
+ *     -d   fdatasync instead of fsync
+ *     -a   append instead of overwrite (i_size changes on every sync)
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#define BLOCK_SIZE 8192
+#define FILE_BLOCKS 4096
+#define RUNTIME_SEC 30
+#define MAX_SAMPLES (1 << 20)
+
+static const char *dir;
+static int use_fdatasync, use_append;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	int id;
+	unsigned int seed;
+	uint64_t ops;
+	uint32_t *lat_us;
+};
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int open_file(int id)
+{
+	char path[4096], buf[BLOCK_SIZE];
+	int fd, i;
+
+	snprintf(path, sizeof(path), "%s/fsync.%d", dir, id);
+	fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	if (use_append)
+		return fd;
+	memset(buf, 0xab, sizeof(buf));
+	for (i = 0; i < FILE_BLOCKS; i++) {
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			perror(path);
+			exit(1);
+		}
+	}
+	fsync(fd);
+	return fd;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	char buf[BLOCK_SIZE];
+	uint64_t start;
+	off_t off;
+	int fd;
+
+	fd = open_file(w->id);
+	memset(buf, w->id, sizeof(buf));
+	while (!stop) {
+		if (use_append)
+			off = (off_t)w->ops * BLOCK_SIZE;
+		else
+			off = (off_t)(rand_r(&w->seed) % FILE_BLOCKS) * BLOCK_SIZE;
+		if (pwrite(fd, buf, sizeof(buf), off) != sizeof(buf)) {
+			perror("pwrite");
+			exit(1);
+		}
+		start = now_ns();
+		if (use_fdatasync ? fdatasync(fd) : fsync(fd)) {
+			perror("sync");
+			exit(1);
+		}
+		if (w->ops < MAX_SAMPLES)
+			w->lat_us[w->ops] = (now_ns() - start) / 1000;
+		w->ops++;
+	}
+	close(fd);
+	return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+	struct worker *workers;
+	uint32_t *all;
+	uint64_t total = 0, n = 0, cnt;
+	int nr_threads = 1, opt, i;
+
+	while ((opt = getopt(argc, argv, "da")) != -1) {
+		switch (opt) {
+		case 'd':
+			use_fdatasync = 1;
+			break;
+		case 'a':
+			use_append = 1;
+			break;
+		default:
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "usage: %s [-d] [-a] <dir> [threads]\n", argv[0]);
+		return 1;
+	}
+	dir = argv[optind];
+	if (optind + 1 < argc)
+		nr_threads = atoi(argv[optind + 1]);
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].id = i;
+		workers[i].seed = i + 1;
+		workers[i].lat_us = malloc(MAX_SAMPLES * sizeof(uint32_t));
+		pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i]);
+	}
+	sleep(RUNTIME_SEC);
+	stop = 1;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].ops;
+	}
+
+	all = malloc(total * sizeof(uint32_t));
+	for (i = 0; i < nr_threads; i++) {
+		cnt = workers[i].ops < MAX_SAMPLES ? workers[i].ops : MAX_SAMPLES;
+		memcpy(all + n, workers[i].lat_us, cnt * sizeof(uint32_t));
+		n += cnt;
+	}
+	qsort(all, n, sizeof(uint32_t), cmp_u32);
+
+	printf("%-10s %-9s %8s %12s %10s %10s %10s\n",
+	       "sync", "pattern", "threads", "ops/s", "p50(us)", "p99(us)", "max(us)");
+	printf("%-10s %-9s %8d %12.0f %10u %10u %10u\n",
+	       use_fdatasync ? "fdatasync" : "fsync",
+	       use_append ? "append" : "overwrite", nr_threads,
+	       (double)total / RUNTIME_SEC,
+	       n ? all[n / 2] : 0, n ? all[n * 99 / 100] : 0, n ? all[n - 1] : 0);
+	return 0;
+}
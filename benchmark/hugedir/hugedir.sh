@@ -0,0 +1,49 @@
+#!/bin/bash
+
+# One hot directory: 64 threads create into a single directory (createbench
+# -s from ../create), then the directory is listed and emptied by 64
+# parallel unlinkers. Directories past LIGHTFS_DCACHE_SHARD_MIN children
+# keep them in per-shard trees, so compare against a lightfs.ko built
+# before the split existed.
+#
+#   ./hugedir.sh <lightfs.ko> [<baseline lightfs.ko>]
+
+target_dir=/bench
+threads=${THREADS:-64}
+files=${FILES:-100000}
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <lightfs.ko> [<baseline lightfs.ko>]"
+    exit 1
+fi
+
+make -C $(dirname $0)/../create createbench || exit 1
+createbench=$(dirname $0)/../create/createbench
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+run() {
+    local module=$1 t0 t1 t2
+
+    insmod $module || exit 1
+    mount -t lightfs /dev/loop3 $target_dir || exit 1
+
+    echo "== $module"
+    $createbench -s $target_dir/hot $threads $files | tail -n 1
+    t0=$(now_ms)
+    ls -f $target_dir/hot | wc -l
+    t1=$(now_ms)
+    find $target_dir/hot -type f | xargs -P $threads -n 1000 rm -f
+    t2=$(now_ms)
+    echo "readdir $((t1 - t0)) ms, unlink $((t2 - t1)) ms"
+
+    rm -rf $target_dir/hot
+    umount $target_dir
+    rmmod lightfs
+}
+
+for module in "$@"; do
+    run $module
+done
@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * User-space microbenchmark for kevinfs/lightfs_hash.h.
+ *
+ * Compares the single pass 64-bit hash against the old scheme: two
+ * crc32 passes per cache lookup (bucket and fingerprint) and k murmur3
+ * passes per bloom filter insert. Both old hashes are copied here.
+ */
+
+#include <time.h>
+
+#include "kshim.h"
+#include "lightfs_hash.h"
+
+#define NR_KEYS 4096
+#define KEY_MAX_LEN 264
+#define BLOOM_K 3
+#define BLOOM_M (308 * 8)
+
+static volatile uint64_t sink;
+static char keys[NR_KEYS][KEY_MAX_LEN];
+
+/* slice-by-8 crc32_le, as lib/crc32.c with its default CRC_LE_BITS == 64 */
+static uint32_t crc32_table[8][256];
+
+static void crc32_init(void)
+{
+	uint32_t i, j, c;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++)
+			c = (c >> 1) ^ (c & 1 ? 0xedb88320 : 0);
+		crc32_table[0][i] = c;
+	}
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < 8; j++)
+			crc32_table[j][i] = (crc32_table[j - 1][i] >> 8) ^
+			                    crc32_table[0][crc32_table[j - 1][i] & 0xff];
+}
+
+static uint32_t crc32(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t q, r;
+
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&q, p, 4);
+		memcpy(&r, p + 4, 4);
+		q = le32_to_cpu(q) ^ crc;
+		r = le32_to_cpu(r);
+		crc = crc32_table[7][q & 0xff] ^ crc32_table[6][(q >> 8) & 0xff] ^
+		      crc32_table[5][(q >> 16) & 0xff] ^ crc32_table[4][q >> 24] ^
+		      crc32_table[3][r & 0xff] ^ crc32_table[2][(r >> 8) & 0xff] ^
+		      crc32_table[1][(r >> 16) & 0xff] ^ crc32_table[0][r >> 24];
+	}
+	while (len--)
+		crc = (crc >> 8) ^ crc32_table[0][(crc ^ *p++) & 0xff];
+	return crc;
+}
+
+/* the murmur3.c that bloomfilter.c used to call */
+#define ROTL32(x,r)	(((x) << (r)) | ((x) >> (32 - (r))))
+
+static uint32_t murmur3_hash32(const void *key, size_t len, uint32_t seed)
+{
+	const uint32_t c1 = 0xcc9e2d51;
+	const uint32_t c2 = 0x1b873593;
+	const uint8_t *data = (const uint8_t *)key;
+	const int nblocks = len >> 2;
+	const uint8_t *tail = data + nblocks * 4;
+	uint32_t h1 = seed, k1 = 0;
+	int i;
+
+	for (i = 0; i < nblocks; i++) {
+		uint32_t k;
+
+		memcpy(&k, data + i * 4, 4);
+		k *= c1;
+		k = ROTL32(k, 15);
+		k *= c2;
+		h1 ^= k;
+		h1 = ROTL32(h1, 13);
+		h1 = h1 * 5 + 0xe6546b64;
+	}
+
+	switch (len & 3) {
+	case 3: k1 ^= tail[2] << 16;
+	case 2: k1 ^= tail[1] << 8;
+	case 1: k1 ^= tail[0];
+		k1 *= c1; k1 = ROTL32(k1, 15); k1 *= c2; h1 ^= k1;
+	};
+
+	h1 ^= len;
+	h1 ^= h1 >> 16;
+	h1 *= 0x85ebca6b;
+	h1 ^= h1 >> 13;
+	h1 *= 0xc2b2ae35;
+	h1 ^= h1 >> 16;
+	return h1;
+}
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *name, int len, uint64_t ns, uint64_t ops)
+{
+	printf("%-24s %6d %12lu %12.2f %12.2f\n",
+	       name, len, ops, (double)ns / ops, (double)len * ops / ns);
+}
+
+/* meta keys: 'm', be64 parent ino, name, NUL */
+static void make_keys(int len)
+{
+	int i, j;
+
+	for (i = 0; i < NR_KEYS; i++) {
+		keys[i][0] = 'm';
+		*(uint64_t *)(keys[i] + 1) = cpu_to_be64(i / 64);
+		for (j = 9; j < len - 1; j++)
+			keys[i][j] = 'a' + ((i * 7 + j * 13) % 26);
+		/* names within a directory must differ */
+		for (j = 0; j < 4; j++)
+			keys[i][9 + j] = "0123456789abcdef"[(i >> (j * 4)) & 0xf];
+		keys[i][len - 1] = '\0';
+	}
+}
+
+static void bench_cache(int len, uint64_t iters)
+{
+	uint64_t i, start;
+	uint32_t hkey, fp;
+
+	start = now_ns();
+	for (i = 0; i < iters; i++) {
+		hkey = crc32(0, keys[i % NR_KEYS], len);
+		fp = crc32(17, keys[i % NR_KEYS], len);
+		sink += hkey ^ fp;
+	}
+	report("cache_crc32_x2", len, now_ns() - start, iters);
+
+	start = now_ns();
+	for (i = 0; i < iters; i++) {
+		uint64_t h = lightfs_hash64(keys[i % NR_KEYS], len);
+
+		sink += lightfs_hash_bucket(h) ^ lightfs_hash_fp(h);
+	}
+	report("cache_hash64", len, now_ns() - start, iters);
+
+	start = now_ns();
+	for (i = 0; i < iters; i++) {
+		uint64_t h = lightfs_hash64_soft(keys[i % NR_KEYS], len);
+
+		sink += lightfs_hash_bucket(h) ^ lightfs_hash_fp(h);
+	}
+	report("cache_hash64_soft", len, now_ns() - start, iters);
+}
+
+static void bench_bloom(int len, uint64_t iters)
+{
+	uint64_t i, start;
+	uint32_t k, h, h1, h2;
+
+	start = now_ns();
+	for (i = 0; i < iters; i++) {
+		for (k = 0; k < BLOOM_K; k++) {
+			h = murmur3_hash32(keys[i % NR_KEYS], len, k);
+			sink += h % BLOOM_M;
+		}
+	}
+	report("bloom_murmur3_xk", len, now_ns() - start, iters);
+
+	start = now_ns();
+	for (i = 0; i < iters; i++) {
+		uint64_t hash = lightfs_hash64(keys[i % NR_KEYS], len);
+
+		h1 = lightfs_hash_bucket(hash);
+		h2 = lightfs_hash_fp(hash) | 1;
+		for (k = 0; k < BLOOM_K; k++)
+			sink += (h1 + k * h2) % BLOOM_M;
+	}
+	report("bloom_hash64_double", len, now_ns() - start, iters);
+}
+
+/*
+ * Sanity check of the split: keys in one bucket (low 20 bits, as
+ * HASHTABLE_BITS) should almost never share a fingerprint.
+ */
+static void check_fp(int len)
+{
+	static uint64_t hashes[NR_KEYS];
+	int i, j, dup = 0;
+
+	for (i = 0; i < NR_KEYS; i++)
+		hashes[i] = lightfs_hash64(keys[i], len);
+	for (i = 0; i < NR_KEYS; i++)
+		for (j = i + 1; j < NR_KEYS; j++)
+			if (((lightfs_hash_bucket(hashes[i]) ^ lightfs_hash_bucket(hashes[j])) & 0xfffff) == 0 &&
+			    lightfs_hash_fp(hashes[i]) == lightfs_hash_fp(hashes[j]))
+				dup++;
+	if (dup)
+		printf("%-24s %6d %12d\n", "fp_collisions", len, dup);
+}
+
+int main(int argc, char *argv[])
+{
+	static const int key_lens[] = { 16, 32, 64, 128, 264 };
+	uint64_t iters = 2000000;
+	int i;
+
+	if (argc > 1)
+		iters = strtoull(argv[1], NULL, 0);
+
+	crc32_init();
+#ifdef CONFIG_X86_64
+	printf("crc32c: %s\n", static_cpu_has(X86_FEATURE_XMM4_2) ? "yes" : "no");
+#endif
+	printf("%-24s %6s %12s %12s %12s\n", "bench", "keylen", "ops", "ns/op", "bytes/ns");
+
+	for (i = 0; i < sizeof(key_lens) / sizeof(key_lens[0]); i++) {
+		make_keys(key_lens[i]);
+		check_fp(key_lens[i]);
+		bench_cache(key_lens[i], iters);
+		bench_bloom(key_lens[i], iters);
+	}
+
+	return 0;
+}
@@ -0,0 +1,3 @@
+/* user-space stand-in for <asm/cpufeature.h>, see kshim.h */
+#define X86_FEATURE_XMM4_2 "sse4.2"
+#define static_cpu_has(feature) __builtin_cpu_supports(feature)
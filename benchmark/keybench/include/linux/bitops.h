@@ -0,0 +1,7 @@
+/* user-space stand-in for <linux/bitops.h>, see kshim.h */
+#include <stdint.h>
+
+static inline uint64_t rol64(uint64_t word, unsigned int shift)
+{
+	return (word << (shift & 63)) | (word >> ((-shift) & 63));
+}
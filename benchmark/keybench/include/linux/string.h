@@ -0,0 +1,2 @@
+/* user-space stand-in for <linux/string.h>, see kshim.h */
+#include <string.h>
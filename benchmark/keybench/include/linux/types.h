@@ -0,0 +1,3 @@
+/* user-space stand-in for <linux/types.h>, see kshim.h */
+#include <stdint.h>
+#include <stddef.h>
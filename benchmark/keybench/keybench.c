@@ -0,0 +1,401 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * User-space microbenchmark for the kevinfs key encoder and the
+ * lightfs_io.h wire serializers.
+ *
+ * The serializers are included verbatim from kevinfs/lightfs_io.h.
+ * The key helpers live in lightfs_super.c / lightfs_bstore.c and are
+ * mirrored below, keep them in sync.
+ */
+
+#include <time.h>
+#include <unistd.h>
+
+#include "kshim.h"
+#include "lightfs_debug.h"
+#include "lightfs_io.h"
+
+#define MAGIC_POS      (0)
+#define INO_POS        (MAGIC_POS + sizeof(char))
+#define PATH_POS       (INO_POS + sizeof(uint64_t))
+#define BNUM_POS(size) (size - sizeof(uint64_t))
+#define DATA_META_KEY_SIZE_DIFF (sizeof(uint64_t))
+#define META_KEY_MAGIC ('m')
+#define DATA_KEY_MAGIC ('d')
+
+#define NAME_MAX_LEN 255
+#define NR_NAMES 1024
+
+static volatile uint64_t sink;
+
+/* lightfs_fs.h */
+static inline void lightfs_key_set_magic(char *key, char magic)
+{
+	*key = magic;
+}
+
+static inline uint64_t lightfs_key_get_ino(char *key)
+{
+	return be64_to_cpu(*(uint64_t *)(key + INO_POS));
+}
+
+static inline void lightfs_key_set_ino(char *key, uint64_t ino)
+{
+	*(uint64_t *)(key + INO_POS) = cpu_to_be64(ino);
+}
+
+static inline char *lightfs_key_path(char *key)
+{
+	return (key + PATH_POS);
+}
+
+static inline uint64_t
+lightfs_data_key_get_blocknum(char *key, uint32_t key_size)
+{
+	return be64_to_cpu(*(uint64_t *)(key + BNUM_POS(key_size)));
+}
+
+static inline void
+lightfs_data_key_set_blocknum(char *key, uint32_t key_size, uint64_t blocknum)
+{
+	*(uint64_t *)(key + BNUM_POS(key_size)) = cpu_to_be64(blocknum);
+}
+
+static inline void dbt_setup(DBT *dbt, const void *data, size_t size)
+{
+	dbt->data = (void *)data;
+	dbt->size = size;
+	dbt->ulen = size;
+	dbt->flags = DB_DBT_USERMEM;
+}
+
+/* lightfs_super.c */
+static int
+alloc_child_meta_dbt_from_ino(DBT *dbt, uint64_t parent_ino, const char *name)
+{
+	char *meta_key;
+	size_t size;
+
+	size = PATH_POS + strlen(name) + 1;
+	meta_key = kmalloc(size, GFP_NOIO);
+	if (meta_key == NULL)
+		return -ENOMEM;
+	lightfs_key_set_magic(meta_key, META_KEY_MAGIC);
+	lightfs_key_set_ino(meta_key, parent_ino);
+	sprintf(lightfs_key_path(meta_key), "%s", name);
+
+	dbt_setup(dbt, meta_key, size);
+	return 0;
+}
+
+static int
+alloc_data_dbt_from_ino(DBT *data_dbt, uint64_t ino, uint64_t block_num)
+{
+	char *data_key;
+	size_t size;
+
+	size = PATH_POS + DATA_META_KEY_SIZE_DIFF;
+	data_key = kmalloc(size, GFP_NOIO);
+	if (data_key == NULL)
+		return -ENOMEM;
+	lightfs_key_set_magic(data_key, DATA_KEY_MAGIC);
+	lightfs_key_set_ino(data_key, ino);
+	lightfs_data_key_set_blocknum(data_key, size, block_num);
+
+	dbt_setup(data_dbt, data_key, size);
+	return 0;
+}
+
+static void
+copy_data_dbt_from_ino(DBT *data_dbt, uint64_t ino, uint64_t block_num)
+{
+	char *data_key = data_dbt->data;
+	size_t size;
+
+	size = PATH_POS + DATA_META_KEY_SIZE_DIFF;
+	BUG_ON(size > data_dbt->ulen);
+	lightfs_key_set_magic(data_key, DATA_KEY_MAGIC);
+	lightfs_key_set_ino(data_key, ino);
+	lightfs_data_key_set_blocknum(data_key, size, block_num);
+
+	data_dbt->size = size;
+}
+
+/* lightfs_bstore.c */
+static int env_keycmp(DBT const *a, DBT const *b)
+{
+	int r;
+	uint32_t alen, blen;
+	alen = a->size;
+	blen = b->size;
+	if (alen < blen) {
+		r = memcmp(a->data, b->data, alen);
+		if (r)
+			return r;
+		return -1;
+	} else if (alen > blen) {
+		r = memcmp(a->data, b->data, blen);
+		if (r)
+			return r;
+		return 1;
+	}
+	// alen == blen
+	return memcmp(a->data, b->data, alen);
+}
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *name, int param, uint64_t ns, uint64_t ops, uint64_t bytes)
+{
+	printf("%-24s %6d %12lu %12.2f %12.2f\n",
+	       name, param, ops, (double)ns / ops, (double)bytes / ops);
+}
+
+static char names[NR_NAMES][NAME_MAX_LEN + 1];
+
+static void make_names(int name_len)
+{
+	int i, j;
+
+	for (i = 0; i < NR_NAMES; i++) {
+		for (j = 0; j < name_len; j++)
+			names[i][j] = 'a' + ((i * 7 + j * 13) % 26);
+		names[i][name_len] = '\0';
+	}
+}
+
+static void bench_meta_key(int name_len, uint64_t iters)
+{
+	DBT dbt;
+	uint64_t i, start, bytes = 0;
+
+	make_names(name_len);
+	start = now_ns();
+	for (i = 0; i < iters; i++) {
+		alloc_child_meta_dbt_from_ino(&dbt, i, names[i % NR_NAMES]);
+		bytes += dbt.size;
+		sink += ((char *)dbt.data)[dbt.size - 2];
+		kfree(dbt.data);
+	}
+	report("meta_key_alloc", name_len, now_ns() - start, iters, bytes);
+}
+
+static void bench_data_key(uint64_t iters)
+{
+	DBT dbt;
+	char key[PATH_POS + DATA_META_KEY_SIZE_DIFF];
+	uint64_t i, start, bytes = 0;
+
+	start = now_ns();
+	for (i = 0; i < iters; i++) {
+		alloc_data_dbt_from_ino(&dbt, 42, i + 1);
+		bytes += dbt.size;
+		sink += lightfs_data_key_get_blocknum(dbt.data, dbt.size);
+		kfree(dbt.data);
+	}
+	report("data_key_alloc", 0, now_ns() - start, iters, bytes);
+
+	dbt_setup(&dbt, key, sizeof(key));
+	bytes = 0;
+	start = now_ns();
+	for (i = 0; i < iters; i++) {
+		copy_data_dbt_from_ino(&dbt, 42, 1);
+		lightfs_data_key_set_blocknum(dbt.data, dbt.size, i + 1);
+		bytes += dbt.size;
+		sink += lightfs_key_get_ino(dbt.data);
+	}
+	report("data_key_copy", 0, now_ns() - start, iters, bytes);
+}
+
+/*
+ * Siblings share the parent ino and usually a name prefix, which is
+ * the worst case for memcmp in env_keycmp.
+ */
+static void bench_keycmp(int name_len, uint64_t iters)
+{
+	static DBT keys[NR_NAMES];
+	uint64_t i, start, bytes = 0;
+	int j;
+
+	make_names(name_len);
+	for (j = 0; j < NR_NAMES; j++) {
+		memset(names[j], 'x', name_len > 8 ? name_len - 8 : 0);
+		alloc_child_meta_dbt_from_ino(&keys[j], 1, names[j]);
+	}
+
+	start = now_ns();
+	for (i = 0; i < iters; i++) {
+		DBT *a = &keys[i % NR_NAMES];
+		DBT *b = &keys[(i * 31 + 7) % NR_NAMES];
+
+		sink += env_keycmp(a, b);
+		bytes += a->size < b->size ? a->size : b->size;
+	}
+	report("keycmp_meta", name_len, now_ns() - start, iters, bytes);
+
+	for (j = 0; j < NR_NAMES; j++)
+		kfree(keys[j].data);
+}
+
+static void bench_keycmp_data(uint64_t iters)
+{
+	static DBT keys[NR_NAMES];
+	uint64_t i, start, bytes = 0;
+	int j;
+
+	for (j = 0; j < NR_NAMES; j++)
+		alloc_data_dbt_from_ino(&keys[j], 42, j + 1);
+
+	start = now_ns();
+	for (i = 0; i < iters; i++) {
+		DBT *a = &keys[i % NR_NAMES];
+		DBT *b = &keys[(i * 31 + 7) % NR_NAMES];
+
+		sink += env_keycmp(a, b);
+		bytes += a->size;
+	}
+	report("keycmp_data", 0, now_ns() - start, iters, bytes);
+
+	for (j = 0; j < NR_NAMES; j++)
+		kfree(keys[j].data);
+}
+
+/*
+ * Fill a cheeze buffer the way lightfs_c_txn_transfer does: txn_id, cnt,
+ * then records until C_TXN_LIMIT_BYTES.
+ */
+static void bench_serialize(const char *name, int type, int value_len, int rounds)
+{
+	char *buf = malloc(LIGHTFS_IO_LARGE_BUF);
+	char value[PAGE_SIZE];
+	DBT meta_key, data_key;
+	uint64_t start, ns = 0, ops = 0, bytes = 0;
+	int r, idx;
+	uint16_t cnt;
+
+	memset(value, 0xab, sizeof(value));
+	make_names(16);
+	if (alloc_child_meta_dbt_from_ino(&meta_key, 1, names[0]) ||
+	    alloc_data_dbt_from_ino(&data_key, 42, 1))
+		exit(1);
+
+	for (r = 0; r < rounds; r++) {
+		start = now_ns();
+		idx = lightfs_io_set_txn_id(buf, r, 0);
+		idx = lightfs_io_set_cnt(buf + idx, 0, idx);
+		for (cnt = 0; idx + PATH_MAX + PAGE_SIZE < C_TXN_LIMIT_BYTES; cnt++) {
+			switch (type) {
+			case LIGHTFS_META_SET:
+				idx = lightfs_io_set_buf_meta_set(buf, type, meta_key.size, meta_key.data, 0, INODE_SIZE, value, idx);
+				break;
+			case LIGHTFS_DATA_SET:
+				lightfs_data_key_set_blocknum(data_key.data, data_key.size, cnt + 1);
+				idx = lightfs_io_set_buf_set(buf, type, data_key.size, data_key.data, 0, value_len, value, idx);
+				break;
+			case LIGHTFS_DATA_DEL:
+				lightfs_data_key_set_blocknum(data_key.data, data_key.size, cnt + 1);
+				idx = lightfs_io_set_buf_del(buf, type, data_key.size, data_key.data, idx);
+				break;
+			}
+		}
+		lightfs_io_set_cnt(buf + sizeof(uint32_t), cnt, 0);
+		ns += now_ns() - start;
+		ops += cnt;
+		bytes += idx;
+		sink += buf[idx - 1];
+	}
+	report(name, value_len, ns, ops, bytes);
+
+	kfree(meta_key.data);
+	kfree(data_key.data);
+	free(buf);
+}
+
+static int scan_pages_cb(DBT const *key, DBT const *val, void *extra)
+{
+	char *page = extra;
+
+	if (lightfs_data_key_get_blocknum(key->data, key->size) == 0)
+		return -1;
+	memcpy(page, val->data, val->size);
+	return 0;
+}
+
+/*
+ * Request encoding plus response walk of lightfs_bstore_txn_get_multi:
+ * the device returns cnt pages back to back in the cheeze buffer.
+ */
+static void bench_get_multi(int cnt, uint64_t iters)
+{
+	char *buf = malloc(LIGHTFS_IO_LARGE_BUF);
+	char *page = malloc(PAGE_SIZE);
+	struct cheeze_req_user req;
+	DBT data_key, value;
+	uint64_t i, start, bytes = 0;
+	uint64_t block_num;
+	int idx, j;
+
+	memset(buf, 0xcd, LIGHTFS_IO_LARGE_BUF);
+	if (alloc_data_dbt_from_ino(&data_key, 42, 1))
+		exit(1);
+
+	start = now_ns();
+	for (i = 0; i < iters; i++) {
+		idx = lightfs_io_set_txn_id(buf, i, 0);
+		idx = lightfs_io_set_cnt(buf + idx, cnt, idx);
+		idx = lightfs_io_set_buf_get_multi(buf, LIGHTFS_GET_MULTI, data_key.size, data_key.data, idx);
+		lightfs_io_set_cheeze_req(&req, idx, buf, buf, 0);
+
+		block_num = 1;
+		for (j = 0; j < cnt; j++) {
+			lightfs_data_key_set_blocknum(data_key.data, data_key.size, block_num++);
+			dbt_setup(&value, req.ret_buf + (j * PAGE_SIZE), PAGE_SIZE);
+			scan_pages_cb(&data_key, &value, page);
+		}
+		bytes += idx + (uint64_t)cnt * PAGE_SIZE;
+		sink += page[0];
+	}
+	report("get_multi_parse", cnt, now_ns() - start, iters, bytes);
+
+	kfree(data_key.data);
+	free(page);
+	free(buf);
+}
+
+int main(int argc, char *argv[])
+{
+	static const int name_lens[] = { 8, 16, 64, 255 };
+	static const int data_lens[] = { 512, 4096 };
+	static const int multi_cnts[] = { 1, 8, 32, 128, 512 };
+	uint64_t iters = 1000000;
+	int i;
+
+	if (argc > 1)
+		iters = strtoull(argv[1], NULL, 0);
+
+	printf("%-24s %6s %12s %12s %12s\n", "bench", "param", "ops", "ns/op", "bytes/op");
+
+	for (i = 0; i < sizeof(name_lens) / sizeof(name_lens[0]); i++)
+		bench_meta_key(name_lens[i], iters);
+	bench_data_key(iters);
+
+	for (i = 0; i < sizeof(name_lens) / sizeof(name_lens[0]); i++)
+		bench_keycmp(name_lens[i], iters);
+	bench_keycmp_data(iters);
+
+	bench_serialize("serialize_meta_set", LIGHTFS_META_SET, INODE_SIZE, 64);
+	for (i = 0; i < sizeof(data_lens) / sizeof(data_lens[0]); i++)
+		bench_serialize("serialize_data_set", LIGHTFS_DATA_SET, data_lens[i], 64);
+	bench_serialize("serialize_data_del", LIGHTFS_DATA_DEL, 0, 64);
+
+	for (i = 0; i < sizeof(multi_cnts) / sizeof(multi_cnts[0]); i++)
+		bench_get_multi(multi_cnts[i], iters / multi_cnts[i] + 1);
+
+	return 0;
+}
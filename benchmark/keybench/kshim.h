@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Minimal kernel shim so the kevinfs key helpers and lightfs_io.h
+ * serializers can be built as a plain user-space program.
+ */
+
+#ifndef __KEYBENCH_KSHIM_H
+#define __KEYBENCH_KSHIM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <endian.h>
+#include <assert.h>
+
+#ifdef __x86_64__
+#define CONFIG_X86_64 1
+#endif
+
+#define printk printf
+#define vprintk vprintf
+#define KERN_CRIT ""
+#define KERN_ALERT ""
+#define pr_info printf
+#define BUG_ON(cond) assert(!(cond))
+
+#define cpu_to_be64 htobe64
+#define be64_to_cpu be64toh
+#define le32_to_cpu le32toh
+
+#define GFP_NOIO 0
+#define kmalloc(size, flags) malloc(size)
+#define kfree(ptr) free(ptr)
+
+#define ENOMEM 12
+#define PAGE_SIZE 4096
+#define PATH_MAX 4096
+#define INODE_SIZE 152
+#define LIGHTFS_IO_LARGE_BUF (2 * 1024 * 1024)
+#define C_TXN_LIMIT_BYTES (1569760)
+
+#define DB_DBT_USERMEM 0x800
+
+/* lightfs_io.h pulls these from lightfs.h and cheeze.h, which are kernel only */
+typedef struct __lightfs_db_io DB_IO;
+typedef struct __lightfs_dbt DBT;
+
+struct __lightfs_dbt {
+	void*data;
+	uint32_t size;
+	uint32_t ulen;
+	uint32_t flags;
+};
+
+struct cheeze_req_user {
+	int id;
+	int buf_len;
+	char *buf;
+	int ubuf_len;
+	char *ubuf;
+	char *ret_buf;
+} __attribute__((aligned(8), packed));
+
+/* lightfs_req_type in db.h, keep in sync */
+enum lightfs_req_type {
+	LIGHTFS_META_GET = 0,
+	LIGHTFS_META_SET,
+	LIGHTFS_META_SYNC_SET,
+	LIGHTFS_META_DEL,
+	LIGHTFS_META_CURSOR,
+	LIGHTFS_META_UPDATE,
+	LIGHTFS_META_RENAME,
+	LIGHTFS_DATA_GET,
+	LIGHTFS_DATA_SET,
+	LIGHTFS_DATA_SEQ_SET,
+	LIGHTFS_DATA_DEL,
+	LIGHTFS_DATA_DEL_MULTI,
+	LIGHTFS_DATA_CURSOR,
+	LIGHTFS_DATA_UPDATE,
+	LIGHTFS_DATA_RENAME,
+	LIGHTFS_COMMIT,
+	LIGHTFS_GET_MULTI,
+	LIGHTFS_DATA_SET_WB,
+	LIGHTFS_GET_MULTI_REAL,
+	LIGHTFS_DEL_MULTI_REAL,
+	LIGHTFS_TXN_TRANSFER,
+	LIGHTFS_GET_MULTI_READA,
+	LIGHTFS_GET_MULTI_READA_REAL,
+	LIGHTFS_DATA_EXT_WB,
+};
+
+#endif
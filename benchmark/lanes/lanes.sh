@@ -0,0 +1,55 @@
+#!/bin/bash
+
+# Read latency under bulk writeback, for the cheeze priority lanes. A fio
+# writer streams 128K buffered writes (with periodic fsync) into one file
+# while a reader does 4K O_DIRECT random reads of another, prewritten
+# file at queue depth 1, so every read is a synchronous GET_MULTI. The
+# reader's p50/p99 completion latency is printed for a lightfs.ko built
+# with -DPRIO_LANE and for one built without it; build both with
+# -DMONITOR to also get the per-lane latency summary at rmmod.
+#
+# The lanes are in the cheeze path, so the modules must not be built with
+# -DEMULATION or -DNULL_IO. /dev/loop3 is set up as in kevinfs/run.sh.
+#
+#   ./lanes.sh <lightfs.ko with PRIO_LANE> <lightfs.ko without>
+
+target_dir=/bench
+size=${SIZE:-8G}
+runtime=${RUNTIME:-60}
+
+if [ $# -ne 2 ]; then
+    echo "usage: $0 <lightfs.ko with PRIO_LANE> <lightfs.ko without>"
+    exit 1
+fi
+
+flush() {
+    sync
+    echo 3 > /proc/sys/vm/drop_caches
+}
+
+run() {
+    local name=$1 module=$2
+
+    insmod $module || exit 1
+    mount -t lightfs /dev/loop3 $target_dir || exit 1
+
+    fio --name=prefill --filename=$target_dir/readfile --size=$size \
+        --rw=write --bs=1M --end_fsync=1 > /dev/null || exit 1
+    flush
+
+    echo "== $name"
+    fio --percentile_list=50:99 --runtime=$runtime --time_based \
+        --name=writer --filename=$target_dir/writefile --size=$size \
+        --rw=write --bs=128k --ioengine=libaio --iodepth=32 --fsync=256 \
+        --name=reader --filename=$target_dir/readfile --size=$size \
+        --rw=randread --bs=4k --direct=1 --ioengine=psync \
+        | grep -E "^(writer|reader)|IOPS=|50.00th|99.00th"
+
+    rm -f $target_dir/readfile $target_dir/writefile
+    umount $target_dir
+    rmmod lightfs
+    dmesg | grep "\[lane " | tail -n 2
+}
+
+run lanes $1
+run shared $2
@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# Lookup scaling on kevinfs, 1..64 threads on one shared tree.
+# Dentries and inodes are dropped every second while the benchmark runs,
+# otherwise the VFS dcache answers the stat() calls and lightfs_lookup
+# (and its metadata cache) is never reached.
+
+target_dir=${1:-/bench}
+
+make -C $(dirname $0) statbench || exit 1
+statbench=$(dirname $0)/statbench
+
+$statbench -c ${target_dir}/tree || exit 1
+sync
+
+while true; do
+    echo 2 > /proc/sys/vm/drop_caches
+    sleep 1
+done &
+dropper=$!
+
+$statbench ${target_dir}/tree
+
+kill $dropper
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Metadata lookup scaling: N threads stat() random files of one shared
+ * directory tree, reports lookups/s for each thread count.
+ *
+ *   ./statbench -c /bench/tree     create the tree (depth x fanout)
+ *   ./statbench /bench/tree        run 1..64 threads
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#define DEPTH 3
+#define FANOUT 16
+#define FILES_PER_DIR 64
+#define RUNTIME_SEC 10
+#define MAX_THREADS 64
+
+static const char *root;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned int seed;
+	uint64_t ops;
+};
+
+static void make_path(char *path, size_t len, unsigned int *seed)
+{
+	int n, d;
+
+	n = snprintf(path, len, "%s", root);
+	for (d = 0; d < DEPTH; d++)
+		n += snprintf(path + n, len - n, "/d%02d", rand_r(seed) % FANOUT);
+	snprintf(path + n, len - n, "/f%03d", rand_r(seed) % FILES_PER_DIR);
+}
+
+static int create_tree(const char *dir, int depth)
+{
+	char path[4096];
+	int i, fd;
+
+	if (mkdir(dir, 0755) && depth == DEPTH) {
+		perror(dir);
+		return -1;
+	}
+	if (depth == 0) {
+		for (i = 0; i < FILES_PER_DIR; i++) {
+			snprintf(path, sizeof(path), "%s/f%03d", dir, i);
+			fd = open(path, O_CREAT | O_WRONLY, 0644);
+			if (fd < 0) {
+				perror(path);
+				return -1;
+			}
+			close(fd);
+		}
+		return 0;
+	}
+	for (i = 0; i < FANOUT; i++) {
+		snprintf(path, sizeof(path), "%s/d%02d", dir, i);
+		if (create_tree(path, depth - 1))
+			return -1;
+	}
+	return 0;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	struct stat st;
+	char path[4096];
+
+	while (!stop) {
+		make_path(path, sizeof(path), &w->seed);
+		if (stat(path, &st)) {
+			perror(path);
+			exit(1);
+		}
+		w->ops++;
+	}
+	return NULL;
+}
+
+static void run(int nr_threads)
+{
+	static struct worker workers[MAX_THREADS];
+	uint64_t total = 0;
+	int i;
+
+	stop = 0;
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].seed = i + 1;
+		workers[i].ops = 0;
+		pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i]);
+	}
+	sleep(RUNTIME_SEC);
+	stop = 1;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].ops;
+	}
+	printf("%8d %16lu %16.0f %16.0f\n", nr_threads, total,
+	       (double)total / RUNTIME_SEC, (double)total / RUNTIME_SEC / nr_threads);
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	if (argc == 3 && !strcmp(argv[1], "-c"))
+		return create_tree(argv[2], DEPTH) ? 1 : 0;
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s [-c] <dir>\n", argv[0]);
+		return 1;
+	}
+	root = argv[1];
+
+	printf("%8s %16s %16s %16s\n", "threads", "lookups", "lookups/s", "per-thread/s");
+	for (i = 1; i <= MAX_THREADS; i *= 2)
+		run(i);
+
+	return 0;
+}
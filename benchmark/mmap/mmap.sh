@@ -0,0 +1,40 @@
+#!/bin/bash
+
+# Page faults on kevinfs mappings: mmapbench does random 4K loads and
+# stores through a shared mapping of a file larger than the touched
+# working set, with and without MADV_RANDOM, for 1..16 threads. The page
+# cache is dropped before every run so the faults go to the device, then
+# fio's mmap engine repeats the random reads for comparison.
+#
+#   ./mmap.sh [dir]    SIZE=4G
+
+target_dir=${1:-/bench}
+size=${SIZE:-4G}
+file=$target_dir/mmap.dat
+
+make -C $(dirname $0) mmapbench || exit 1
+mmapbench=$(dirname $0)/mmapbench
+
+flush() {
+    sync
+    echo 3 > /proc/sys/vm/drop_caches
+}
+
+rm -f $file
+fio --name=fill --filename=$file --rw=write --bs=1M --size=$size \
+    --end_fsync=1 > /dev/null || exit 1
+
+for flags in "" "-r" "-w" "-r -w"; do
+    for threads in 1 4 16; do
+        flush
+        $mmapbench $flags $file $threads | tail -n 1
+    done
+done
+
+for advice in 0 1; do
+    flush
+    fio --name=mmap-randread --filename=$file --ioengine=mmap --rw=randread \
+        --bs=4k --size=$size --numjobs=4 --time_based --runtime=30 \
+        --fadvise_hint=$advice --group_reporting | grep -E "IOPS|lat \("
+done
+rm -f $file
@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Random reads through a shared mapping, like a memory-mapped database:
+ * every thread touches one byte of random 4K pages of a preallocated
+ * file for a fixed time. Reports touches/s, page faults/s and the major
+ * faults that went to the device.
+ *
+ *   ./mmapbench [-r] [-w] <file> [threads]
+ *     -r   madvise(MADV_RANDOM) on the mapping
+ *     -w   store instead of load, every first touch goes to page_mkwrite
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PAGE 4096
+#define RUNTIME_SEC 30
+
+static char *map;
+static size_t nr_pages;
+static int use_write;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned int seed;
+	uint64_t ops;
+	uint64_t sum;
+};
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	size_t idx;
+
+	while (!stop) {
+		idx = ((size_t)rand_r(&w->seed) << 16 ^ rand_r(&w->seed)) % nr_pages;
+		if (use_write)
+			map[idx * PAGE] = (char)w->ops;
+		else
+			w->sum += map[idx * PAGE];
+		w->ops++;
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct worker *workers;
+	struct rusage ru;
+	struct stat st;
+	uint64_t total = 0;
+	int nr_threads = 1, use_random = 0, opt, fd, i;
+
+	while ((opt = getopt(argc, argv, "rw")) != -1) {
+		switch (opt) {
+		case 'r':
+			use_random = 1;
+			break;
+		case 'w':
+			use_write = 1;
+			break;
+		default:
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "usage: %s [-r] [-w] <file> [threads]\n", argv[0]);
+		return 1;
+	}
+	if (optind + 1 < argc)
+		nr_threads = atoi(argv[optind + 1]);
+
+	fd = open(argv[optind], O_RDWR);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(argv[optind]);
+		return 1;
+	}
+	nr_pages = st.st_size / PAGE;
+	if (!nr_pages) {
+		fprintf(stderr, "%s: empty file\n", argv[optind]);
+		return 1;
+	}
+	map = mmap(NULL, nr_pages * PAGE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	if (use_random && madvise(map, nr_pages * PAGE, MADV_RANDOM)) {
+		perror("madvise");
+		return 1;
+	}
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].seed = i + 1;
+		pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i]);
+	}
+	sleep(RUNTIME_SEC);
+	stop = 1;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].ops;
+	}
+	getrusage(RUSAGE_SELF, &ru);
+	if (use_write)
+		msync(map, nr_pages * PAGE, MS_SYNC);
+	munmap(map, nr_pages * PAGE);
+	close(fd);
+
+	printf("%-6s %-7s %8s %14s %12s %12s\n",
+	       "access", "advice", "threads", "touches/s", "faults/s", "majflt/s");
+	printf("%-6s %-7s %8d %14.0f %12.0f %12.0f\n",
+	       use_write ? "store" : "load", use_random ? "random" : "normal",
+	       nr_threads, (double)total / RUNTIME_SEC,
+	       (double)(ru.ru_majflt + ru.ru_minflt) / RUNTIME_SEC,
+	       (double)ru.ru_majflt / RUNTIME_SEC);
+	return 0;
+}
@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Populate a kevinfs mount for the remount benchmark: N empty files
+ * spread over directories of FILES_PER_DIR files, created by NR_THREADS
+ * threads, one directory per thread at a time.
+ *
+ *   ./mkfiles /bench/tree 1000000
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define FILES_PER_DIR 1000
+#define DIRS_PER_DIR 1000
+#define NR_THREADS 32
+
+static const char *root;
+static uint64_t nr_files, nr_dirs;
+static uint64_t next_dir;
+
+/* dir n is root/t<n / DIRS_PER_DIR>/d<n % DIRS_PER_DIR> */
+static void dir_path(char *path, size_t len, uint64_t n)
+{
+	snprintf(path, len, "%s/t%06lu/d%03lu", root,
+	         n / DIRS_PER_DIR, n % DIRS_PER_DIR);
+}
+
+static void *worker(void *arg)
+{
+	char path[4096];
+	uint64_t n, i, cnt;
+	int fd;
+
+	while ((n = __sync_fetch_and_add(&next_dir, 1)) < nr_dirs) {
+		dir_path(path, sizeof(path), n);
+		if (mkdir(path, 0755)) {
+			perror(path);
+			exit(1);
+		}
+		cnt = nr_files - n * FILES_PER_DIR;
+		if (cnt > FILES_PER_DIR)
+			cnt = FILES_PER_DIR;
+		for (i = 0; i < cnt; i++) {
+			dir_path(path, sizeof(path), n);
+			snprintf(path + strlen(path), sizeof(path) - strlen(path),
+			         "/f%03lu", i);
+			fd = open(path, O_CREAT | O_WRONLY, 0644);
+			if (fd < 0) {
+				perror(path);
+				exit(1);
+			}
+			close(fd);
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t threads[NR_THREADS];
+	char path[4096];
+	uint64_t t;
+	int i;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <dir> <nr_files>\n", argv[0]);
+		return 1;
+	}
+	root = argv[1];
+	nr_files = strtoull(argv[2], NULL, 0);
+	nr_dirs = (nr_files + FILES_PER_DIR - 1) / FILES_PER_DIR;
+
+	if (mkdir(root, 0755)) {
+		perror(root);
+		return 1;
+	}
+	for (t = 0; t * DIRS_PER_DIR < nr_dirs; t++) {
+		snprintf(path, sizeof(path), "%s/t%06lu", root, t);
+		if (mkdir(path, 0755)) {
+			perror(path);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < NR_THREADS; i++)
+		pthread_create(&threads[i], NULL, worker, NULL);
+	for (i = 0; i < NR_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	printf("%lu files in %lu dirs\n", nr_files, nr_dirs);
+	return 0;
+}
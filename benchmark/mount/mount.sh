@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Remount cost of kevinfs for 10^5..10^8 files on the persistent emulator.
+# The flash driver (or emulator) must keep its contents across umount, and
+# lightfs.ko must be loaded. For every size the tree is created, the fs is
+# remounted and three times are taken (ms):
+#   mount       mount(2), root read back from the device
+#   lookup      first stat() of a file two directories down
+#   readdir     first full listing of another leaf directory
+# The directories on the path are loaded into the metadata cache by the
+# first lookup, so lookup and readdir include those ITER scans.
+
+dev=${1:-/dev/loop3}
+target_dir=${2:-/bench}
+sizes=${SIZES:-"100000 1000000 10000000 100000000"}
+
+make -C $(dirname $0) mkfiles || exit 1
+mkfiles=$(dirname $0)/mkfiles
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+printf "%12s %10s %10s %10s\n" files mount lookup readdir
+for n in $sizes; do
+    mountpoint -q $target_dir || mount -t lightfs $dev $target_dir || exit 1
+    rm -rf $target_dir/tree
+    $mkfiles $target_dir/tree $n > /dev/null || exit 1
+    sync
+    umount $target_dir || exit 1
+    echo 3 > /proc/sys/vm/drop_caches
+
+    t0=$(now_ms)
+    mount -t lightfs $dev $target_dir || exit 1
+    t1=$(now_ms)
+    stat $target_dir/tree/t000000/d000/f000 > /dev/null || exit 1
+    t2=$(now_ms)
+    ls -f $target_dir/tree/t000000/d001 > /dev/null || exit 1
+    t3=$(now_ms)
+
+    printf "%12d %10d %10d %10d\n" $n $((t1 - t0)) $((t2 - t1)) $((t3 - t2))
+done
+umount $target_dir
@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# Software ceiling of kevinfs: the fio and filebench suites on a lightfs.ko
+# built with -DNULL_IO (and -DMONITOR for the per-op counts), where every
+# request is acked at once and nothing is stored. Throughput here bounds
+# what any device can give; the fio "cpu" line and filebench's per-op
+# latency are the cost of the fs itself. File data reads back as zeroes.
+#
+# /dev/loop3 is set up as in kevinfs/run.sh, and the fs is mounted on
+# /bench, where fio/global.fio puts its file.
+#
+#   ./null.sh <lightfs.ko>
+
+module=${1:?usage: $0 <lightfs.ko>}
+target_dir=/bench
+bench_dir=$(cd $(dirname $0)/.. && pwd)
+
+flush() {
+    sync
+    echo 3 > /proc/sys/vm/drop_caches
+}
+
+insmod $module || exit 1
+mount -t lightfs /dev/loop3 $target_dir || exit 1
+
+for workload in seqwrite seqread randwrite randread; do
+    flush
+    echo "== fio $workload"
+    fio $bench_dir/fio/$workload.fio | grep -E "IOPS=|cpu *:"
+done
+
+for workload in real_fileserver.f real_varmail.f real_webserver.f real_oltp.f; do
+    rm -rf $target_dir/*
+    flush
+    echo "== filebench $workload"
+    sed "s|^set \$dir=.*|set \$dir=$target_dir|" $bench_dir/filebench/workloads/$workload > /tmp/$workload
+    filebench -f /tmp/$workload | grep -E "IO Summary"
+done
+
+umount $target_dir
+rmmod lightfs
+dmesg | sed -n '/LIGHTFS IO SUMMARY/,/=====$/p' | tail -n 30
@@ -0,0 +1,90 @@
+/*
+ * Just enough of the kernel API to build kevinfs/lightfs_queue.c as a
+ * user-space object: atomics on C11 <stdatomic.h>, wait queues on a
+ * pthread mutex/cond pair, allocations on calloc.
+ */
+#ifndef __KSHIM_H__
+#define __KSHIM_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+#define ____cacheline_aligned_in_smp __attribute__((aligned(64)))
+#define cpu_relax() sched_yield()
+
+#define GFP_KERNEL 0
+#define kzalloc(size, gfp) calloc(1, size)
+#define kcalloc(n, size, gfp) calloc(n, size)
+#define vzalloc(size) calloc(1, size)
+#define kfree(p) free(p)
+#define vfree(p) free(p)
+
+static inline unsigned int roundup_pow_of_two(unsigned int n)
+{
+	unsigned int r = 1;
+
+	while (r < n)
+		r <<= 1;
+	return r;
+}
+
+typedef struct {
+	_Atomic int counter;
+} atomic_t;
+
+#define atomic_read(v) atomic_load_explicit(&(v)->counter, memory_order_relaxed)
+#define atomic_set(v, i) atomic_store_explicit(&(v)->counter, (i), memory_order_relaxed)
+#define atomic_read_acquire(v) atomic_load_explicit(&(v)->counter, memory_order_acquire)
+#define atomic_set_release(v, i) atomic_store_explicit(&(v)->counter, (i), memory_order_release)
+
+static inline int atomic_cmpxchg(atomic_t *v, int old, int new)
+{
+	atomic_compare_exchange_strong(&v->counter, &old, new);
+	return old;
+}
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	atomic_int sleepers;
+} wait_queue_head_t;
+
+static inline void init_waitqueue_head(wait_queue_head_t *wq)
+{
+	pthread_mutex_init(&wq->lock, NULL);
+	pthread_cond_init(&wq->cond, NULL);
+	atomic_init(&wq->sleepers, 0);
+}
+
+// sleepers is raised before condition is rechecked, wq_has_sleeper() fences
+// after the waker's store: one of the two always sees the other
+#define wait_event(wq_head, condition) do {					\
+	if (condition)							\
+		break;							\
+	pthread_mutex_lock(&(wq_head).lock);				\
+	atomic_fetch_add(&(wq_head).sleepers, 1);			\
+	while (!(condition))						\
+		pthread_cond_wait(&(wq_head).cond, &(wq_head).lock);	\
+	atomic_fetch_sub(&(wq_head).sleepers, 1);			\
+	pthread_mutex_unlock(&(wq_head).lock);				\
+} while (0)
+
+static inline bool wq_has_sleeper(wait_queue_head_t *wq)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	return atomic_load(&wq->sleepers) != 0;
+}
+
+static inline void wake_up(wait_queue_head_t *wq)
+{
+	pthread_mutex_lock(&wq->lock);
+	pthread_cond_broadcast(&wq->cond);
+	pthread_mutex_unlock(&wq->lock);
+}
+
+#endif
@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# lightfs_queue in user space: the lock-free tag ring of kevinfs against
+# the previous semaphore-plus-spinlock queue, for 1..16 producers and
+# consumers at the depth of the transfer tags (CONCURRENT_CNT) and at 64.
+# Every run also checks that each item comes out exactly once and in
+# order. Throughput is in million items per second.
+
+items=${ITEMS:-1000000}
+
+make -C $(dirname $0) || exit 1
+
+printf "%-6s %8s %8s %6s %12s\n" queue producers consumers depth Mitems/s
+for queue in ring sem; do
+    bench=$(dirname $0)/queuebench
+    [ $queue = sem ] && bench=${bench}_sem
+    for depth in 2 64; do
+        for threads in "1 1" "2 2" "4 4" "8 8" "16 16" "1 8" "8 1"; do
+            set -- $threads
+            printf "%-6s " $queue
+            $bench -p $1 -c $2 -q $depth -n $items || exit 1
+        done
+    done
+done
@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Stress test and throughput of lightfs_queue in user space. Linked
+ * against kevinfs/lightfs_queue.c (queuebench) or the previous
+ * semaphore queue (queuebench_sem).
+ *
+ * A peek/pop check runs first. Then producers push tagged items while
+ * consumers peek_and_pop them, and every item must come out exactly once,
+ * in push order per producer as seen by any one consumer.
+ *
+ *   ./queuebench [-p producers] [-c consumers] [-q depth] [-n items]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <time.h>
+
+struct lightfs_queue;
+int lightfs_queue_push(struct lightfs_queue *q, void *data);
+void *lightfs_queue_peek(struct lightfs_queue *q);
+void lightfs_queue_pop(struct lightfs_queue *q, int id);
+void *lightfs_queue_peek_and_pop(struct lightfs_queue *q);
+bool lightfs_queue_is_empty(struct lightfs_queue *q);
+void lightfs_queue_init(struct lightfs_queue **q, int cnt);
+void lightfs_queue_exit(struct lightfs_queue *q);
+
+#define MAX_THREADS 64
+
+static struct lightfs_queue *q;
+static int nr_producers = 4, nr_consumers = 4, depth = 64;
+static uint64_t nr_items = 1000000;
+static atomic_uint_fast64_t claimed;
+static atomic_int errors;
+
+struct consumer {
+	pthread_t thread;
+	uint64_t last[MAX_THREADS];	// last seq seen from each producer
+	uint64_t cnt[MAX_THREADS];
+	uint64_t sum[MAX_THREADS];
+};
+
+static struct consumer consumers[MAX_THREADS];
+
+// producer in the top byte, seq (from 1) below
+#define ITEM(p, seq) ((void *)(uintptr_t)(((uint64_t)(p) << 56) | (seq)))
+#define ITEM_P(v) ((uint64_t)(uintptr_t)(v) >> 56)
+#define ITEM_SEQ(v) ((uint64_t)(uintptr_t)(v) & ((1ULL << 56) - 1))
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fail(const char *msg)
+{
+	fprintf(stderr, "FAILED: %s\n", msg);
+	atomic_fetch_add(&errors, 1);
+}
+
+// tags stay taken from peek to pop, and come back for new pushes after it
+static void check_peek_pop(void)
+{
+	int ids[1024], i, n = depth < 1024 ? depth : 1024;
+
+	lightfs_queue_init(&q, n);
+	if (!lightfs_queue_is_empty(q))
+		fail("new queue not empty");
+	for (i = 0; i < n; i++)
+		ids[i] = lightfs_queue_push(q, ITEM(0, i + 1));
+	for (i = 0; i < n; i++) {
+		if (lightfs_queue_peek(q) != ITEM(0, i + 1))
+			fail("peek out of order");
+	}
+	if (!lightfs_queue_is_empty(q))
+		fail("queue not empty after peeks");
+	for (i = n - 1; i >= 0; i--)
+		lightfs_queue_pop(q, ids[i]);
+	for (i = 0; i < n; i++)
+		lightfs_queue_push(q, ITEM(0, i + 1));
+	for (i = 0; i < n; i++) {
+		if (lightfs_queue_peek_and_pop(q) != ITEM(0, i + 1))
+			fail("peek_and_pop out of order");
+	}
+	lightfs_queue_exit(q);
+}
+
+static void *producer_fn(void *arg)
+{
+	uint64_t p = (uintptr_t)arg, seq;
+
+	for (seq = 1; seq <= nr_items; seq++)
+		lightfs_queue_push(q, ITEM(p, seq));
+	return NULL;
+}
+
+static void *consumer_fn(void *arg)
+{
+	struct consumer *c = arg;
+	uint64_t total = nr_items * nr_producers, p, seq;
+	void *v;
+
+	while (atomic_fetch_add(&claimed, 1) < total) {
+		v = lightfs_queue_peek_and_pop(q);
+		p = ITEM_P(v);
+		seq = ITEM_SEQ(v);
+		if (p >= (uint64_t)nr_producers || seq == 0 || seq > nr_items) {
+			fail("bad item");
+			continue;
+		}
+		if (seq <= c->last[p])
+			fail("out of order");
+		c->last[p] = seq;
+		c->cnt[p]++;
+		c->sum[p] += seq;
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t producers[MAX_THREADS];
+	uint64_t start, ns, cnt, sum;
+	int opt, i, p;
+
+	while ((opt = getopt(argc, argv, "p:c:q:n:")) != -1) {
+		switch (opt) {
+		case 'p':
+			nr_producers = atoi(optarg);
+			break;
+		case 'c':
+			nr_consumers = atoi(optarg);
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		case 'n':
+			nr_items = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p producers] [-c consumers] [-q depth] [-n items]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nr_producers < 1 || nr_producers > MAX_THREADS ||
+	    nr_consumers < 1 || nr_consumers > MAX_THREADS || depth < 1) {
+		fprintf(stderr, "1..%d producers and consumers, depth >= 1\n", MAX_THREADS);
+		return 1;
+	}
+
+	check_peek_pop();
+
+	lightfs_queue_init(&q, depth);
+	start = now_ns();
+	for (i = 0; i < nr_consumers; i++)
+		pthread_create(&consumers[i].thread, NULL, consumer_fn, &consumers[i]);
+	for (p = 0; p < nr_producers; p++)
+		pthread_create(&producers[p], NULL, producer_fn, (void *)(uintptr_t)p);
+	for (p = 0; p < nr_producers; p++)
+		pthread_join(producers[p], NULL);
+	for (i = 0; i < nr_consumers; i++)
+		pthread_join(consumers[i].thread, NULL);
+	ns = now_ns() - start;
+
+	if (!lightfs_queue_is_empty(q))
+		fail("queue not empty at the end");
+	for (p = 0; p < nr_producers; p++) {
+		cnt = sum = 0;
+		for (i = 0; i < nr_consumers; i++) {
+			cnt += consumers[i].cnt[p];
+			sum += consumers[i].sum[p];
+		}
+		if (cnt != nr_items || sum != nr_items * (nr_items + 1) / 2)
+			fail("items lost or duplicated");
+	}
+	lightfs_queue_exit(q);
+
+	printf("%8d %8d %6d %12.2f %s\n", nr_producers, nr_consumers, depth,
+	       (double)nr_items * nr_producers * 1000 / ns,
+	       atomic_load(&errors) ? "FAILED" : "ok");
+	return atomic_load(&errors) ? 1 : 0;
+}
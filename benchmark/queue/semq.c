@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * The previous lightfs_queue in user space, as the baseline: two counting
+ * semaphores for slots and items and one spinlock around the moves of a
+ * tag between the free and the processing list.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+static void INIT_LIST_HEAD(struct list_head *h)
+{
+	h->next = h->prev = h;
+}
+
+static void list_del(struct list_head *e)
+{
+	e->prev->next = e->next;
+	e->next->prev = e->prev;
+}
+
+static void list_add_tail(struct list_head *e, struct list_head *h)
+{
+	e->prev = h->prev;
+	e->next = h;
+	h->prev->next = e;
+	h->prev = e;
+}
+
+static void list_move_tail(struct list_head *e, struct list_head *h)
+{
+	list_del(e);
+	list_add_tail(e, h);
+}
+
+struct lightfs_queue_item {
+	struct list_head tag;	// first, so the list entry is the item
+	void *data;
+	int id;
+};
+
+struct lightfs_queue {
+	sem_t slots;
+	sem_t items;
+	struct list_head free_tag_list;
+	struct list_head processing_tag_list;
+	pthread_spinlock_t queue_spin;
+	struct lightfs_queue_item **item_arr;
+	int cap;
+};
+
+static void down(sem_t *sem)
+{
+	while (sem_wait(sem) && errno == EINTR)
+		;
+}
+
+int lightfs_queue_push(struct lightfs_queue *q, void *data)
+{
+	struct lightfs_queue_item *item;
+	int id;
+
+	down(&q->slots);
+	pthread_spin_lock(&q->queue_spin);
+	item = (struct lightfs_queue_item *)q->free_tag_list.next;
+	list_move_tail(&item->tag, &q->processing_tag_list);
+	id = item->id;
+	item->data = data;
+	pthread_spin_unlock(&q->queue_spin);
+	sem_post(&q->items);
+
+	return id;
+}
+
+void *lightfs_queue_peek(struct lightfs_queue *q)
+{
+	struct lightfs_queue_item *item;
+
+	down(&q->items);
+	pthread_spin_lock(&q->queue_spin);
+	item = (struct lightfs_queue_item *)q->processing_tag_list.next;
+	list_del(&item->tag);
+	pthread_spin_unlock(&q->queue_spin);
+
+	return item->data;
+}
+
+void lightfs_queue_pop(struct lightfs_queue *q, int id)
+{
+	pthread_spin_lock(&q->queue_spin);
+	list_add_tail(&q->item_arr[id]->tag, &q->free_tag_list);
+	pthread_spin_unlock(&q->queue_spin);
+	sem_post(&q->slots);
+}
+
+void *lightfs_queue_peek_and_pop(struct lightfs_queue *q)
+{
+	struct lightfs_queue_item *item;
+	void *data;
+
+	down(&q->items);
+	pthread_spin_lock(&q->queue_spin);
+	item = (struct lightfs_queue_item *)q->processing_tag_list.next;
+	list_del(&item->tag);
+	list_add_tail(&item->tag, &q->free_tag_list);
+	// read under the lock: the kernel version read it after unlock, when
+	// a push may already have reused the tag
+	data = item->data;
+	pthread_spin_unlock(&q->queue_spin);
+	sem_post(&q->slots);
+
+	return data;
+}
+
+bool lightfs_queue_is_empty(struct lightfs_queue *q)
+{
+	bool ret;
+
+	pthread_spin_lock(&q->queue_spin);
+	ret = q->processing_tag_list.next == &q->processing_tag_list;
+	pthread_spin_unlock(&q->queue_spin);
+	return ret;
+}
+
+void lightfs_queue_init(struct lightfs_queue **q, int cnt)
+{
+	struct lightfs_queue *_q = calloc(1, sizeof(*_q));
+	int i;
+
+	INIT_LIST_HEAD(&_q->free_tag_list);
+	INIT_LIST_HEAD(&_q->processing_tag_list);
+	pthread_spin_init(&_q->queue_spin, PTHREAD_PROCESS_PRIVATE);
+	_q->item_arr = calloc(cnt, sizeof(*_q->item_arr));
+	for (i = 0; i < cnt; i++) {
+		_q->item_arr[i] = calloc(1, sizeof(struct lightfs_queue_item));
+		_q->item_arr[i]->id = i;
+		list_add_tail(&_q->item_arr[i]->tag, &_q->free_tag_list);
+	}
+	sem_init(&_q->slots, 0, cnt);
+	sem_init(&_q->items, 0, 0);
+	_q->cap = cnt;
+	*q = _q;
+}
+
+void lightfs_queue_exit(struct lightfs_queue *q)
+{
+	int i;
+
+	for (i = 0; i < q->cap; i++)
+		free(q->item_arr[i]);
+	free(q->item_arr);
+	free(q);
+}
@@ -0,0 +1,62 @@
+#!/bin/bash
+
+# Readahead hit and waste on a mixed job: one fio reader streams a file
+# sequentially while another does 4K random reads of a second file, both
+# buffered. The job runs without hints and with fio's fadvise_hint
+# (POSIX_FADV_SEQUENTIAL / POSIX_FADV_RANDOM per job). After each run the
+# page cache is dropped so unread read-ahead pages are counted, and the
+# deltas of /sys/kernel/debug/lightfs/reada are printed. lightfs.ko must be
+# built with -DREADA and mounted on /bench.
+#
+#   ./hints.sh [dir]    SIZE=4G RUNTIME=60
+
+target_dir=${1:-/bench}
+size=${SIZE:-4G}
+runtime=${RUNTIME:-60}
+stats=/sys/kernel/debug/lightfs/reada
+
+flush() {
+    sync
+    echo 3 > /proc/sys/vm/drop_caches
+}
+
+field() {
+    grep "^$1:" $stats | awk '{print $2}'
+}
+
+if [ ! -r $stats ]; then
+    echo "$stats not found, is lightfs mounted with -DREADA?"
+    exit 1
+fi
+
+for f in seqfile randfile; do
+    fio --name=prefill --filename=$target_dir/$f --size=$size \
+        --rw=write --bs=1M --end_fsync=1 > /dev/null || exit 1
+done
+
+for hints in off on; do
+    if [ $hints = on ]; then
+        seq_hint=sequential rand_hint=random
+    else
+        seq_hint=0 rand_hint=0
+    fi
+    flush
+    for k in windows vfs_windows cancelled pages hits wasted; do
+        eval before_$k=$(field $k)
+    done
+
+    echo "== fadvise hints $hints"
+    fio --runtime=$runtime --time_based \
+        --name=seq --filename=$target_dir/seqfile --size=$size \
+        --rw=read --bs=128k --ioengine=psync --fadvise_hint=$seq_hint \
+        --name=rand --filename=$target_dir/randfile --size=$size \
+        --rw=randread --bs=4k --ioengine=psync --fadvise_hint=$rand_hint \
+        | grep -E "^(seq|rand)|IOPS="
+    flush
+
+    for k in windows vfs_windows cancelled pages hits wasted; do
+        eval "echo $k: \$(( \$(field $k) - before_$k ))"
+    done
+done
+
+rm -f $target_dir/seqfile $target_dir/randfile
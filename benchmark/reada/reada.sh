@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# Single-thread sequential buffered read throughput for the pipelined
+# readahead. One file is written once, then read front to back by a
+# single psync fio job with a cold page cache for every value of the
+# lightfs reada_windows module parameter (0 turns the windows off and
+# leaves the kernel's own readahead). lightfs.ko must be loaded with
+# -DREADA and mounted on /bench.
+#
+#   ./reada.sh [dir]    WINDOWS="0 1 2 4 8 16" SIZE=8G BS="4k 128k"
+
+target_dir=${1:-/bench}
+size=${SIZE:-8G}
+param=/sys/module/lightfs/parameters/reada_windows
+
+flush() {
+    sync
+    echo 3 > /proc/sys/vm/drop_caches
+}
+
+if [ ! -w $param ]; then
+    echo "$param not found, is lightfs.ko loaded?"
+    exit 1
+fi
+orig=$(cat $param)
+
+fio --name=prefill --filename=$target_dir/seqfile --size=$size \
+    --rw=write --bs=1M --end_fsync=1 > /dev/null || exit 1
+
+for bs in ${BS:-4k 128k}; do
+    for windows in ${WINDOWS:-0 1 2 4 8 16}; do
+        echo $windows > $param
+        flush
+        echo "== bs $bs reada_windows $windows"
+        fio --name=seqread --filename=$target_dir/seqfile --size=$size \
+            --rw=read --bs=$bs --ioengine=psync --numjobs=1 \
+            | grep -E "READ:|cpu"
+    done
+done
+
+echo $orig > $param
+rm -f $target_dir/seqfile
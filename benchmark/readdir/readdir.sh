@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# getdents throughput of kevinfs on directories of 10^4..10^6 entries,
+# like a mail spool. lightfs.ko must be loaded and mounted on $1 (default
+# /bench). Every size gets its own directory, filled once.
+
+target_dir=${1:-/bench}
+sizes=${SIZES:-"10000 100000 1000000"}
+
+make -C $(dirname $0) getdentsbench || exit 1
+getdentsbench=$(dirname $0)/getdentsbench
+
+for n in $sizes; do
+    echo "== $n entries"
+    $getdentsbench $target_dir/dir.$n $n
+done
@@ -0,0 +1,59 @@
+#!/bin/bash
+
+# Metadata cache shrinker under memory pressure. filebench fileserver
+# runs in a memory cgroup limited to LIMIT_MB, and a tmpfs file of HOG_MB
+# takes most of the rest of the host. The shrinker is a global one (the
+# cache is not charged to a cgroup), so the hog is what makes reclaim
+# reach it. The shrink_* lines of /sys/kernel/debug/lightfs/cache and the
+# slab usage are sampled every second; the freed/s column is the
+# eviction rate. lightfs.ko is built with -DCACHE_SHRINK and loaded.
+#
+#   ./shrink.sh [dev] [dir]
+
+dev=${1:-/dev/loop3}
+target_dir=${2:-/bench}
+limit_mb=${LIMIT_MB:-512}
+hog_mb=${HOG_MB:-$(($(awk '/MemTotal/ {print $2}' /proc/meminfo) / 1024 * 3 / 4))}
+workloads=$(dirname $0)/../filebench/workloads
+cgroup=/sys/fs/cgroup/memory/lightfs_shrink
+stats=/sys/kernel/debug/lightfs/cache
+
+mountpoint -q /sys/kernel/debug || mount -t debugfs none /sys/kernel/debug
+mountpoint -q $target_dir || mount -t lightfs $dev $target_dir || exit 1
+rm -rf $target_dir/*
+
+mkdir -p $cgroup
+echo $((limit_mb * 1024 * 1024)) > $cgroup/memory.limit_in_bytes
+
+field() {
+    awk -F': ' -v k=$1 '$1 == k {print $2}' $stats
+}
+
+sample() {
+    local last=$(field shrink_freed) freed
+
+    printf "%6s %10s %10s %10s %10s %12s\n" sec items cold dirs freed/s bytes
+    for ((t = 1; ; t++)); do
+        sleep 1
+        freed=$(field shrink_freed)
+        printf "%6d %10d %10d %10d %10d %12d\n" $t $(field items) \
+            $(field shrink_cold) $(field shrink_dirs) $((freed - last)) $(field bytes)
+        last=$freed
+    done
+}
+
+sed "s|^set \$dir=.*|set \$dir=$target_dir|" $workloads/real_fileserver.f > /tmp/real_fileserver.f
+
+sample &
+sampler=$!
+(echo $BASHPID > $cgroup/tasks; exec filebench -f /tmp/real_fileserver.f) &
+filebench=$!
+sleep 10
+dd if=/dev/zero of=/dev/shm/lightfs_hog bs=1M count=$hog_mb 2> /dev/null
+wait $filebench
+kill $sampler
+
+rm -f /dev/shm/lightfs_hog
+cat $stats
+umount $target_dir
+rmdir $cgroup
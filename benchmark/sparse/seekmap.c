@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Map the data segments of a sparse file with SEEK_DATA/SEEK_HOLE and
+ * report how many there are, the bytes they hold and the time the walk
+ * took. With -v every segment is printed.
+ *
+ *   ./seekmap [-v] <file>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t start, segments = 0, data = 0, calls = 0;
+	off_t pos = 0, hole;
+	struct stat st;
+	int verbose = 0, fd, opt;
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		if (opt != 'v')
+			return 1;
+		verbose = 1;
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "usage: %s [-v] <file>\n", argv[0]);
+		return 1;
+	}
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	start = now_ns();
+	for (;;) {
+		pos = lseek(fd, pos, SEEK_DATA);
+		calls++;
+		if (pos < 0) {
+			if (errno != ENXIO) {
+				perror("SEEK_DATA");
+				return 1;
+			}
+			break;
+		}
+		hole = lseek(fd, pos, SEEK_HOLE);
+		calls++;
+		if (hole < 0) {
+			perror("SEEK_HOLE");
+			return 1;
+		}
+		if (verbose)
+			printf("data %12ld - %12ld\n", (long)pos, (long)hole);
+		segments++;
+		data += hole - pos;
+		pos = hole;
+	}
+
+	printf("%-12s %10s %14s %14s %10s %10s\n",
+	       "size", "segments", "data", "blocks*512", "calls", "ms");
+	printf("%-12ld %10lu %14lu %14lu %10lu %10.1f\n",
+	       (long)st.st_size, segments, data, (uint64_t)st.st_blocks * 512,
+	       calls, (now_ns() - start) / 1e6);
+	return 0;
+}
@@ -0,0 +1,49 @@
+#!/bin/bash
+
+# Sparse files on kevinfs: write throughput, capacity and read-back of
+#   dense    sequential write of random data (reference)
+#   zero     sequential write of all-zero buffers, elided at writeback
+#   holey    one 4K block written every 32K, the rest never written
+# "used" is the df delta after the write is synced. seekmap then walks
+# the file with SEEK_DATA/SEEK_HOLE. lightfs.ko must be loaded and
+# mounted on the target dir.
+#
+#   ./sparse.sh [mount point] [size]
+
+target_dir=${1:-/bench}
+size=${2:-4G}
+
+make -C $(dirname $0) seekmap || exit 1
+seekmap=$(dirname $0)/seekmap
+
+flush() {
+    sync
+    echo 3 > /proc/sys/vm/drop_caches
+}
+
+used_kb() {
+    df -k --output=used $target_dir | tail -n 1
+}
+
+run() {
+    local name=$1
+    shift
+
+    rm -f $target_dir/sparse
+    flush
+    before=$(used_kb)
+    echo "== $name"
+    fio --name=$name --filename=$target_dir/sparse --size=$size --bs=4k \
+        --ioengine=psync --end_fsync=1 "$@" | grep -E "WRITE:"
+    flush
+    echo "used $(( $(used_kb) - before )) KB"
+    $seekmap $target_dir/sparse
+    flush
+    fio --name=$name-read --filename=$target_dir/sparse --size=$size --bs=1M \
+        --ioengine=psync --rw=read | grep -E "READ:"
+}
+
+run dense --rw=write --refill_buffers
+run zero --rw=write --zero_buffers
+run holey --rw=write:28k
+rm -f $target_dir/sparse
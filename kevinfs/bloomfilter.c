@@ -1,5 +1,5 @@
 #include "bloomfilter.h"
-#include "murmur3.h"
+#include "lightfs_hash.h"
 
 #define bit_set(v,n)    ((v)[(n) >> 3] |= (0x1 << (0x7 - ((n) & 0x7))))
 #define bit_get(v,n)    ((v)[(n) >> 3] &  (0x1 << (0x7 - ((n) & 0x7))))
@@ -14,15 +14,28 @@ bloomfilter_init(struct bloomfilter *bloomfilter, unsigned int m, unsigned int k
 	memset(bloomfilter->bit_vector, 0, bloomfilter->m >> 3);
 }
 
+/*
+ * Kirsch-Mitzenmacher double hashing, probe i is h1 + i * h2, so all k
+ * probes come from one lightfs_hash64()
+ */
+static inline void
+bloomfilter_hash(const void *key, size_t len, uint32_t *h1, uint32_t *h2)
+{
+	uint64_t h = lightfs_hash64(key, len);
+
+	*h1 = lightfs_hash_bucket(h);
+	*h2 = lightfs_hash_fp(h) | 1;
+}
+
 void
 bloomfilter_set(struct bloomfilter *bloomfilter, const void *key, size_t len)
 {
 	uint32_t i;
-	uint32_t h;
+	uint32_t h, h1, h2;
 
+	bloomfilter_hash(key, len, &h1, &h2);
 	for (i = 0; i < bloomfilter->k; i++) {
-		murmur3_hash32(key, len, i, &h);
-		h %= bloomfilter->m;
+		h = (h1 + i * h2) % bloomfilter->m;
 		bit_set(bloomfilter->bit_vector, h);
 	}
 }
@@ -31,11 +44,11 @@ int
 bloomfilter_get(struct bloomfilter *bloomfilter, const void *key, size_t len)
 {
 	uint32_t i;
-	uint32_t h;
+	uint32_t h, h1, h2;
 
+	bloomfilter_hash(key, len, &h1, &h2);
 	for (i = 0; i < bloomfilter->k; i++) {
-		murmur3_hash32(key, len, i, &h);
-		h %= bloomfilter->m;
+		h = (h1 + i * h2) % bloomfilter->m;
 		if (!bit_get(bloomfilter->bit_vector, h))
 			return 0;
 	}
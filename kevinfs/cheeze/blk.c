@@ -27,12 +27,12 @@ struct class *cheeze_chr_class;
 
 extern char *data_addr[2];
 
-uint64_t cheeze_prepare_io(struct cheeze_req_user *user, char sync, void *extra, bool transfer) {
+uint64_t cheeze_prepare_io(struct cheeze_req_user *user, char sync, void *extra, bool transfer, enum cheeze_lane lane) {
 	int id;
 	uint64_t seq;
 	struct cheeze_req *req;
 	
-	seq = cheeze_push(user);
+	seq = cheeze_push(user, lane);
 	id = user->id;
 	req = reqs + id;
 
@@ -40,6 +40,7 @@ uint64_t cheeze_prepare_io(struct cheeze_req_user *user, char sync, void *extra,
 	req->sync = sync;
 	req->transfer = transfer;
 	req->extra = extra;
+	req->done = NULL;
 
 	return seq;
 }
@@ -53,10 +54,19 @@ void cheeze_io(struct cheeze_req_user *user, void *(*cb)(void *data), void *extr
 {
 	int id;
 	struct cheeze_req *req;
+	bool sync;
 
 	id = user->id;
 
 	req = reqs + id;
+	sync = req->sync; // an async req can complete and be reused under us
+	req->cpu = raw_smp_processor_id();
+#ifdef MONITOR
+	req->submit = ktime_get();
+#endif
+#ifdef PRIO_LANE
+	seq = cheeze_lane_dispatch(req);
+#endif
 
 	send_req(req, id, seq);
 
@@ -64,12 +74,29 @@ void cheeze_io(struct cheeze_req_user *user, void *(*cb)(void *data), void *extr
 		cb(extra);
 	}
 
-	if (req->sync)
+	if (sync)
 		wait_for_completion(&req->acked);
 	//cheeze_move_pop(id);
 }
 EXPORT_SYMBOL(cheeze_io);
 
+/*
+ * Submit a prepared non-sync request and return at once. done(extra) is
+ * called from the completion path once user holds the reply; it must not
+ * sleep and must cheeze_free_io() the tag when it is finished with the
+ * buffer.
+ */
+void cheeze_io_async(struct cheeze_req_user *user, void (*done)(void *extra), void *extra, uint64_t seq)
+{
+	struct cheeze_req *req = reqs + user->id;
+
+	BUG_ON(req->sync);
+	req->done = done;
+	req->extra = extra;
+	cheeze_io(user, NULL, NULL, seq);
+}
+EXPORT_SYMBOL(cheeze_io_async);
+
 int cheeze_init(void)
 {
 	int ret, i;
@@ -44,6 +44,22 @@
 
 #define SKIP INT_MIN
 
+/*
+ * Priority lanes: tags [0, CHEEZE_SYNC_RESERVED) only go to reads, which
+ * also puts them first in an id-order scan of the send events. While
+ * reads are in flight a bulk request is dispatched once per
+ * CHEEZE_SYNC_WEIGHT reads, with at most CHEEZE_BULK_BURST banked.
+ */
+#define CHEEZE_SYNC_RESERVED 64
+#define CHEEZE_SYNC_WEIGHT 4
+#define CHEEZE_BULK_BURST 4
+
+enum cheeze_lane {
+	CHEEZE_LANE_SYNC, // gets and cursors a reader waits for
+	CHEEZE_LANE_BULK, // puts, txn transfers, commits and readahead
+	CHEEZE_LANES,
+};
+
 // #define DEBUG
 #define DEBUG_SLEEP 1
 
@@ -65,6 +81,8 @@ struct cheeze_req_user {
 #ifdef __KERNEL__
 
 #include <linux/list.h>
+#include <linux/llist.h>
+#include <linux/ktime.h>
 
 struct cheeze_queue_item {
 	int id;
@@ -76,14 +94,24 @@ struct cheeze_req {
 	bool sync;
 	bool transfer;
 	void *extra;
+	void (*done)(void *extra); // async completion, runs on the completion path
 	struct cheeze_req_user *user; // Set by koo, needs to be freed by koo
 	struct cheeze_queue_item *item;
+	int cpu; // submitting CPU
+	enum cheeze_lane lane;
+#ifdef COMP_STEER
+	struct llist_node cpl_node;
+#endif
+#ifdef MONITOR
+	ktime_t submit;
+#endif
 };
 
 // blk.c
-uint64_t cheeze_prepare_io(struct cheeze_req_user *user, char sync, void *extra, bool transfer);
+uint64_t cheeze_prepare_io(struct cheeze_req_user *user, char sync, void *extra, bool transfer, enum cheeze_lane lane);
 void cheeze_free_io(int id);
 void cheeze_io(struct cheeze_req_user *user, void *(*cb)(void *data), void *extra, uint64_t seq); // Called by koo
+void cheeze_io_async(struct cheeze_req_user *user, void (*done)(void *extra), void *extra, uint64_t seq);
 extern struct class *cheeze_chr_class;
 // extern struct mutex cheeze_mutex;
 void cheeze_chr_cleanup_module(void);
@@ -91,10 +119,14 @@ int cheeze_chr_init_module(void);
 
 // queue.c
 extern struct cheeze_req *reqs;
-uint64_t cheeze_push(struct cheeze_req_user *user);
+uint64_t cheeze_push(struct cheeze_req_user *user, enum cheeze_lane lane);
 struct cheeze_req *cheeze_peek(void);
 void cheeze_pop(int id);
 void cheeze_move_pop(int id);
+#ifdef PRIO_LANE
+uint64_t cheeze_lane_dispatch(struct cheeze_req *req);
+void cheeze_lane_complete(struct cheeze_req *req);
+#endif
 void cheeze_queue_init(void);
 void cheeze_queue_exit(void);
 
@@ -11,13 +11,17 @@
 #include <linux/backing-dev.h>
 #include <linux/blk-mq.h>
 #include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/atomic.h>
 
 #include "cheeze.h"
 
 //static int front, rear;
 //static struct semaphore mutex, slots, items;
-static struct semaphore slots, items;
-static struct list_head free_tag_list, processing_tag_list; 
+// slots[lane] counts the free tags of free_tag_list[lane]. Without
+// PRIO_LANE every tag is in the bulk pool.
+static struct semaphore slots[CHEEZE_LANES], items;
+static struct list_head free_tag_list[CHEEZE_LANES], processing_tag_list; 
 static int qd = 0;
 static spinlock_t queue_spin;
 static uint64_t seq;
@@ -26,20 +30,47 @@ static uint64_t seq;
 // Protect with lock
 struct cheeze_req *reqs = NULL;
 
+static inline int cheeze_pool(int id)
+{
+#ifdef PRIO_LANE
+	if (id < CHEEZE_SYNC_RESERVED)
+		return CHEEZE_LANE_SYNC;
+#endif
+	return CHEEZE_LANE_BULK;
+}
+
+// returns the pool a slot was taken from
+static int cheeze_take_slot(enum cheeze_lane lane)
+{
+#ifdef PRIO_LANE
+	if (lane == CHEEZE_LANE_SYNC) {
+		if (!down_trylock(&slots[CHEEZE_LANE_SYNC]))
+			return CHEEZE_LANE_SYNC;
+		if (!down_trylock(&slots[CHEEZE_LANE_BULK]))
+			return CHEEZE_LANE_BULK;
+		// only reads hold reserved tags, one comes back soon
+		while(down_interruptible(&slots[CHEEZE_LANE_SYNC]) == -EINTR) {}
+		return CHEEZE_LANE_SYNC;
+	}
+#endif
+	while(down_interruptible(&slots[CHEEZE_LANE_BULK]) == -EINTR) {
+		//pr_info("interrupt - 1\n");
+	}
+	return CHEEZE_LANE_BULK;
+}
+
 // Lock must be held and freed before and after push()
-uint64_t cheeze_push(struct cheeze_req_user *user) {
+uint64_t cheeze_push(struct cheeze_req_user *user, enum cheeze_lane lane) {
 	struct cheeze_req *req;
-	int id;
+	int id, pool;
 	unsigned long irqflags;
-	uint64_t _seq;
+	uint64_t _seq = 0;
 	struct cheeze_queue_item *item; 
 
-	while(down_interruptible(&slots) == -EINTR) {
-		//pr_info("interrupt - 1\n");
-	}
+	pool = cheeze_take_slot(lane);
 	spin_lock_irqsave(&queue_spin, irqflags);
 
-	item = list_first_entry(&free_tag_list, struct cheeze_queue_item, tag_list);
+	item = list_first_entry(&free_tag_list[pool], struct cheeze_queue_item, tag_list);
 	list_move_tail(&item->tag_list, &processing_tag_list);
 	id = item->id;
 
@@ -49,7 +80,10 @@ uint64_t cheeze_push(struct cheeze_req_user *user) {
 	req->user->id = id;
 	reinit_completion(&req->acked);
 	req->item = item;
+	req->lane = lane;
+#ifndef PRIO_LANE
 	_seq = seq++;
+#endif
 	qd++;
 	//pr_info("ID: %d, SEQ: %d\n", id, _seq);
 
@@ -91,12 +125,12 @@ void cheeze_pop(int id) {
 	req = reqs + id;
 	
 	item = req->item;
-	list_add_tail(&item->tag_list, &free_tag_list);
+	list_add_tail(&item->tag_list, &free_tag_list[cheeze_pool(id)]);
 	qd--;
 
 	spin_unlock_irqrestore(&queue_spin, irqflags);
 
-	up(&slots);	/* Announce available slot */
+	up(&slots[cheeze_pool(id)]);	/* Announce available slot */
 }
 
 void cheeze_move_pop(int id) {
@@ -109,14 +143,67 @@ void cheeze_move_pop(int id) {
 	req = reqs + id;
 	
 	item = req->item;
-	list_move_tail(&item->tag_list, &free_tag_list);
+	list_move_tail(&item->tag_list, &free_tag_list[cheeze_pool(id)]);
 	qd--;
 
 	spin_unlock_irqrestore(&queue_spin, irqflags);
 
-	up(&slots);	/* Announce available slot */
+	up(&slots[cheeze_pool(id)]);	/* Announce available slot */
+}
+
+#ifdef PRIO_LANE
+static atomic_t sync_inflight, sync_dispatched, bulk_credit;
+// bulk tickets: the next one to hand out and the one dispatched next
+static atomic_t bulk_ticket, bulk_serving;
+static DECLARE_WAIT_QUEUE_HEAD(bulk_wait);
+
+static bool cheeze_bulk_may_dispatch(int ticket)
+{
+	if (atomic_read(&bulk_serving) != ticket)
+		return false;
+	return !atomic_read(&sync_inflight) || atomic_dec_if_positive(&bulk_credit) >= 0;
 }
 
+/*
+ * Called right before send_req(). A bulk request waits here while reads
+ * are in flight and it has no credit; reads bank one credit per
+ * CHEEZE_SYNC_WEIGHT dispatches. Bulk requests leave in the order they
+ * got here: each takes a ticket and only the oldest one may go, and only
+ * after it took its seq, so the other side sees them in that order too.
+ */
+uint64_t cheeze_lane_dispatch(struct cheeze_req *req) {
+	unsigned long irqflags;
+	uint64_t _seq;
+	int ticket = 0;
+
+	if (req->lane == CHEEZE_LANE_BULK) {
+		ticket = atomic_inc_return(&bulk_ticket) - 1;
+		wait_event(bulk_wait, cheeze_bulk_may_dispatch(ticket));
+	} else {
+		atomic_inc(&sync_inflight);
+		if (atomic_inc_return(&sync_dispatched) % CHEEZE_SYNC_WEIGHT == 0 &&
+		    atomic_add_unless(&bulk_credit, 1, CHEEZE_BULK_BURST))
+			wake_up(&bulk_wait);
+	}
+
+	spin_lock_irqsave(&queue_spin, irqflags);
+	_seq = seq++;
+	spin_unlock_irqrestore(&queue_spin, irqflags);
+
+	if (req->lane == CHEEZE_LANE_BULK) {
+		atomic_inc(&bulk_serving);
+		wake_up(&bulk_wait); // the next ticket
+	}
+
+	return _seq;
+}
+
+void cheeze_lane_complete(struct cheeze_req *req) {
+	if (req->lane == CHEEZE_LANE_SYNC && atomic_dec_and_test(&sync_inflight))
+		wake_up(&bulk_wait);
+}
+#endif
+
 #ifdef PRINT_QD
 static struct hrtimer qd_timer;
 #endif
@@ -144,18 +231,21 @@ void cheeze_queue_init(void) {
 	hrtimer_start(&qd_timer, ktime, HRTIMER_MODE_REL);
 #endif
 	
-	INIT_LIST_HEAD(&free_tag_list);
+	INIT_LIST_HEAD(&free_tag_list[CHEEZE_LANE_SYNC]);
+	INIT_LIST_HEAD(&free_tag_list[CHEEZE_LANE_BULK]);
 	INIT_LIST_HEAD(&processing_tag_list);
 	spin_lock_init(&queue_spin);
 
+	sema_init(&slots[CHEEZE_LANE_SYNC], 0);
+	sema_init(&slots[CHEEZE_LANE_BULK], 0);
 	for (i = 0; i < CHEEZE_QUEUE_SIZE; i++) {
 		item = kzalloc(sizeof(struct cheeze_queue_item), GFP_KERNEL);
 		item->id = i;
 		INIT_LIST_HEAD(&item->tag_list);
-		list_add_tail(&item->tag_list, &free_tag_list);
+		list_add_tail(&item->tag_list, &free_tag_list[cheeze_pool(i)]);
+		up(&slots[cheeze_pool(i)]);	/* Initially, buf has n empty slots */
 	}
 
-	sema_init(&slots, CHEEZE_QUEUE_SIZE);	/* Initially, buf has n empty slots */
 	sema_init(&items, 0);	/* Initially, buf has zero data items */
 	seq = 0;
 }
@@ -8,6 +8,9 @@
 #include <linux/module.h>
 #include <linux/delay.h>
 #include <linux/kthread.h>
+#include <linux/workqueue.h>
+#include <linux/percpu.h>
+#include <linux/log2.h>
 #include "cheeze.h"
 #include "../lightfs_fs.h"
 
@@ -44,79 +47,222 @@ int send_req (struct cheeze_req *req, int id, uint64_t seq) {
 	return 0;
 }
 
+#ifdef MONITOR
+#define CHEEZE_LAT_BUCKETS 32 // log2(us)
+
+struct cheeze_cpl_stat {
+	uint64_t cnt;
+	uint64_t remote; // completed away from the submitting CPU
+	uint64_t lat_ns;
+	uint64_t lane_lat[CHEEZE_LANES][CHEEZE_LAT_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct cheeze_cpl_stat, cheeze_cpl_stats);
+
+static inline void cheeze_cpl_account(struct cheeze_req *req)
+{
+	struct cheeze_cpl_stat *stat = get_cpu_ptr(&cheeze_cpl_stats);
+	uint64_t lat = ktime_to_ns(ktime_sub(ktime_get(), req->submit));
+
+	stat->cnt++;
+	if (req->cpu != smp_processor_id())
+		stat->remote++;
+	stat->lat_ns += lat;
+	stat->lane_lat[req->lane][min_t(int, ilog2(lat / NSEC_PER_USEC | 1), CHEEZE_LAT_BUCKETS - 1)]++;
+	put_cpu_ptr(&cheeze_cpl_stats);
+}
+
+// upper bound (us) of the bucket holding the pct-th percentile
+static uint64_t cheeze_lat_pct(uint64_t *hist, uint64_t total, int pct)
+{
+	uint64_t sum = 0;
+	int i;
+
+	for (i = 0; i < CHEEZE_LAT_BUCKETS; i++) {
+		sum += hist[i];
+		if (sum * 100 >= total * pct)
+			break;
+	}
+	return 2ULL << i;
+}
+
+static void cheeze_lane_print(void)
+{
+	static const char *names[CHEEZE_LANES] = { "sync", "bulk" };
+	uint64_t hist[CHEEZE_LAT_BUCKETS], total;
+	struct cheeze_cpl_stat *stat;
+	int lane, cpu, i;
+
+	for (lane = 0; lane < CHEEZE_LANES; lane++) {
+		memset(hist, 0, sizeof(hist));
+		total = 0;
+		for_each_possible_cpu(cpu) {
+			stat = per_cpu_ptr(&cheeze_cpl_stats, cpu);
+			for (i = 0; i < CHEEZE_LAT_BUCKETS; i++) {
+				hist[i] += stat->lane_lat[lane][i];
+				total += stat->lane_lat[lane][i];
+			}
+		}
+		if (!total)
+			continue;
+		pr_info("[lane %s] requests: %llu, p50 < %llu us, p99 < %llu us\n",
+			names[lane], total, cheeze_lat_pct(hist, total, 50),
+			cheeze_lat_pct(hist, total, 99));
+	}
+}
+
+static void cheeze_cpl_print(void)
+{
+	struct cheeze_cpl_stat *stat;
+	int cpu;
+
+	pr_info("========= CHEEZE COMPLETION SUMMARY =========\n");
+	for_each_possible_cpu(cpu) {
+		stat = per_cpu_ptr(&cheeze_cpl_stats, cpu);
+		if (!stat->cnt)
+			continue;
+		pr_info("[cpu %3d] completions: %llu, remote: %llu, avg latency: %llu ns\n",
+			cpu, stat->cnt, stat->remote, stat->lat_ns / stat->cnt);
+	}
+	cheeze_lane_print();
+}
+#endif
+
+static void cheeze_complete (int id) {
+	struct cheeze_req *req = reqs + id;
+	struct cheeze_req_user *ureq = ureq_addr + id;
+
+#ifdef MONITOR
+	cheeze_cpl_account(req);
+#endif
+#ifdef PRIO_LANE
+	cheeze_lane_complete(req);
+#endif
+	if (req->done) { // async GET, the tag is freed by done()
+		memcpy(req->user, ureq, sizeof(struct cheeze_req_user));
+		req->done(req->extra);
+		return;
+	}
+	//if (!req->sync && !req->extra) {
+	//	*recv = 0;
+		//cheeze_move_pop(id);
+		//memset(ureq, 0, sizeof(struct cheeze_req_user));
+	//	continue;
+	//}
+	if (ureq->ret_buf == NULL || !req->sync || req->transfer) { // SET, TRANSFER
+		//memcpy(req->user, ureq, sizeof(struct cheeze_req_user));
+		if (!req->sync) {
+			cheeze_move_pop(id);
+		} else {
+			complete(&req->acked);
+			cheeze_move_pop(id);
+		}
+	} else {
+		if (ureq->ubuf_len != 0) { // GET
+			//pr_info("[recv req] req->extra: %p\n", req->extra);
+		//pr_info("[recv req] user %p, user->id: %d user->buf_len: %d, user->buf: %p, user->ret_buf: %p user->ubuf_len: %d\n", req->user, req->user->id, req->user->buf_len, req->user->buf, req->user->ret_buf, req->user->ubuf_len);
+		//memcpy(req->user, ureq, sizeof(struct cheeze_req_user));
+			if (req->user->ubuf_len == 152) {
+				memcpy(req->user, ureq, sizeof(struct cheeze_req_user));
+				req->user->ubuf_len = 152;
+			} else {
+				memcpy(req->user, ureq, sizeof(struct cheeze_req_user));
+			}
+			complete(&req->acked);
+
+		//pr_info("[recv req] ureq %p, ureq->id: %d ureq->buf_len: %d, ureq->buf: %p, ureq->ret_buf: %p user->ubuf_len: %d\n", ureq, ureq->id, ureq->buf_len, ureq->buf, ureq->ret_buf, ureq->ubuf_len);
+			//memcpy(ureq->ret_buf, buf, req->user->ubuf_len);
+		} else {
+			memcpy(req->user, ureq, sizeof(struct cheeze_req_user));
+			complete(&req->acked);
+		}
+	}
+}
+
+#ifdef COMP_STEER
+/*
+ * Completion steering: kshm only detects completions, the completion work
+ * (waking waiters, async done() callbacks, copying the ureq back into the
+ * submitter's cheeze_req_user) runs on the CPU that submitted the request,
+ * like blk-mq does.
+ * A per-CPU work item is used instead of an IPI because done() callbacks
+ * take plain spin_lock()s that are also taken in process context.
+ */
+struct cheeze_cpl_queue {
+	struct llist_head list;
+	struct work_struct work;
+};
+
+static DEFINE_PER_CPU(struct cheeze_cpl_queue, cheeze_cpl_queues);
+static struct workqueue_struct *cheeze_cpl_wq;
+
+static void cheeze_cpl_work_fn(struct work_struct *work)
+{
+	struct cheeze_cpl_queue *cq = container_of(work, struct cheeze_cpl_queue, work);
+	struct llist_node *node;
+	struct cheeze_req *req, *tmp;
+
+	node = llist_reverse_order(llist_del_all(&cq->list));
+	// req can be reused as soon as it is completed, so use _safe
+	llist_for_each_entry_safe(req, tmp, node, cpl_node)
+		cheeze_complete(req - reqs);
+}
+
+static void cheeze_steer (int id) {
+	struct cheeze_req *req = reqs + id;
+	struct cheeze_cpl_queue *cq;
+	int cpu = req->cpu;
+
+	if (!cheeze_cpl_wq || cpu == raw_smp_processor_id() || !cpu_online(cpu)) {
+		cheeze_complete(id);
+		return;
+	}
+
+	cq = per_cpu_ptr(&cheeze_cpl_queues, cpu);
+	if (llist_add(&req->cpl_node, &cq->list))
+		queue_work_on(cpu, cheeze_cpl_wq, &cq->work);
+}
+
+static void cheeze_steer_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct cheeze_cpl_queue *cq = per_cpu_ptr(&cheeze_cpl_queues, cpu);
+
+		init_llist_head(&cq->list);
+		INIT_WORK(&cq->work, cheeze_cpl_work_fn);
+	}
+	cheeze_cpl_wq = alloc_workqueue("cheeze_cpl", WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
+	if (!cheeze_cpl_wq)
+		pr_err("cheeze: no completion workqueue, completing on kshm\n");
+}
+
+static void cheeze_steer_exit(void)
+{
+	if (cheeze_cpl_wq) {
+		destroy_workqueue(cheeze_cpl_wq);
+		cheeze_cpl_wq = NULL;
+	}
+}
+#endif
+
 static void recv_req (void) {
 	uint8_t *recv;
-	int i, id;
-	struct cheeze_req *req;
-	struct cheeze_req_user *ureq;
-	char *buf;
+	int i;
 
 	for (i = 0; i < CHEEZE_QUEUE_SIZE; i++) {
 		recv = &recv_event_addr[i];
 		if (*recv) {
-			id = i;
-			req = reqs + id;
-			ureq = ureq_addr + id;
-			buf = get_buf_addr(data_addr, id);
-			//if (!req->sync && !req->extra) {
-			//	*recv = 0;
-				//cheeze_move_pop(id);
-				//memset(ureq, 0, sizeof(struct cheeze_req_user));
-			//	continue;
-			//}
-			if (req->extra && ureq->ubuf_len != 0) {
-				struct reada_entry *ra_entry = (struct reada_entry *)(req->extra);
-				struct lightfs_inode *lightfs_inode = (struct lightfs_inode *)(ra_entry->extra);
-				spin_lock(&lightfs_inode->reada_spin);
-				ra_entry->reada_state |= READA_DONE;
-				complete_all(&ra_entry->reada_acked);
-				spin_unlock(&lightfs_inode->reada_spin);
-			}
-			if (ureq->ret_buf == NULL || !req->sync || req->transfer) { // SET, TRANSFER
-				//memcpy(req->user, ureq, sizeof(struct cheeze_req_user));
-				if (!req->sync) {
-					cheeze_move_pop(id);
-				} else {
-					complete(&req->acked);
-					cheeze_move_pop(id);
-				}
-			} else {
-				if (ureq->ubuf_len != 0) { // GET
-					//pr_info("[recv req] req->extra: %p\n", req->extra);
-				//pr_info("[recv req] user %p, user->id: %d user->buf_len: %d, user->buf: %p, user->ret_buf: %p user->ubuf_len: %d\n", req->user, req->user->id, req->user->buf_len, req->user->buf, req->user->ret_buf, req->user->ubuf_len);
-				//memcpy(req->user, ureq, sizeof(struct cheeze_req_user));
-					if (req->extra != NULL) {
-#ifdef READA
-						struct reada_entry *ra_entry = (struct reada_entry *)(req->extra);
-						struct lightfs_inode *lightfs_inode = (struct lightfs_inode *)(ra_entry->extra);
-						spin_lock(&lightfs_inode->reada_spin);
-						ra_entry->reada_state |= READA_DONE;
-						complete_all(&ra_entry->reada_acked);
-						spin_unlock(&lightfs_inode->reada_spin);
-#endif
-
-					} else {
-						if (req->user->ubuf_len == 152) {
-							memcpy(req->user, ureq, sizeof(struct cheeze_req_user));
-							req->user->ubuf_len = 152;
-						} else {
-							memcpy(req->user, ureq, sizeof(struct cheeze_req_user));
-						}
-						complete(&req->acked);
-					}
-
-				//pr_info("[recv req] ureq %p, ureq->id: %d ureq->buf_len: %d, ureq->buf: %p, ureq->ret_buf: %p user->ubuf_len: %d\n", ureq, ureq->id, ureq->buf_len, ureq->buf, ureq->ret_buf, ureq->ubuf_len);
-					//memcpy(ureq->ret_buf, buf, req->user->ubuf_len);
-				} else {
-					memcpy(req->user, ureq, sizeof(struct cheeze_req_user));
-					complete(&req->acked);
-				}
-			}
 			/* memory barrier XXX:Arm */
-			//cheeze_move_pop(id);
-			//memset(ureq, 0, sizeof(struct cheeze_req_user));
-			barrier();
+			// clear before completing, the slot may be reused right after
 			*recv = 0;
+			barrier();
+#ifdef COMP_STEER
+			cheeze_steer(i);
+#else
+			cheeze_complete(i);
+#endif
 			/* memory barrier XXX:Arm */
 		}
 	}
@@ -258,6 +404,9 @@ void shm_init() {
 #endif
 	shm_meta_init(page_addr[0]);
 	shm_data_init(page_addr);
+#ifdef COMP_STEER
+	cheeze_steer_init();
+#endif
 	shm_task = kthread_run(shm_kthread, NULL, "kshm");
 }
 
@@ -283,6 +432,12 @@ void shm_exit(void)
 
 	kthread_stop(shm_task);
 	shm_task = NULL;
+#ifdef COMP_STEER
+	cheeze_steer_exit();
+#endif
+#ifdef MONITOR
+	cheeze_cpl_print();
+#endif
 }
 
 //module_exit(shm_exit);
@@ -136,8 +136,11 @@ enum lightfs_req_type {
 	LIGHTFS_TXN_TRANSFER,
 	LIGHTFS_GET_MULTI_READA,
 	LIGHTFS_GET_MULTI_READA_REAL,
+	LIGHTFS_DATA_EXT_WB,
 };
 
+struct lightfs_get_async;
+
 struct lightfs_db_key_operations {
     int (*keycmp) (DB *, const DBT *, const DBT *);
 };
@@ -186,6 +189,7 @@ struct __lightfs_db {
 #endif
 	int (*get_multi_reada) (DB *, DB_TXN *, DBT *, uint32_t, void *, enum lightfs_req_type);
 	int (*get) (DB *, DB_TXN *, DBT *, DBT *, enum lightfs_req_type);
+	int (*get_async) (DB *, DB_TXN *, DBT *, DBT *, enum lightfs_req_type, struct lightfs_get_async *);
 	int (*get_flags) (DB *, uint32_t *);
 	int (*open) (DB *, DB_TXN *, const char *, const char *, DBTYPE, uint32_t, int);
 	int (*put) (DB *, DB_TXN *, DBT *, DBT *, enum lightfs_req_type);
@@ -195,6 +199,7 @@ struct __lightfs_db {
 	int (*cache_weak_del) (DB *, DB_TXN *, DBT *, enum lightfs_req_type);
 	int (*cache_del) (DB *, DB_TXN *, DBT *, enum lightfs_req_type, bool is_dir);
 	int (*cache_put) (DB *, DB_TXN *, DBT *, DBT *, enum lightfs_req_type, struct inode *dir_inode, bool is_dir);
+	int (*cache_readdir) (DB *, DBT *dir_key, char *last_name, char *buf, uint32_t buf_size, uint32_t *len);
 };
 
 
@@ -3,6 +3,7 @@
 
 #include "lightfs_fs.h"
 #include <linux/workqueue.h>
+#include <linux/completion.h>
 
 //#define LIGHTFS_TXN_LIMIT 365
 #define LIGHTFS_TXN_LIMIT 310
@@ -37,14 +38,12 @@
 #define CONCURRENT_CNT 2
 #define OPS_CNT 30
 #define MISS_RATE 10
-#define READA_BLOCK_CNT 256
-#define READA_THRESHOLD 64
-#define READA_REISSUE 32
-#define READA_MULTIPLIER 1
-#define READA_QD 4
-#define ENORA 99999
-#define ESMALL 9999
-#define EEOF 999
+#define READA_BLOCK_CNT 256 // pages per readahead window
+#define READA_THRESHOLD 64 // sequential pages before windows are issued
+#define READA_QD 8 // default windows in flight per stream (reada_windows)
+#define READA_QD_MAX 64
+#define FAULT_AROUND_CNT 16 // pages read together on a random mmap fault
+#define MMAP_LOTSAMISS 100 // as in mm/filemap.c, mmap readahead gives up
 
 
 
@@ -54,21 +53,7 @@ typedef struct __lightfs_c_txn DB_C_TXN;
 typedef struct __lightfs_c_txn_list DB_C_TXN_LIST;
 typedef uint32_t TXNID_T;
 
-struct lightfs_queue_item {
-    void *data;
-    int id; 
-    struct list_head tag;
-};
-
-struct lightfs_queue {
-    struct semaphore slots;
-    struct semaphore items;
-    struct list_head free_tag_list;
-    struct list_head processing_tag_list;
-    spinlock_t queue_spin;
-    struct lightfs_queue_item **item_arr;
-    int cap;
-};
+struct lightfs_queue;
 
 
 struct __lightfs_txn_buffer {
@@ -126,6 +111,21 @@ struct lightfs_monitor {
 	atomic64_t ops_num[OPS_CNT];
 };
 
+// handle of an async get, see lightfs_bstore_txn_get_async()
+struct lightfs_get_async {
+	DB_TXN_BUF *txn_buf;
+	void (*cb)(struct lightfs_get_async *ga); // on the completion path, must not sleep
+	void *private;
+	int ret;
+	struct completion done;
+};
+
+static inline int lightfs_get_async_wait(struct lightfs_get_async *ga)
+{
+	wait_for_completion(&ga->done);
+	return ga->ret;
+}
+
 struct __lightfs_db_io {
 	int (*get) (DB *db, DB_TXN_BUF *txn_buf);
 	int (*sync_put) (DB *db, DB_TXN_BUF *txn_buf);
@@ -135,6 +135,7 @@ struct __lightfs_db_io {
 	int (*close) (DB_IO *db_io);
 	int (*get_multi) (DB *db, DB_TXN_BUF *txn_buf);
 	int (*get_multi_reada) (DB *db, DB_TXN_BUF *txn_buf, void *extra);
+	int (*get_async) (DB *db, DB_TXN_BUF *txn_buf, struct lightfs_get_async *ga);
 	struct lightfs_monitor mon;
 };
 
@@ -176,6 +177,7 @@ struct __lightfs_txn_hdlr {
 	struct workqueue_struct **workqs;
 	struct lightfs_queue *workq_tags;
 	uint64_t current_workq_id;
+	bool flush_req; // an fsync waits, do not wait for TXN_FLUSH_TIME
 };
 
 #endif
@@ -223,26 +223,17 @@ int lightfs_bstore_get_ino(DB *meta_db, DB_TXN *txn, ino_t *ino)
 	return ret;
 }
 
-// get the ino_num counting in meta_db
-// if it is smaller than our ino, update that with our ino
-int lightfs_bstore_update_ino(DB *meta_db, DB_TXN *txn, ino_t ino)
+// store ino_num without reading it back, the only writer is the
+// lease worker, which never lowers it
+int lightfs_bstore_put_ino(DB *meta_db, DB_TXN *txn, ino_t ino)
 {
-	int ret;
-	ino_t curr_ino;
 	DBT ino_key_dbt, ino_val_dbt;
 
 	dbt_setup(&ino_key_dbt, ino_key, sizeof(ino_key));
-	dbt_setup(&ino_val_dbt, &curr_ino, sizeof(curr_ino));
-
-	ret = meta_db->get(meta_db, txn, &ino_key_dbt,
-	                   &ino_val_dbt, LIGHTFS_META_GET);
-	if (!ret && ino > curr_ino) {
-		curr_ino = ino;
-		ret = meta_db->put(meta_db, txn, &ino_key_dbt,
-		                   &ino_val_dbt, LIGHTFS_META_SET);
-	}
+	dbt_setup(&ino_val_dbt, &ino, sizeof(ino));
 
-	return ret;
+	return meta_db->put(meta_db, txn, &ino_key_dbt,
+	                    &ino_val_dbt, LIGHTFS_META_SET);
 }
 
 static int env_keycmp(DB *DB, DBT const *a, DBT const *b)
@@ -501,7 +492,8 @@ int lightfs_bstore_meta_get_tmp(DB *meta_db, DBT *meta_dbt, DB_TXN *txn,
 	return ret;
 }
 
-int lightfs_bstore_meta_get(DB *meta_db, DBT *meta_dbt, DB_TXN *txn,
+// the cache is authoritative: the parent directory has been loaded
+int lightfs_bstore_meta_lookup(DB *meta_db, DBT *meta_dbt, DB_TXN *txn,
                          struct lightfs_metadata *metadata)
 {
 	int ret;
@@ -522,6 +514,107 @@ int lightfs_bstore_meta_get(DB *meta_db, DBT *meta_dbt, DB_TXN *txn,
 	return ret;
 }
 
+// a cache miss goes to the device (root at mount, redirect targets)
+int lightfs_bstore_meta_get(DB *meta_db, DBT *meta_dbt, DB_TXN *txn,
+                         struct lightfs_metadata *metadata)
+{
+	int ret;
+	DBT value;
+
+	ret = lightfs_bstore_meta_lookup(meta_db, meta_dbt, txn, metadata);
+	if (ret != -ENOENT)
+		return ret;
+
+	dbt_setup(&value, metadata, sizeof(*metadata));
+	ret = meta_db->get(meta_db, txn, meta_dbt, &value, LIGHTFS_META_GET);
+	if (ret == DB_NOTFOUND)
+		return -ENOENT;
+	if (ret)
+		return ret;
+
+	lightfs_ht_cache_fill(meta_dbt, &value, NULL,
+	                      metadata->type == LIGHTFS_METADATA_TYPE_NORMAL &&
+	                      S_ISDIR(metadata->u.st.st_mode));
+
+	return 0;
+}
+
+/*
+ * Read the children of dir back from the device into the cache, once per
+ * directory after mount. One ITER scan over [m|ino, m|ino+1).
+ * Entries already cached are newer than the device and are kept.
+ */
+static int lightfs_bstore_meta_scan_dir(DB *meta_db, DB_TXN *txn, struct inode *dir)
+{
+	int ret, r;
+	char *child_meta_key;
+	struct lightfs_metadata meta;
+	DBT child_meta_dbt, metadata_dbt;
+	DBC *cursor;
+	bool is_dir;
+
+	child_meta_key = kmalloc(META_KEY_MAX_LEN, GFP_NOIO);
+	if (!child_meta_key)
+		return -ENOMEM;
+	dbt_setup(&child_meta_dbt, child_meta_key, META_KEY_MAX_LEN);
+	copy_meta_dbt_from_ino(&child_meta_dbt, dir->i_ino);
+	dbt_setup(&metadata_dbt, &meta, sizeof(meta));
+
+	ret = meta_db->cursor(meta_db, txn, &cursor, LIGHTFS_META_CURSOR);
+	if (ret)
+		goto out;
+
+	// the first call fills the cursor buffer, the second one copies out
+	r = cursor->c_get(cursor, &child_meta_dbt, &metadata_dbt, DB_SET_RANGE);
+	if (!r)
+		r = cursor->c_get(cursor, &child_meta_dbt, &metadata_dbt, DB_SET_RANGE);
+	while (!r) {
+		if (!meta_key_is_child_of_ino(child_meta_key, dir->i_ino))
+			break;
+		// skip the dir's own redirect entry and the ino counter
+		if (lightfs_key_path(child_meta_key)[0] == '\0' ||
+		    (child_meta_dbt.size == sizeof(ino_key) &&
+		     !memcmp(child_meta_key, ino_key, sizeof(ino_key))))
+			goto next;
+		is_dir = meta.type == LIGHTFS_METADATA_TYPE_NORMAL &&
+		         S_ISDIR(meta.u.st.st_mode);
+		lightfs_ht_cache_fill(&child_meta_dbt, &metadata_dbt, dir, is_dir);
+next:
+		r = cursor->c_get(cursor, &child_meta_dbt, &metadata_dbt, DB_NEXT);
+	}
+	if (r && r != DB_NOTFOUND)
+		ret = r;
+
+	r = cursor->c_close(cursor);
+	BUG_ON(r);
+out:
+	kfree(child_meta_key);
+	return ret;
+}
+
+int lightfs_bstore_meta_load_dir(DB *meta_db, DB_TXN *txn, struct inode *dir)
+{
+	struct lightfs_inode *lightfs_inode = LIGHTFS_I(dir);
+	DBT *dir_dbt = &lightfs_inode->meta_dbt;
+	unsigned int gen;
+	int ret = 0;
+
+	if (lightfs_ht_cache_dir_is_loaded(dir_dbt))
+		return 0;
+
+	mutex_lock(&lightfs_inode->load_mutex);
+	while (!lightfs_ht_cache_dir_is_loaded(dir_dbt)) {
+		gen = lightfs_ht_cache_dir_gen(dir_dbt);
+		ret = lightfs_bstore_meta_scan_dir(meta_db, txn, dir);
+		if (ret || lightfs_ht_cache_dir_set_loaded(dir_dbt, gen))
+			break;
+		cond_resched(); // the shrinker dropped children meanwhile
+	}
+	mutex_unlock(&lightfs_inode->load_mutex);
+
+	return ret;
+}
+
 int lightfs_bstore_group_eviction(struct inode *inode) {
 	DBT *dir_meta_dbt;
 	dir_meta_dbt = &(LIGHTFS_I(inode)->meta_dbt);
@@ -723,6 +816,120 @@ int lightfs_bstore_meta_readdir(DB *meta_db, DBT *meta_dbt, DB_TXN *txn,
 	return ret;
 }
 
+#ifdef ASYNC_GET
+struct lightfs_redirect_get {
+	struct lightfs_get_async ga;
+	char key[SIZEOF_ROOT_META_KEY];
+	DBT key_dbt;
+	struct lightfs_metadata meta;
+};
+
+/*
+ * Hardlinks in a readdir batch each need their target's metadata, which
+ * is only on the device. Fetch the uncached ones of the batch with async
+ * gets in parallel, the emit loop then finds them in the cache.
+ */
+static void lightfs_bstore_meta_prefetch_redirects(DB *meta_db, struct readdir_ctx *dir_ctx)
+{
+	struct lightfs_redirect_get *gets;
+	struct lightfs_dirent *de;
+	struct lightfs_metadata meta;
+	uint32_t off = dir_ctx->batch_off;
+	DB_TXN *txn;
+	DBT value;
+	int i, nr;
+
+	gets = kmalloc(LIGHTFS_ASYNC_GET_MAX * sizeof(*gets), GFP_NOIO);
+	if (!gets)
+		return; // the emit loop gets them one by one
+
+	lightfs_bstore_txn_begin(meta_db->dbenv, NULL, &txn, TXN_READONLY);
+	while (off < dir_ctx->batch_len) {
+		nr = 0;
+		while (nr < LIGHTFS_ASYNC_GET_MAX && off < dir_ctx->batch_len) {
+			de = (struct lightfs_dirent *)(dir_ctx->batch + off);
+			off += LIGHTFS_DIRENT_SIZE(de->name_len);
+			if (!de->is_redirect)
+				continue;
+			dbt_setup_buf(&gets[nr].key_dbt, gets[nr].key, SIZEOF_ROOT_META_KEY);
+			copy_meta_dbt_from_ino(&gets[nr].key_dbt, de->ino);
+			if (lightfs_bstore_meta_lookup(meta_db, &gets[nr].key_dbt, txn, &meta) != -ENOENT)
+				continue;
+			gets[nr].ga.cb = NULL;
+			dbt_setup(&value, &gets[nr].meta, sizeof(gets[nr].meta));
+			meta_db->get_async(meta_db, txn, &gets[nr].key_dbt, &value,
+			                   LIGHTFS_META_GET, &gets[nr].ga);
+			nr++;
+		}
+		for (i = 0; i < nr; i++) {
+			if (lightfs_get_async_wait(&gets[i].ga))
+				continue;
+			dbt_setup(&value, &gets[i].meta, sizeof(gets[i].meta));
+			lightfs_ht_cache_fill(&gets[i].key_dbt, &value, NULL,
+			                      gets[i].meta.type == LIGHTFS_METADATA_TYPE_NORMAL &&
+			                      S_ISDIR(gets[i].meta.u.st.st_mode));
+		}
+	}
+	lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+	kfree(gets);
+}
+#endif
+
+/*
+ * List a directory whose children are all in the dcache: they are taken
+ * in batches, one dcache lock hold each, and emitted with no lock held.
+ * An entry dir_emit refuses stays in the batch for the next call.
+ */
+int lightfs_bstore_meta_readdir_cached(DB *meta_db, DBT *meta_dbt,
+                             struct dir_context *ctx, struct readdir_ctx *dir_ctx)
+{
+	struct lightfs_dirent *de;
+	struct lightfs_metadata meta;
+	char indirect_meta_key[SIZEOF_ROOT_META_KEY];
+	DBT indirect_meta_dbt;
+	DB_TXN *txn;
+	u64 ino;
+	unsigned type;
+	int r;
+
+	for (;;) {
+		if (dir_ctx->batch_off == dir_ctx->batch_len) {
+			if (dir_ctx->batch_end) {
+				dir_ctx->pos = 0; // all cache hit
+				return 0;
+			}
+			r = XXX_cache_db->cache_readdir(XXX_cache_db, meta_dbt,
+			                                dir_ctx->last_name, dir_ctx->batch,
+			                                LIGHTFS_READDIR_BATCH, &dir_ctx->batch_len);
+			dir_ctx->batch_off = 0;
+			dir_ctx->batch_end = (r == DB_NOTFOUND_DCACHE_FULL);
+#ifdef ASYNC_GET
+			lightfs_bstore_meta_prefetch_redirects(meta_db, dir_ctx);
+#endif
+			continue;
+		}
+		de = (struct lightfs_dirent *)(dir_ctx->batch + dir_ctx->batch_off);
+		ino = de->ino;
+		type = lightfs_get_type(de->mode);
+		if (de->is_redirect) {
+			dbt_setup_buf(&indirect_meta_dbt, indirect_meta_key,
+			              SIZEOF_ROOT_META_KEY);
+			copy_meta_dbt_from_ino(&indirect_meta_dbt, de->ino);
+			lightfs_bstore_txn_begin(meta_db->dbenv, NULL, &txn, TXN_READONLY);
+			r = lightfs_bstore_meta_get(meta_db, &indirect_meta_dbt, txn, &meta);
+			lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+			if (r)
+				return r;
+			ino = meta.u.st.st_ino;
+			type = lightfs_get_type(meta.u.st.st_mode);
+		}
+		if (!dir_emit(ctx, de->name, de->name_len, ino, type))
+			return 0;
+		dir_ctx->emit_cnt++;
+		dir_ctx->batch_off += LIGHTFS_DIRENT_SIZE(de->name_len);
+	}
+}
+
 int lightfs_bstore_get(DB *data_db, DBT *data_dbt, DB_TXN *txn, void *buf, struct inode *inode)
 {
 	int ret;
@@ -761,6 +968,28 @@ int lightfs_bstore_put(DB *data_db, DBT *data_dbt, DB_TXN *txn,
 	return ret;
 }
 
+#ifdef EXTENT
+// data_dbt is the key of the first block of an extent group. Its page
+// records (and an older extent) are deleted in the same txn, so a page
+// record found later is always newer than the extent.
+// pages must be kmalloc'ed, it is freed once the txn is transferred
+int lightfs_bstore_put_extent(DB *data_db, DBT *data_dbt, DB_TXN *txn,
+                              struct page **pages, unsigned nr_pages)
+{
+	int ret;
+	DBT value;
+
+	ret = data_db->del_multi(data_db, txn, data_dbt, LIGHTFS_EXTENT_PAGES,
+	                         0, LIGHTFS_DATA_DEL_MULTI);
+	if (ret)
+		return ret;
+
+	dbt_setup(&value, pages, nr_pages << PAGE_SHIFT);
+
+	return data_db->put(data_db, txn, data_dbt, &value, LIGHTFS_DATA_EXT_WB);
+}
+#endif
+
 int lightfs_bstore_put_page(DB *data_db, DBT *data_dbt, DB_TXN *txn,
                     struct page *page, size_t len, int is_seq)
 {
@@ -775,6 +1004,15 @@ int lightfs_bstore_put_page(DB *data_db, DBT *data_dbt, DB_TXN *txn,
 	kunmap(page);
 #endif
 
+#ifndef EXTENT
+	// an all-zero page is left as a hole, an older record of it goes.
+	// (a DEL would uncover the block in an extent, so not with EXTENT)
+	if (lightfs_page_is_zero(page)) {
+		dbt_setup(&value, page, 0);
+		return data_db->put(data_db, txn, data_dbt, &value, LIGHTFS_DATA_DEL);
+	}
+#endif
+
 	dbt_setup(&value, page, len);
 
 	ret = data_db->put(data_db, txn, data_dbt, &value, LIGHTFS_DATA_SET_WB);
@@ -796,6 +1034,53 @@ int lightfs_bstore_update(DB *data_db, DBT *data_dbt, DB_TXN *txn,
 	return ret;
 }
 
+// delete block_cnt blocks from block_num on, LIGHTFS_TXN_LIMIT blocks
+// (one DEL_MULTI) per txn
+int lightfs_bstore_del_range(DB *data_db, struct inode *inode,
+                             uint64_t block_num, uint64_t block_cnt)
+{
+	int ret = 0;
+	DBT data_dbt;
+	DB_TXN *txn;
+	uint64_t cnt;
+	uint32_t txn_id;
+#ifndef PINK
+	uint64_t i;
+#endif
+
+	ret = alloc_data_dbt_from_inode(&data_dbt, inode, block_num);
+	if (ret)
+		return ret;
+
+	while (block_cnt) {
+		cnt = block_cnt > LIGHTFS_TXN_LIMIT ? LIGHTFS_TXN_LIMIT : block_cnt;
+		TXN_GOTO_LABEL(retry);
+		lightfs_bstore_txn_begin(sbi->db_dev, NULL, &txn, TXN_MAY_WRITE);
+#ifdef PINK
+		ret = data_db->del_multi(data_db, txn, &data_dbt, cnt, 0, LIGHTFS_DATA_DEL_MULTI);
+#else
+		for (i = 0; i < cnt && !ret; i++) {
+			copy_data_dbt_from_inode(&data_dbt, inode, block_num + i);
+			ret = data_db->del(data_db, txn, &data_dbt, LIGHTFS_DATA_DEL);
+		}
+#endif
+		if (ret) {
+			DBOP_JUMP_ON_CONFLICT(ret, retry);
+			lightfs_bstore_txn_abort(txn);
+			break;
+		}
+		ret = lightfs_bstore_txn_commit_id(txn, DB_TXN_NOSYNC, &txn_id);
+		COMMIT_JUMP_ON_CONFLICT(ret, retry);
+		lightfs_inode_txn_update(inode, txn_id);
+		block_num += cnt;
+		block_cnt -= cnt;
+		copy_data_dbt_from_inode(&data_dbt, inode, block_num);
+	}
+	dbt_destroy(&data_dbt);
+
+	return ret;
+}
+
 // delete all blocks that is beyond new_num
 //  if offset == 0, delete block new_num as well
 //  otherwise, truncate block new_num to size offset
@@ -806,8 +1091,10 @@ int lightfs_bstore_trunc(DB *data_db, DBT *meta_dbt,
 	DBT min_data_key_dbt, max_data_key_dbt;
 	loff_t size = i_size_read(inode);
 	uint64_t last_block_num = lightfs_get_block_num_by_size(size);
-	uint64_t current_block_num, total_block_num, transfering_block_cnt;
+	uint64_t current_block_num, total_block_num;
+#ifndef PINK
 	DB_TXN *txn = _txn;
+#endif
 	if (new_num == 0) {
 		current_block_num = 1;
 	} else {
@@ -830,22 +1117,7 @@ int lightfs_bstore_trunc(DB *data_db, DBT *meta_dbt,
 	total_block_num = last_block_num - current_block_num + 1;
 
 #ifdef PINK
-	while (total_block_num) {
-		TXN_GOTO_LABEL(retry);
-		lightfs_bstore_txn_begin(sbi->db_dev, NULL, &txn, TXN_MAY_WRITE);
-		transfering_block_cnt = total_block_num > LIGHTFS_TXN_LIMIT ? LIGHTFS_TXN_LIMIT : total_block_num;
-		ret = data_db->del_multi(data_db, txn, &min_data_key_dbt, transfering_block_cnt, 0, LIGHTFS_DATA_DEL_MULTI);
-		if (ret) {
-			DBOP_JUMP_ON_CONFLICT(ret, retry);
-			lightfs_bstore_txn_abort(txn);
-		} else {
-			ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
-			COMMIT_JUMP_ON_CONFLICT(ret, retry);
-		}
-		current_block_num += transfering_block_cnt;
-		total_block_num -= transfering_block_cnt;
-		copy_data_dbt_from_inode(&min_data_key_dbt, inode, current_block_num);
-	}
+	ret = lightfs_bstore_del_range(data_db, inode, current_block_num, total_block_num);
 #else
 	do {
 		ret = data_db->del(data_db, txn, &max_data_key_dbt, LIGHTFS_DATA_DEL);
@@ -1094,15 +1366,17 @@ int lightfs_bstore_scan_pages(DB *data_db, DBT *meta_dbt, DB_TXN *txn, struct li
 	info.lightfs_io = lightfs_io;
 	info.inode = inode;
 	info.block_cnt = block_cnt;
+	info.do_continue = 1;
 
 	while (info.do_continue && !r)
 		r = data_db->get_multi(data_db, txn, &data_dbt, block_cnt, lightfs_scan_pages_cb, &info, LIGHTFS_GET_MULTI);
 	if (r && r != DB_NOTFOUND)
 		ret = r;
+	// DB_NOTFOUND: no block of the range is stored, it is all hole
 	if (!ret)
 		lightfs_bstore_fill_rest_page(lightfs_io);
 
-	BUG_ON(r);
+	BUG_ON(ret);
 #else
 	if (block_cnt < 100) {
 		while(block_cnt--) {
@@ -1147,39 +1421,241 @@ int lightfs_bstore_scan_pages(DB *data_db, DBT *meta_dbt, DB_TXN *txn, struct li
 	return ret;
 }
 
-#ifdef READA
-int lightfs_bstore_reada_pages(DB *data_db, DBT *meta_dbt, DB_TXN *txn, struct lightfs_io *lightfs_io, struct inode *inode, unsigned iter)
-{
-	int ret, r = 0;
+#ifdef ASYNC_GET
+struct lightfs_sparse_get {
+	struct lightfs_get_async ga;
 	DBT data_dbt;
+	struct page *page;
+	char *buf;
+};
+
+/*
+ * Read a page list with gaps (pages between them are already cached):
+ * one async get per page, up to LIGHTFS_ASYNC_GET_MAX in flight, instead
+ * of a get_multi that moves the whole range.
+ */
+int lightfs_bstore_scan_sparse_pages(DB *data_db, DB_TXN *txn, struct lightfs_io *lightfs_io, struct inode *inode)
+{
+	struct lightfs_sparse_get *gets;
+	DBT value;
 	loff_t size = i_size_read(inode);
-	uint64_t current_block_num, block_cnt;
-	struct reada_entry *last_ra_entry, *ra_entry;
-	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
+	uint64_t last_block_num = lightfs_get_block_num_by_size(size);
+	size_t block_off = block_get_off_by_position(size);
+	uint64_t page_block_num;
 	struct page *page;
+	int i, nr, ret = 0, r;
 
-	if (lightfs_inode->ra_entry) {
-		last_ra_entry = list_last_entry(&lightfs_inode->ra_list, struct reada_entry, list);
-		current_block_num = last_ra_entry->reada_block_start + last_ra_entry->reada_block_len;
-	} else {
-		page = lightfs_io_last_page(lightfs_io);
-		current_block_num = (PAGE_TO_BLOCK_NUM(page) * iter) + 1;
+	gets = kmalloc(LIGHTFS_ASYNC_GET_MAX * sizeof(*gets), GFP_NOIO);
+	if (!gets)
+		return -ENOMEM;
+
+	while (!lightfs_io_job_done(lightfs_io)) {
+		nr = 0;
+		i = lightfs_io->lightfs_bvidx;
+		while (nr < LIGHTFS_ASYNC_GET_MAX && i < lightfs_io->lightfs_vcnt) {
+			page = lightfs_io_page_at(lightfs_io, i++);
+			page_block_num = PAGE_TO_BLOCK_NUM(page);
+			if (page_block_num > last_block_num) {
+				zero_user_segment(page, 0, PAGE_SIZE);
+				continue;
+			}
+			gets[nr].page = page;
+			ret = alloc_data_dbt_from_inode(&gets[nr].data_dbt, inode, page_block_num);
+			if (ret)
+				break;
+			gets[nr].buf = kmap(page);
+			gets[nr].ga.cb = NULL;
+			dbt_setup(&value, gets[nr].buf, LIGHTFS_BSTORE_BLOCKSIZE);
+			data_db->get_async(data_db, txn, &gets[nr].data_dbt, &value,
+			                   LIGHTFS_DATA_GET, &gets[nr].ga);
+			nr++;
+		}
+		lightfs_io->lightfs_bvidx = i;
+
+		for (i = 0; i < nr; i++) {
+			page = gets[i].page;
+			r = lightfs_get_async_wait(&gets[i].ga);
+			if (r == DB_NOTFOUND)
+				memset(gets[i].buf, 0, LIGHTFS_BSTORE_BLOCKSIZE);
+			else if (r && !ret)
+				ret = r;
+			else if (PAGE_TO_BLOCK_NUM(page) == last_block_num && block_off &&
+			         block_off < LIGHTFS_BSTORE_BLOCKSIZE)
+				memset(gets[i].buf + block_off, 0, LIGHTFS_BSTORE_BLOCKSIZE - block_off);
+			kunmap(page);
+			flush_dcache_page(page);
+			dbt_destroy(&gets[i].data_dbt);
+		}
+		if (ret)
+			break;
 	}
-	block_cnt = lightfs_get_block_num_by_size(size) + 1 - current_block_num;
-	block_cnt = block_cnt > lightfs_io->lightfs_vcnt * READA_MULTIPLIER ? lightfs_io->lightfs_vcnt * READA_MULTIPLIER : block_cnt; 
+	kfree(gets);
 
-	if (block_cnt == 0) {
-		return EEOF;
+	return ret;
+}
+#endif
+
+struct lightfs_scan_user_pages_cb_info {
+	struct inode *inode;
+	struct page **pages;
+	uint64_t block_num;
+	unsigned nr_pages;
+};
+
+static int lightfs_scan_user_pages_cb(DBT const *key, DBT const *val, void *extra)
+{
+	struct lightfs_scan_user_pages_cb_info *info = extra;
+	uint64_t idx = lightfs_data_key_get_blocknum(key->data, key->size) - info->block_num;
+	char *page_buf;
+
+	if (!key_is_same_of_ino(key->data, info->inode->i_ino) || idx >= info->nr_pages)
+		return 0;
+	page_buf = kmap_atomic(info->pages[idx]);
+	memcpy(page_buf, val->data, val->size);
+	// the user page still holds the caller's bytes past a short value
+	if (val->size < PAGE_SIZE)
+		memset(page_buf + val->size, 0, PAGE_SIZE - val->size);
+	kunmap_atomic(page_buf);
+
+	return 0;
+}
+
+// O_DIRECT read: one GET_MULTI filled straight into pinned user pages,
+// one page per block
+int lightfs_bstore_scan_user_pages(DB *data_db, DB_TXN *txn, struct inode *inode,
+                                   uint64_t block_num, struct page **pages, unsigned nr_pages)
+{
+	struct lightfs_scan_user_pages_cb_info info;
+	DBT data_dbt;
+	unsigned i;
+	int ret;
+
+	ret = alloc_data_dbt_from_inode(&data_dbt, inode, block_num);
+	if (ret)
+		return ret;
+
+	info.inode = inode;
+	info.pages = pages;
+	info.block_num = block_num;
+	info.nr_pages = nr_pages;
+	ret = data_db->get_multi(data_db, txn, &data_dbt, nr_pages, lightfs_scan_user_pages_cb, &info, LIGHTFS_GET_MULTI);
+	if (ret == DB_NOTFOUND) {
+		for (i = 0; i < nr_pages; i++)
+			zero_user_segment(pages[i], 0, PAGE_SIZE);
+		ret = 0;
 	}
-	
-	ret = alloc_data_dbt_from_inode(&data_dbt, inode,
-			current_block_num);
+	dbt_destroy(&data_dbt);
+
+	return ret;
+}
+
+struct lightfs_seek_cb_info {
+	struct inode *inode;
+	uint64_t next;
+	uint64_t last_block_num;
+	int whence;
+	int found;
+	int do_continue;
+};
+
+static int lightfs_seek_cb(DBT const *key, DBT const *val, void *extra)
+{
+	struct lightfs_seek_cb_info *info = extra;
+	uint64_t block_num, end;
+
+	info->do_continue = 0;
+	if (!key_is_same_of_ino(key->data, info->inode->i_ino))
+		return 0;
+	block_num = lightfs_data_key_get_blocknum(key->data, key->size);
+	if (block_num > info->last_block_num)
+		return 0;
+	// an extent record covers more than one block
+	end = block_num + (val->size > PAGE_SIZE ? val->size >> PAGE_SHIFT : 1);
+	if (end <= info->next) {
+		info->do_continue = 1;
+		return 0;
+	}
+	if (info->whence == SEEK_DATA) {
+		info->next = max(info->next, block_num);
+		info->found = 1;
+		return 0;
+	}
+	if (block_num > info->next) { // the hole starts at next
+		info->found = 1;
+		return 0;
+	}
+	info->next = end;
+	info->do_continue = info->next <= info->last_block_num;
+
+	return 0;
+}
+
+// walk the data keys of inode from block_num on. SEEK_DATA: *found is the
+// first stored block, 0 if there is none. SEEK_HOLE: *found is the first
+// block without a record, possibly past the last block.
+int lightfs_bstore_seek(DB *data_db, DB_TXN *txn, struct inode *inode,
+                        uint64_t block_num, int whence, uint64_t *found)
+{
+	struct lightfs_seek_cb_info info;
+	DBT data_dbt;
+	DBC *cursor;
+	uint64_t start = block_num;
+	int ret, r;
+
+#ifdef EXTENT
+	start = lightfs_extent_start(block_num);
+#endif
+	info.inode = inode;
+	info.next = block_num;
+	info.last_block_num = lightfs_get_block_num_by_size(i_size_read(inode));
+	info.whence = whence;
+	info.found = 0;
+	info.do_continue = 1;
+
+	ret = alloc_data_dbt_from_inode(&data_dbt, inode, start);
 	if (ret)
 		return ret;
+	ret = data_db->cursor(data_db, txn, &cursor, LIGHTFS_DATA_CURSOR);
+	if (ret)
+		goto out;
+
+	r = cursor->c_getf_set_range(cursor, info.last_block_num - start + 1,
+	                             &data_dbt, lightfs_seek_cb, &info);
+	while (info.do_continue && !r)
+		r = cursor->c_getf_next(cursor, info.last_block_num - start + 1,
+		                        lightfs_seek_cb, &info);
+	if (r && r != DB_NOTFOUND)
+		ret = r;
+	r = cursor->c_close(cursor);
+	BUG_ON(r);
+
+	if (whence == SEEK_DATA)
+		*found = info.found ? info.next : 0;
+	else
+		*found = info.next;
+out:
+	dbt_destroy(&data_dbt);
+
+	return ret;
+}
 
-	ra_entry = lightfs_reada_alloc(inode, current_block_num, block_cnt);
+#ifdef READA
+// issue the GET_MULTI of a readahead window, it completes in lightfs_reada_end()
+int lightfs_bstore_reada_pages(DB *data_db, DB_TXN *txn, struct inode *inode,
+                           struct reada_entry *ra_entry)
+{
+	int ret;
+	DBT data_dbt;
 
-	r = data_db->get_multi_reada(data_db, txn, &data_dbt, block_cnt, ra_entry, LIGHTFS_GET_MULTI_READA);
+	ret = alloc_data_dbt_from_inode(&data_dbt, inode, ra_entry->reada_block_start);
+	if (ret)
+		return ret;
+
+	ret = data_db->get_multi_reada(data_db, txn, &data_dbt, ra_entry->reada_block_len,
+	                               ra_entry, LIGHTFS_GET_MULTI_READA);
+	// DB_NOTFOUND is reported to the window, not to us
+	if (ret == DB_NOTFOUND)
+		ret = 0;
 
 	dbt_destroy(&data_dbt);
 
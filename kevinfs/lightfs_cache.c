@@ -1,41 +1,113 @@
-#include <linux/crc32.h>
 #include "lightfs.h"
 #include "lightfs_txn_hdlr.h"
 #include "rbtreekv.h"
 #include "lightfs_cache.h"
-
-#define FSEED 0
-#define SSEED 17
+#include "lightfs_hash.h"
+#include "lightfs_reada.h"
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/log2.h>
+#include <linux/shrinker.h>
 
 DEFINE_HASHTABLE (lightfs_ht_cache, HASHTABLE_BITS);
 DEFINE_HASHTABLE (lightfs_ht_lock, HASHTABLE_BITS);
 
 static struct kmem_cache *dcache_entry_cachep;
-static struct kmem_cache *ht_cache_item_cachep;
-static struct kmem_cache *meta_cachep;
 
-static int _dbt_copy(DBT *to, const DBT *from) {
-	memcpy(to, from, sizeof(DBT));
-	to->data = kmalloc(from->size, GFP_ATOMIC);
-	if (to->data == NULL) {
-		return -ENOMEM;
-	}
-	memcpy(to->data, from->data, from->size);
-	return 0;
+// slab classes of ht_cache_item by the key they hold inline
+#define HT_ITEM_CLASSES 4
+static const uint16_t ht_item_class_key[HT_ITEM_CLASSES] = {
+	32, 64, 128, META_KEY_MAX_LEN,
+};
+static struct kmem_cache *ht_item_cachep[HT_ITEM_CLASSES];
+
+static struct {
+	atomic64_t items, dirs, big_dirs;
+	atomic64_t bytes; // slab objects of items, dcache entries, shards
+	atomic64_t key_bytes;
+	atomic64_t legacy_bytes; // the same entries with separate key and meta
+} lightfs_cache_stat;
+
+static struct dentry *lightfs_debugfs_dir;
+
+#ifdef CACHE_SHRINK
+#ifdef DISABLE_DCACHE
+#error "CACHE_SHRINK drops entries the device has, DISABLE_DCACHE keeps some only in the cache"
+#endif
+/*
+ * Idle entries in the order they went idle (the VFS evicted their inode):
+ * directories, whose children the shrinker can drop, and entries with no
+ * parent. Under lightfs_cold_lock, taken inside the bucket locks.
+ */
+static LIST_HEAD(lightfs_cold_list);
+static DEFINE_SPINLOCK(lightfs_cold_lock);
+static DEFINE_MUTEX(lightfs_shrink_mutex);
+
+static struct {
+	atomic64_t cold; // entries the cold list can free
+	atomic64_t scan, freed, dirs;
+	atomic64_t dirty; // scans stopped by entries not on the device yet
+} lightfs_shrink_stat;
+#endif
+
+// what kmalloc(len) took for the key copy, before keys were inline
+static inline size_t lightfs_kmalloc_size (size_t len)
+{
+	if (len <= 8)
+		return 8;
+	if (len > 64 && len <= 96)
+		return 96;
+	if (len > 128 && len <= 192)
+		return 192;
+	return roundup_pow_of_two(len);
 }
-static int _dbt_no_alloc_copy(DBT *to, const DBT *from) {
-	memcpy(to->data, from->data, from->size);
-	return 0;
+
+// header of the item before keys were inline: two DBTs for key and value
+#define HT_ITEM_LEGACY_HDR \
+	(sizeof(struct ht_cache_item) - sizeof(struct lightfs_cmeta) - sizeof(uint16_t) + 2 * sizeof(DBT))
+
+static void lightfs_cmeta_pack (struct lightfs_cmeta *c, const struct lightfs_metadata *m)
+{
+	c->type = m->type;
+	if (m->type == LIGHTFS_METADATA_TYPE_REDIRECT) {
+		c->ino = m->u.ino;
+		return;
+	}
+	c->ino = m->u.st.st_ino;
+	c->size = m->u.st.st_size;
+	c->blocks = m->u.st.st_blocks;
+	c->atime = m->u.st.st_atime;
+	c->mtime = m->u.st.st_mtime;
+	c->ctime = m->u.st.st_ctime;
+	c->mode = m->u.st.st_mode;
+	c->nlink = m->u.st.st_nlink;
+	c->uid = m->u.st.st_uid;
+	c->gid = m->u.st.st_gid;
+	c->dev = m->u.st.st_dev;
+	c->rdev = m->u.st.st_rdev;
 }
 
-static int _dbt_copy_meta(DBT *to, const DBT *from) {
-	memcpy(to, from, sizeof(DBT));
-	to->data = kmem_cache_alloc(meta_cachep, GFP_ATOMIC);
-	if (to->data == NULL) {
-		return -ENOMEM;
+static void lightfs_cmeta_unpack (struct lightfs_metadata *m, const struct lightfs_cmeta *c)
+{
+	memset(m, 0, sizeof(*m));
+	m->type = c->type;
+	if (c->type == LIGHTFS_METADATA_TYPE_REDIRECT) {
+		m->u.ino = c->ino;
+		return;
 	}
-	memcpy(to->data, from->data, from->size);
-	return 0;
+	m->u.st.st_ino = c->ino;
+	m->u.st.st_size = c->size;
+	m->u.st.st_blocks = c->blocks;
+	m->u.st.st_blksize = LIGHTFS_BSTORE_BLOCKSIZE;
+	m->u.st.st_atime = c->atime;
+	m->u.st.st_mtime = c->mtime;
+	m->u.st.st_ctime = c->ctime;
+	m->u.st.st_mode = c->mode;
+	m->u.st.st_nlink = c->nlink;
+	m->u.st.st_uid = c->uid;
+	m->u.st.st_gid = c->gid;
+	m->u.st.st_dev = c->dev;
+	m->u.st.st_rdev = c->rdev;
 }
 
 
@@ -58,9 +130,12 @@ static int lightfs_keycmp(char *akey, uint16_t alen, char *bkey, uint16_t blen)
 }
 
 
-static inline uint32_t lightfs_ht_func (int seed, char *buf, uint32_t len) 
+static inline void lightfs_ht_func (char *buf, uint32_t len, uint32_t *hkey, uint32_t *fp)
 {
-	return crc32(seed, buf, len);
+	uint64_t hash = lightfs_hash64(buf, len);
+
+	*hkey = lightfs_hash_bucket(hash);
+	*fp = lightfs_hash_fp(hash);
 }
 
 static int lightfs_ht_cache_open (DB *db, DB_TXN *txn, const char *file, const char *database, DBTYPE type, uint32_t flag, int mode)
@@ -68,51 +143,226 @@ static int lightfs_ht_cache_open (DB *db, DB_TXN *txn, const char *file, const c
 	return 0;
 }
 
-static inline void lightfs_dcache_entry_init(struct ht_cache_item *dir_ht_item) {
+static inline void lightfs_dcache_entry_init(struct ht_cache_item *dir_ht_item, bool is_loaded) {
 	dir_ht_item->dcache = kmem_cache_alloc(dcache_entry_cachep, GFP_ATOMIC);
+	atomic64_inc(&lightfs_cache_stat.dirs);
+	atomic64_add(kmem_cache_size(dcache_entry_cachep), &lightfs_cache_stat.bytes);
 	dir_ht_item->dcache->is_full = true;
-	dir_ht_item->dcache->rb_root = RB_ROOT;
-	dir_ht_item->dcache->child = 0;
-	dir_ht_item->dcache->e_child = 0;
-
-	spin_lock_init(&dir_ht_item->dcache->lock);
+	dir_ht_item->dcache->is_loaded = is_loaded;
+	dir_ht_item->dcache->gen = 0;
+	dir_ht_item->dcache->cold = 0;
+	dir_ht_item->dcache->shrink_at = NULL;
+	dir_ht_item->dcache->shrink_shard = 0;
+	dir_ht_item->dcache->one.rb_root = RB_ROOT;
+	dir_ht_item->dcache->big = NULL;
+	atomic_set(&dir_ht_item->dcache->child, 0);
+	atomic_set(&dir_ht_item->dcache->e_child, 0);
+
+	spin_lock_init(&dir_ht_item->dcache->one.lock);
 }
 
 static inline void lightfs_dcache_entry_free (struct ht_cache_item *dir_ht_item) {
 	if (dir_ht_item->dcache) {
 		//free_rb_tree(dir_ht_item->dcache->rb_root.rb_node);
+		if (dir_ht_item->dcache->big) {
+			kfree(dir_ht_item->dcache->big);
+			atomic64_dec(&lightfs_cache_stat.big_dirs);
+			atomic64_sub(LIGHTFS_DCACHE_SHARDS * sizeof(struct dcache_shard_big), &lightfs_cache_stat.bytes);
+		}
+		kfree(dir_ht_item->dcache->shrink_at);
 		kmem_cache_free(dcache_entry_cachep, dir_ht_item->dcache);
+		atomic64_dec(&lightfs_cache_stat.dirs);
+		atomic64_sub(kmem_cache_size(dcache_entry_cachep), &lightfs_cache_stat.bytes);
 		dir_ht_item->dcache = NULL;
 	}
 }
 
+static inline uint8_t lightfs_dcache_shard_of (const char *name, uint32_t len)
+{
+	return lightfs_hash64(name, len) & (LIGHTFS_DCACHE_SHARDS - 1);
+}
+
+// (shard, name) order of the children, they all share the dir prefix
+static inline int lightfs_dcache_cmp (uint8_t shard, char *key, uint16_t key_len, struct ht_cache_item *item)
+{
+	if (shard != item->shard)
+		return shard < item->shard ? -1 : 1;
+	return lightfs_keycmp(key, key_len, item->key, item->key_len);
+}
+
+// the locked tree that holds (or would hold) children of shard
+static struct dcache_shard *lightfs_dcache_lock (struct dcache_entry *dcache, uint8_t shard)
+{
+	struct dcache_shard_big *big;
+	struct dcache_shard *s;
+
+	for (;;) {
+		big = smp_load_acquire(&dcache->big);
+		s = big ? &big[shard].s : &dcache->one;
+		spin_lock(&s->lock);
+		// big only goes from NULL to set, under one.lock
+		if (big || !READ_ONCE(dcache->big))
+			return s;
+		spin_unlock(&s->lock);
+	}
+}
+
+static void lightfs_dcache_split (struct dcache_entry *dcache)
+{
+	struct dcache_shard_big *big;
+	struct ht_cache_item *item, *this;
+	struct rb_node *node, **new, *parent;
+	struct rb_root *root;
+	int i;
+
+	big = kmalloc(LIGHTFS_DCACHE_SHARDS * sizeof(*big), GFP_ATOMIC);
+	if (!big)
+		return; // stays in one tree, tried again on the next insert
+	for (i = 0; i < LIGHTFS_DCACHE_SHARDS; i++) {
+		spin_lock_init(&big[i].s.lock);
+		big[i].s.rb_root = RB_ROOT;
+	}
+
+	spin_lock(&dcache->one.lock);
+	if (dcache->big) {
+		spin_unlock(&dcache->one.lock);
+		kfree(big);
+		return;
+	}
+	while ((node = rb_first(&dcache->one.rb_root))) {
+		item = container_of(node, struct ht_cache_item, rb_node);
+		rb_erase(node, &dcache->one.rb_root);
+		// taken in order, so always the rightmost of its shard
+		root = &big[item->shard].s.rb_root;
+		new = &root->rb_node;
+		parent = NULL;
+		while (*new) {
+			parent = *new;
+			new = &(*new)->rb_right;
+		}
+		rb_link_node(&item->rb_node, parent, new);
+		rb_insert_color(&item->rb_node, root);
+	}
+	smp_store_release(&dcache->big, big);
+	spin_unlock(&dcache->one.lock);
+	atomic64_inc(&lightfs_cache_stat.big_dirs);
+	atomic64_add(LIGHTFS_DCACHE_SHARDS * sizeof(*big), &lightfs_cache_stat.bytes);
+}
+
+/*
+ * The child after node, the first one if node is NULL. Takes the shard
+ * locks itself, node must stay linked while it runs.
+ */
+static struct ht_cache_item *lightfs_dcache_next (struct dcache_entry *dcache, struct ht_cache_item *node)
+{
+	struct dcache_shard *s;
+	struct rb_node *rb;
+	int shard = node ? node->shard : 0;
+	bool is_big;
+
+	s = lightfs_dcache_lock(dcache, shard);
+	rb = node ? rb_next(&node->rb_node) : rb_first(&s->rb_root);
+	is_big = s != &dcache->one;
+	spin_unlock(&s->lock);
+	while (!rb && is_big && ++shard < LIGHTFS_DCACHE_SHARDS) {
+		s = lightfs_dcache_lock(dcache, shard);
+		rb = rb_first(&s->rb_root);
+		spin_unlock(&s->lock);
+	}
+	return rb ? container_of(rb, struct ht_cache_item, rb_node) : NULL;
+}
+
+#ifdef CACHE_SHRINK
+static inline uint32_t lightfs_cold_weight (struct ht_cache_item *item)
+{
+	return item->dcache ? item->dcache->cold : 1;
+}
+
+// item just went idle, under its bucket lock
+static void lightfs_cold_add (struct ht_cache_item *item)
+{
+	if (item->parent && !item->dcache)
+		return; // dropped with its directory
+	spin_lock(&lightfs_cold_lock);
+	if (list_empty(&item->cold)) {
+		if (item->dcache)
+			item->dcache->cold = atomic_read(&item->dcache->child) + !item->parent;
+		list_add_tail(&item->cold, &lightfs_cold_list);
+		atomic64_add(lightfs_cold_weight(item), &lightfs_shrink_stat.cold);
+	}
+	spin_unlock(&lightfs_cold_lock);
+}
+
+static void lightfs_cold_del (struct ht_cache_item *item)
+{
+	spin_lock(&lightfs_cold_lock);
+	if (!list_empty(&item->cold)) {
+		list_del_init(&item->cold);
+		atomic64_sub(lightfs_cold_weight(item), &lightfs_shrink_stat.cold);
+	}
+	spin_unlock(&lightfs_cold_lock);
+}
+#else
+static inline void lightfs_cold_add (struct ht_cache_item *item) {}
+static inline void lightfs_cold_del (struct ht_cache_item *item) {}
+#endif
+
+static inline size_t lightfs_ht_item_legacy_size (uint16_t key_len)
+{
+	return HT_ITEM_LEGACY_HDR + lightfs_kmalloc_size(key_len) + INODE_SIZE;
+}
 
 static inline void lightfs_ht_cache_item_init (struct ht_cache_item **ht_item, DBT *key, DBT *value) {
-	*ht_item = kmem_cache_alloc(ht_cache_item_cachep, GFP_ATOMIC);
-	_dbt_copy(&((*ht_item)->key), key);
-	_dbt_copy_meta(&((*ht_item)->value), value);
+	uint8_t class = 0;
+
+	while (key->size > ht_item_class_key[class])
+		class++;
+	*ht_item = kmem_cache_alloc(ht_item_cachep[class], GFP_ATOMIC);
+	(*ht_item)->class = class;
+	(*ht_item)->key_len = key->size;
+	memcpy((*ht_item)->key, key->data, key->size);
+	lightfs_cmeta_pack(&(*ht_item)->meta, value->data);
 	INIT_HLIST_NODE(&(*ht_item)->hnode);
+	INIT_LIST_HEAD(&(*ht_item)->cold);
+	seqcount_init(&(*ht_item)->seq);
 	(*ht_item)->dcache = NULL;
 	(*ht_item)->parent = NULL;
+
+	atomic64_inc(&lightfs_cache_stat.items);
+	atomic64_add(kmem_cache_size(ht_item_cachep[class]), &lightfs_cache_stat.bytes);
+	atomic64_add(key->size, &lightfs_cache_stat.key_bytes);
+	atomic64_add(lightfs_ht_item_legacy_size(key->size), &lightfs_cache_stat.legacy_bytes);
 }
 
 static inline void lightfs_ht_cache_item_free (struct ht_cache_item *ht_item) {
-	kfree(ht_item->key.data);
-	//if (cache_item->value.data)
-	kmem_cache_free(meta_cachep, ht_item->value.data);
-	kmem_cache_free(ht_cache_item_cachep, ht_item);
+	atomic64_dec(&lightfs_cache_stat.items);
+	atomic64_sub(kmem_cache_size(ht_item_cachep[ht_item->class]), &lightfs_cache_stat.bytes);
+	atomic64_sub(ht_item->key_len, &lightfs_cache_stat.key_bytes);
+	atomic64_sub(lightfs_ht_item_legacy_size(ht_item->key_len), &lightfs_cache_stat.legacy_bytes);
+	kmem_cache_free(ht_item_cachep[ht_item->class], ht_item);
+}
+
+static void lightfs_ht_cache_item_free_rcu (struct rcu_head *rcu) {
+	struct ht_cache_item *ht_item = container_of(rcu, struct ht_cache_item, rcu);
+
+	lightfs_dcache_entry_free(ht_item);
+	lightfs_ht_cache_item_free(ht_item);
 }
 
 static int lightfs_dcache_insert (struct ht_cache_item *dir_ht_item, struct ht_cache_item *node)
 {
-	struct rb_node **new = &(dir_ht_item->dcache->rb_root.rb_node), *parent = NULL;
-
+	struct dcache_entry *dcache = dir_ht_item->dcache;
+	struct dcache_shard *s;
+	struct rb_node **new, *parent = NULL;
 
-	spin_lock(&(dir_ht_item->dcache->lock));
+	node->shard = lightfs_dcache_shard_of(lightfs_key_path(node->key),
+	                                      node->key_len - PATH_POS - 1);
+	s = lightfs_dcache_lock(dcache, node->shard);
+	new = &s->rb_root.rb_node;
 
 	while (*new) {
 		struct ht_cache_item *this = container_of(*new, struct ht_cache_item, rb_node);
-		int result = lightfs_keycmp(node->key.data, node->key.size, this->key.data, this->key.size);
+		int result = lightfs_dcache_cmp(node->shard, node->key, node->key_len, this);
 		parent = *new;
 
 		if (result < 0)
@@ -121,20 +371,25 @@ static int lightfs_dcache_insert (struct ht_cache_item *dir_ht_item, struct ht_c
 			new = &((*new)->rb_right);
 		else {
 
-			spin_unlock(&(dir_ht_item->dcache->lock));
+			spin_unlock(&s->lock);
 			return -1;
 		}
 	}
 
 	rb_link_node(&node->rb_node, parent, new);
-	rb_insert_color(&node->rb_node, &(dir_ht_item->dcache->rb_root));
-	spin_unlock(&(dir_ht_item->dcache->lock));
+	rb_insert_color(&node->rb_node, &s->rb_root);
+	spin_unlock(&s->lock);
+
+	if (atomic_inc_return(&dcache->child) >= LIGHTFS_DCACHE_SHARD_MIN && !READ_ONCE(dcache->big))
+		lightfs_dcache_split(dcache);
 
 	return 0;
 }
 
 
-static int lightfs_dcache_invalidate (struct ht_cache_item *node)
+// under the bucket lock of node, true when every child of its parent is
+// invalidated and the parent's group is to be evicted
+static bool lightfs_dcache_invalidate (struct ht_cache_item *node)
 {
 	struct ht_cache_item *dir_cache_item;
 	dir_cache_item = node->parent;
@@ -142,32 +397,26 @@ static int lightfs_dcache_invalidate (struct ht_cache_item *node)
 	//BUG_ON(dir_cache_item == NULL);
 
 	if (!dir_cache_item) {
-		//print_key(__func__, node->key.data, node->key.size);
-		return DB_NOTFOUND;
+		//print_key(__func__, node->key, node->key_len);
+		return false;
 	}
 
-	spin_lock(&(dir_cache_item->dcache->lock));
-
-	dir_cache_item->dcache->is_full = true; // TODO: fix me
-	dir_cache_item->dcache->e_child++; // TODO: fix me
-	//pr_info("child %d, e_child %d\n", dir_cache_item->dcache->child, dir_cache_item->dcache->e_child);
+	WRITE_ONCE(dir_cache_item->dcache->is_full, true); // TODO: fix me
+	atomic_inc(&dir_cache_item->dcache->e_child); // TODO: fix me
 #ifdef GROUP_EVICTION
-	if (dir_cache_item->dcache->e_child == dir_cache_item->dcache->child) {
-		//pr_info("evict!!\n");
-		lightfs_ht_cache_group_eviction(&(dir_cache_item->key));
-	}
+	return atomic_read(&dir_cache_item->dcache->e_child) == atomic_read(&dir_cache_item->dcache->child);
+#else
+	return false;
 #endif
-	spin_unlock(&(dir_cache_item->dcache->lock));
-
-	return 0;
 }
 
 static int lightfs_dcache_del (struct ht_cache_item *node)
 {
-	struct dcache_entry *dcache = node->parent->dcache;
-	spin_lock(&dcache->lock);
-	rb_erase(&node->rb_node, &(dcache->rb_root));
-	spin_unlock(&dcache->lock);
+	struct dcache_shard *s = lightfs_dcache_lock(node->parent->dcache, node->shard);
+
+	rb_erase(&node->rb_node, &s->rb_root);
+	spin_unlock(&s->lock);
+	atomic_dec(&node->parent->dcache->child);
 	return 0;
 }
 
@@ -175,82 +424,85 @@ static int lightfs_ht_cache_get (DB *db, DB_TXN *txn, DBT *key, DBT *value, enum
 {
 	struct ht_lock_item *ht_item;
 	struct ht_cache_item *cache_item;
-	uint32_t hkey = lightfs_ht_func(FSEED, key->data, key->size);
-	uint32_t fp = lightfs_ht_func(SSEED, key->data, key->size);
-
-	hash_for_each_possible(lightfs_ht_lock, ht_item, hnode, hkey) {
-		//print_key(__func__, key->data, key->size);
-		//spin_lock_bh(&ht_item->lock);
-		//spin_lock(&ht_item->lock);
-		down_read(&ht_item->lock);
-		hash_for_each_possible(lightfs_ht_cache, cache_item, hnode, hkey) {
-			if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key.data, cache_item->key.size, key->data, key->size)) {
+	uint32_t hkey, fp;
+	unsigned int seq;
+	bool is_free;
+	int ret = DB_NOTFOUND;
+
+	lightfs_ht_func(key->data, key->size, &hkey, &fp);
+	rcu_read_lock();
+	hash_for_each_possible_rcu(lightfs_ht_cache, cache_item, hnode, hkey) {
+		if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key, cache_item->key_len, key->data, key->size)) {
+			do {
+				seq = read_seqcount_begin(&cache_item->seq);
+				lightfs_cmeta_unpack(value->data, &cache_item->meta);
+				is_free = cache_item->is_weak_del && cache_item->is_evicted;
+			} while (read_seqcount_retry(&cache_item->seq, seq));
+			ret = 0;
+			if (!is_free)
+				break;
+			// reviving an evicted item is a write, recheck under the bucket lock
+			hash_for_each_possible(lightfs_ht_lock, ht_item, hnode, hkey) {
+				spin_lock(&ht_item->lock);
 				if (cache_item->is_weak_del && cache_item->is_evicted) {
-					memcpy(value->data, cache_item->value.data, value->size);
+					write_seqcount_begin(&cache_item->seq);
 					cache_item->is_weak_del = cache_item->is_evicted = 0;
-					//spin_unlock_bh(&ht_item->lock);
-					//spin_unlock(&ht_item->lock);
-					up_read(&ht_item->lock);
-					return DB_FOUND_FREE;
-				} else {
-					memcpy(value->data, cache_item->value.data, value->size);
-					//spin_unlock_bh(&ht_item->lock);
-					//spin_unlock(&ht_item->lock);
-					up_read(&ht_item->lock);
-					return 0;
+					write_seqcount_end(&cache_item->seq);
+					lightfs_cold_del(cache_item);
+					ret = DB_FOUND_FREE;
 				}
+				lightfs_cmeta_unpack(value->data, &cache_item->meta);
+				spin_unlock(&ht_item->lock);
 			}
+			break;
 		}
-		up_read(&ht_item->lock);
-		//spin_unlock_bh(&ht_item->lock);
-		//spin_unlock(&ht_item->lock);
 	}
-	return DB_NOTFOUND;
+	rcu_read_unlock();
+	return ret;
 }
 
 int lightfs_ht_cache_group_eviction (DBT *key)
 {
 	struct ht_lock_item *ht_item;
 	struct ht_cache_item *cache_item, *child_cache_item = NULL;
-	uint32_t hkey = lightfs_ht_func(FSEED, key->data, key->size);
-	uint32_t fp = lightfs_ht_func(SSEED, key->data, key->size);
-	struct rb_node *rb_node = NULL;
+	struct dcache_entry *dcache = NULL;
+	uint32_t hkey, fp;
 	int ret = 0;
 	int child = 0;
 
+	lightfs_ht_func(key->data, key->size, &hkey, &fp);
 	hash_for_each_possible(lightfs_ht_lock, ht_item, hnode, hkey) {
-		down_write(&ht_item->lock);
+		spin_lock(&ht_item->lock);
 		hash_for_each_possible(lightfs_ht_cache, cache_item, hnode, hkey) {
-			if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key.data, cache_item->key.size, key->data, key->size)) {
+			if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key, cache_item->key_len, key->data, key->size)) {
 				BUG_ON (cache_item->dcache == NULL);
-				rb_node = rb_first(&(cache_item->dcache->rb_root));
-				if (rb_node) { // empty dir
-					child_cache_item = container_of(rb_node, struct ht_cache_item, rb_node);	
-				} else {
-					child_cache_item = NULL;
-				}
+				dcache = cache_item->dcache;
+				child_cache_item = lightfs_dcache_next(dcache, NULL); // NULL: empty dir
 				break;
 			}
 		}
 		//the item which is be inserted newly
-		up_write(&ht_item->lock);
+		spin_unlock(&ht_item->lock);
 	}
 	if (child_cache_item) {
 		DB_TXN *txn;
-		if (!child_cache_item->key.size) {
+		DBT child_key;
+		struct lightfs_metadata meta;
+		if (!child_cache_item->key_len) {
 			return 0;
 		}
 repeat:
 		TXN_GOTO_LABEL(retry);
 		lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_MAY_WRITE);
-		while (rb_node) {
+		while (child_cache_item) {
 			if (++child > GROUP_EVICTION_TRESHOLD) {
 				break;
 			}
-			child_cache_item = container_of(rb_node, struct ht_cache_item, rb_node);
-			//print_key(__func__, child_cache_item->key.data, child_cache_item->key.size);
-			ret = lightfs_bstore_meta_put_tmp(NULL, &child_cache_item->key, txn, child_cache_item->value.data, NULL, 0);
-			rb_node = rb_next(rb_node);
+			//print_key(__func__, child_cache_item->key, child_cache_item->key_len);
+			dbt_setup(&child_key, child_cache_item->key, child_cache_item->key_len);
+			lightfs_cmeta_unpack(&meta, &child_cache_item->meta);
+			ret = lightfs_bstore_meta_put_tmp(NULL, &child_key, txn, &meta, NULL, 0);
+			child_cache_item = lightfs_dcache_next(dcache, child_cache_item);
 		}
 		if (ret) {
 			DBOP_JUMP_ON_CONFLICT(ret, retry);
@@ -268,37 +520,40 @@ repeat:
 }
 
 
-static int lightfs_ht_cache_put (DB *db, DB_TXN *txn, DBT *key, DBT *value, enum lightfs_req_type type, struct inode *dir_inode, bool is_dir)
+/*
+ * is_fill: the entry was read back from the device, it must not overwrite a
+ * cached (newer) entry, and a directory's children are not cached yet.
+ */
+static int __lightfs_ht_cache_put (DBT *key, DBT *value, struct inode *dir_inode, bool is_dir, bool is_fill)
 {
 	struct ht_lock_item *ht_item;
 	struct ht_cache_item *cache_item = NULL, *dir_cache_item;
 	DBT *dir_key = NULL;
 	uint32_t dir_hkey, dir_fp;
 	struct lightfs_inode *dir_f_inode;
-	uint32_t hkey = lightfs_ht_func(FSEED, key->data, key->size);
-	uint32_t fp = lightfs_ht_func(SSEED, key->data, key->size);
+	uint32_t hkey, fp;
 	int fp_cnt = 0, keycmp_cnt = 0;
 
+	lightfs_ht_func(key->data, key->size, &hkey, &fp);
 
 	hash_for_each_possible(lightfs_ht_lock, ht_item, hnode, hkey) {
 		//print_key(__func__, key->data, key->size);
 		//lightfs_error(__func__, "key_size: %d, hkey: %d, fp: %d\n", key->size, hkey, fp);
 		//spin_lock_bh(&ht_item->lock);
-		//spin_lock(&ht_item->lock);
-		down_write(&ht_item->lock);
+		spin_lock(&ht_item->lock);
 		hash_for_each_possible(lightfs_ht_cache, cache_item, hnode, hkey) {
-			if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key.data, cache_item->key.size, key->data, key->size)) {
-				if (cache_item->is_weak_del) {
-					//_dbt_copy_meta(&cache_item->value, value);
-					//_dbt_copy_meta(&cache_item->value, value);
-					_dbt_no_alloc_copy(&cache_item->value, value);
-				} else {
-					_dbt_no_alloc_copy(&cache_item->value, value);
+			if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key, cache_item->key_len, key->data, key->size)) {
+				if (is_fill) {
+					spin_unlock(&ht_item->lock);
+					return 0;
 				}
+				write_seqcount_begin(&cache_item->seq);
+				lightfs_cmeta_pack(&cache_item->meta, value->data);
 				cache_item->is_weak_del = cache_item->is_evicted = 0;
+				write_seqcount_end(&cache_item->seq);
+				lightfs_cold_del(cache_item);
 				//spin_unlock_bh(&ht_item->lock);
-				//spin_unlock(&ht_item->lock);
-				up_write(&ht_item->lock);
+				spin_unlock(&ht_item->lock);
 				return 0;
 			} else {
 				if (cache_item->fp == fp)
@@ -314,7 +569,7 @@ static int lightfs_ht_cache_put (DB *db, DB_TXN *txn, DBT *key, DBT *value, enum
 		cache_item->is_weak_del = 0;
 		cache_item->is_evicted = 0;
 		if (is_dir) {
-			lightfs_dcache_entry_init(cache_item);
+			lightfs_dcache_entry_init(cache_item, !is_fill);
 		}
 		if (dir_inode) {
 			dir_f_inode = LIGHTFS_I(dir_inode);
@@ -324,52 +579,133 @@ static int lightfs_ht_cache_put (DB *db, DB_TXN *txn, DBT *key, DBT *value, enum
 			dir_key = NULL;
 		}
 		//spin_unlock_bh(&ht_item->lock);
-		//spin_unlock(&ht_item->lock);
-		hash_add(lightfs_ht_cache, &(cache_item->hnode), hkey);
-		up_write(&ht_item->lock);
+		hash_add_rcu(lightfs_ht_cache, &(cache_item->hnode), hkey);
+		spin_unlock(&ht_item->lock);
 	}
 	if (dir_key) {
-		dir_hkey = lightfs_ht_func(FSEED, dir_key->data, dir_key->size);
-		dir_fp = lightfs_ht_func(SSEED, dir_key->data, dir_key->size);
+		lightfs_ht_func(dir_key->data, dir_key->size, &dir_hkey, &dir_fp);
 		//lightfs_error(__func__, "DIR key_size: %d, hkey: %d, fp: %d\n", key->size, dir_hkey, dir_fp);
-		hash_for_each_possible(lightfs_ht_cache, dir_cache_item, hnode, dir_hkey) {
-			if (dir_cache_item->fp == dir_fp && !lightfs_keycmp(dir_cache_item->key.data, dir_cache_item->key.size, dir_key->data, dir_key->size)) {
+		rcu_read_lock();
+		hash_for_each_possible_rcu(lightfs_ht_cache, dir_cache_item, hnode, dir_hkey) {
+			if (dir_cache_item->fp == dir_fp && !lightfs_keycmp(dir_cache_item->key, dir_cache_item->key_len, dir_key->data, dir_key->size)) {
 				BUG_ON(dir_cache_item->dcache == NULL);
 				lightfs_dcache_insert(dir_cache_item, cache_item);
-				dir_cache_item->dcache->child++;
 				//pr_info("insert child %d, e_child %d\n", dir_cache_item->dcache->child, dir_cache_item->dcache->e_child);
 				// directory item
 				cache_item->parent = dir_cache_item;
 			}
 		}
+		rcu_read_unlock();
 	}
 	return 0;
 }
 
+static int lightfs_ht_cache_put (DB *db, DB_TXN *txn, DBT *key, DBT *value, enum lightfs_req_type type, struct inode *dir_inode, bool is_dir)
+{
+	return __lightfs_ht_cache_put(key, value, dir_inode, is_dir, false);
+}
+
+int lightfs_ht_cache_fill (DBT *key, DBT *value, struct inode *dir_inode, bool is_dir)
+{
+	return __lightfs_ht_cache_put(key, value, dir_inode, is_dir, true);
+}
+
+/*
+ * A directory that is not cached at all is reported as loaded, there is
+ * nothing to link its children to.
+ */
+bool lightfs_ht_cache_dir_is_loaded (DBT *key)
+{
+	struct ht_cache_item *cache_item;
+	uint32_t hkey, fp;
+	bool is_loaded = true;
+
+	lightfs_ht_func(key->data, key->size, &hkey, &fp);
+	rcu_read_lock();
+	hash_for_each_possible_rcu(lightfs_ht_cache, cache_item, hnode, hkey) {
+		if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key, cache_item->key_len, key->data, key->size)) {
+			if (cache_item->dcache)
+				is_loaded = READ_ONCE(cache_item->dcache->is_loaded);
+			break;
+		}
+	}
+	rcu_read_unlock();
+	return is_loaded;
+}
+
+// taken before a scan of the directory, see lightfs_ht_cache_dir_set_loaded
+unsigned int lightfs_ht_cache_dir_gen (DBT *key)
+{
+	struct ht_cache_item *cache_item;
+	uint32_t hkey, fp;
+	unsigned int gen = 0;
+
+	lightfs_ht_func(key->data, key->size, &hkey, &fp);
+	rcu_read_lock();
+	hash_for_each_possible_rcu(lightfs_ht_cache, cache_item, hnode, hkey) {
+		if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key, cache_item->key_len, key->data, key->size)) {
+			if (cache_item->dcache)
+				gen = READ_ONCE(cache_item->dcache->gen);
+			break;
+		}
+	}
+	rcu_read_unlock();
+	return gen;
+}
+
+/*
+ * False if the shrinker dropped children since gen was taken (or is doing
+ * it now), the scan may have skipped them and has to be done again.
+ */
+bool lightfs_ht_cache_dir_set_loaded (DBT *key, unsigned int gen)
+{
+	struct ht_cache_item *cache_item;
+	struct dcache_entry *dcache;
+	uint32_t hkey, fp;
+	bool ret = true;
+
+	lightfs_ht_func(key->data, key->size, &hkey, &fp);
+	rcu_read_lock();
+	hash_for_each_possible_rcu(lightfs_ht_cache, cache_item, hnode, hkey) {
+		if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key, cache_item->key_len, key->data, key->size)) {
+			dcache = cache_item->dcache;
+			if (!dcache)
+				break;
+			spin_lock(&dcache->one.lock);
+			ret = !(gen & 1) && dcache->gen == gen;
+			if (ret)
+				WRITE_ONCE(dcache->is_loaded, true);
+			spin_unlock(&dcache->one.lock);
+			break;
+		}
+	}
+	rcu_read_unlock();
+	return ret;
+}
+
 static int lightfs_ht_cache_del (DB *db , DB_TXN *txn, DBT *key, enum lightfs_req_type type, bool is_dir)
 {
 	struct ht_lock_item *ht_item;
 	struct ht_cache_item *cache_item = NULL;
-	uint32_t hkey = lightfs_ht_func(FSEED, key->data, key->size);
-	uint32_t fp = lightfs_ht_func(SSEED, key->data, key->size);
+	uint32_t hkey, fp;
 	volatile bool found = 0;
 
+	lightfs_ht_func(key->data, key->size, &hkey, &fp);
 	hash_for_each_possible(lightfs_ht_lock, ht_item, hnode, hkey) {
 		//spin_lock_bh(&ht_item->lock);
-		//spin_lock(&ht_item->lock);
-		down_write(&ht_item->lock);
+		spin_lock(&ht_item->lock);
 		hash_for_each_possible(lightfs_ht_cache, cache_item, hnode, hkey) {
-			if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key.data, cache_item->key.size, key->data, key->size)) {
+			if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key, cache_item->key_len, key->data, key->size)) {
 				found = 1;
 				break;
 			}
 		}
 		if (found) {
-			hash_del(&cache_item->hnode);
+			hash_del_rcu(&cache_item->hnode);
+			lightfs_cold_del(cache_item);
 		}
 		//spin_unlock_bh(&ht_item->lock);
-		//spin_unlock(&ht_item->lock);
-		up_write(&ht_item->lock);
+		spin_unlock(&ht_item->lock);
 	}
 
 	if (!found)
@@ -380,9 +716,9 @@ static int lightfs_ht_cache_del (DB *db , DB_TXN *txn, DBT *key, enum lightfs_re
 
 	if (is_dir) {
 		BUG_ON(cache_item->parent->dcache == NULL);
-		lightfs_dcache_entry_free(cache_item);
 	}
-	lightfs_ht_cache_item_free(cache_item);
+	// lockless readers may still see it, the dcache entry goes with it
+	call_rcu(&cache_item->rcu, lightfs_ht_cache_item_free_rcu);
 
 	return 0;
 }
@@ -391,30 +727,46 @@ static int lightfs_ht_cache_weak_del (DB *db , DB_TXN *txn, DBT *key, enum light
 {
 	struct ht_lock_item *ht_item;
 	struct ht_cache_item *cache_item;
-	uint32_t hkey = lightfs_ht_func(FSEED, key->data, key->size);
-	uint32_t fp = lightfs_ht_func(SSEED, key->data, key->size);
+	uint32_t hkey, fp;
 	volatile bool found = 0;
+	char *dir_key = NULL;
+	uint16_t dir_key_len = 0;
 
+	lightfs_ht_func(key->data, key->size, &hkey, &fp);
 	hash_for_each_possible(lightfs_ht_lock, ht_item, hnode, hkey) {
 		//spin_lock_bh(&ht_item->lock);
-		//spin_lock(&ht_item->lock);
-		down_write(&ht_item->lock);
+		spin_lock(&ht_item->lock);
 		hash_for_each_possible(lightfs_ht_cache, cache_item, hnode, hkey) {
-			if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key.data, cache_item->key.size, key->data, key->size)) {
+			if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key, cache_item->key_len, key->data, key->size)) {
 				found = 1;
 				break;
 			}
 		}
 		if (found) {
-			up_write(&ht_item->lock);
-			lightfs_dcache_invalidate(cache_item);
-			down_write(&ht_item->lock);
+			if (lightfs_dcache_invalidate(cache_item)) {
+				dir_key_len = cache_item->parent->key_len;
+				dir_key = kmemdup(cache_item->parent->key, dir_key_len, GFP_ATOMIC);
+			}
+			write_seqcount_begin(&cache_item->seq);
 			cache_item->is_weak_del = cache_item->is_evicted = 1;
+			write_seqcount_end(&cache_item->seq);
+			cache_item->idle_txn = lightfs_bstore_txn_last_id();
+			lightfs_cold_add(cache_item);
 		}
 		//spin_unlock_bh(&ht_item->lock);
-		//spin_unlock(&ht_item->lock);
-		up_write(&ht_item->lock);
+		spin_unlock(&ht_item->lock);
+	}
+
+#ifdef GROUP_EVICTION
+	// it runs a txn and may sleep, the parent is looked up again by key
+	if (dir_key) {
+		DBT dir_dbt;
+
+		dbt_setup(&dir_dbt, dir_key, dir_key_len);
+		lightfs_ht_cache_group_eviction(&dir_dbt);
+		kfree(dir_key);
 	}
+#endif
 
 	if (!found)
 		return DB_NOTFOUND;
@@ -424,6 +776,403 @@ static int lightfs_ht_cache_weak_del (DB *db , DB_TXN *txn, DBT *key, enum light
 
 
 
+// the first child of the locked tree s after (shard, name), all children
+// share the dir prefix so names compare as the keys do
+static struct rb_node *lightfs_dcache_after (struct dcache_shard *s, uint8_t shard, char *name)
+{
+	struct rb_node *node = s->rb_root.rb_node, *next = NULL;
+	struct ht_cache_item *item;
+
+	if (!name[0])
+		return rb_first(&s->rb_root);
+	while (node) {
+		item = container_of(node, struct ht_cache_item, rb_node);
+		if (item->shard > shard ||
+		    (item->shard == shard && strcmp(lightfs_key_path(item->key), name) > 0)) {
+			next = node;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+	return next;
+}
+
+/*
+ * Fill buf with the children of dir_key that sort after last_name, as
+ * many as fit, holding one shard lock at a time. Only what readdir emits
+ * is copied and last_name moves to the last child copied. Returns
+ * DB_NOTFOUND_DCACHE_FULL once the last child is in buf.
+ */
+static int lightfs_ht_cache_readdir (DB *db, DBT *dir_key, char *last_name, char *buf, uint32_t buf_size, uint32_t *len)
+{
+	struct ht_cache_item *cache_item, *dir_cache_item = NULL;
+	struct lightfs_cmeta *meta;
+	struct lightfs_dirent *de = NULL;
+	struct dcache_entry *dcache;
+	struct dcache_shard *s;
+	struct rb_node *node;
+	uint32_t hkey, fp, off = 0, name_len;
+	unsigned int seq;
+	uint8_t shard = 0;
+	int ret = DB_NOTFOUND_DCACHE_FULL;
+
+	lightfs_ht_func(dir_key->data, dir_key->size, &hkey, &fp);
+	rcu_read_lock();
+	hash_for_each_possible_rcu(lightfs_ht_cache, cache_item, hnode, hkey) {
+		if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key, cache_item->key_len, dir_key->data, dir_key->size)) {
+			dir_cache_item = cache_item;
+			break;
+		}
+	}
+	if (!dir_cache_item || !dir_cache_item->dcache) {
+		rcu_read_unlock();
+		*len = 0;
+		return ret;
+	}
+
+	dcache = dir_cache_item->dcache;
+	if (last_name[0])
+		shard = lightfs_dcache_shard_of(last_name, strlen(last_name));
+	s = lightfs_dcache_lock(dcache, shard);
+	node = lightfs_dcache_after(s, shard, last_name);
+	for (;;) {
+		if (!node) {
+			if (s == &dcache->one || ++shard == LIGHTFS_DCACHE_SHARDS)
+				break;
+			spin_unlock(&s->lock);
+			s = lightfs_dcache_lock(dcache, shard);
+			node = rb_first(&s->rb_root);
+			continue;
+		}
+		cache_item = container_of(node, struct ht_cache_item, rb_node);
+		name_len = cache_item->key_len - PATH_POS - 1;
+		if (off + LIGHTFS_DIRENT_SIZE(name_len) > buf_size) {
+			ret = 0;
+			break;
+		}
+		de = (struct lightfs_dirent *)(buf + off);
+		meta = &cache_item->meta;
+		do {
+			seq = read_seqcount_begin(&cache_item->seq);
+			de->is_redirect = meta->type == LIGHTFS_METADATA_TYPE_REDIRECT;
+			de->ino = meta->ino;
+			de->mode = de->is_redirect ? 0 : meta->mode;
+		} while (read_seqcount_retry(&cache_item->seq, seq));
+		de->name_len = name_len;
+		memcpy(de->name, lightfs_key_path(cache_item->key), name_len);
+		off += LIGHTFS_DIRENT_SIZE(name_len);
+		node = rb_next(node);
+	}
+	if (de) {
+		memcpy(last_name, de->name, de->name_len);
+		last_name[de->name_len] = '\0';
+	}
+	spin_unlock(&s->lock);
+	rcu_read_unlock();
+
+	*len = off;
+	return ret;
+}
+
+#ifdef CACHE_SHRINK
+/*
+ * An idle entry is clean once its writes reached the device. Those of an
+ * evicted inode were committed by the time it went idle; a redirect has no
+ * txn of its own, so it waits for every committed txn.
+ */
+static inline bool lightfs_cache_is_clean (struct ht_cache_item *item, uint32_t clean)
+{
+	if (item->is_weak_del && item->is_evicted)
+		return !txn_id_before(clean, item->idle_txn);
+	return clean == lightfs_bstore_txn_last_id();
+}
+
+/*
+ * Drop an idle, clean entry: its inode is evicted, or it is a redirect
+ * and has none. The caller made sure nothing looks it up in the cache
+ * until its directory is scanned again. *dirty: it was idle but not clean.
+ */
+static bool lightfs_ht_cache_drop (struct ht_cache_item *item, uint32_t clean, bool *dirty)
+{
+	struct ht_lock_item *ht_item;
+	uint32_t hkey, fp;
+	bool idle = false;
+
+	lightfs_ht_func(item->key, item->key_len, &hkey, &fp);
+	hash_for_each_possible(lightfs_ht_lock, ht_item, hnode, hkey) {
+		spin_lock(&ht_item->lock);
+		// deleted meanwhile
+		idle = !hlist_unhashed(&item->hnode) &&
+		       ((item->is_weak_del && item->is_evicted) ||
+		        item->meta.type == LIGHTFS_METADATA_TYPE_REDIRECT);
+		if (idle && !lightfs_cache_is_clean(item, clean)) {
+			idle = false;
+			*dirty = true;
+		}
+		if (idle) {
+			hash_del_rcu(&item->hnode);
+			lightfs_cold_del(item);
+		}
+		spin_unlock(&ht_item->lock);
+	}
+	if (!idle)
+		return false;
+	if (item->parent)
+		lightfs_dcache_del(item);
+	call_rcu(&item->rcu, lightfs_ht_cache_item_free_rcu);
+	return true;
+}
+
+// put a shrunk entry back on a cold list, unless it was deleted or
+// looked up meanwhile. first: at the head, it is scanned next.
+static void lightfs_cold_readd (struct ht_cache_item *item, struct list_head *head, bool first)
+{
+	struct ht_lock_item *ht_item;
+	uint32_t hkey, fp;
+
+	lightfs_ht_func(item->key, item->key_len, &hkey, &fp);
+	hash_for_each_possible(lightfs_ht_lock, ht_item, hnode, hkey) {
+		spin_lock(&ht_item->lock);
+		if (!hlist_unhashed(&item->hnode) &&
+		    ((item->is_weak_del && item->is_evicted) ||
+		     item->meta.type == LIGHTFS_METADATA_TYPE_REDIRECT)) {
+			spin_lock(&lightfs_cold_lock);
+			if (list_empty(&item->cold)) {
+				if (first)
+					list_add(&item->cold, head);
+				else
+					list_add_tail(&item->cold, head);
+				atomic64_add(lightfs_cold_weight(item), &lightfs_shrink_stat.cold);
+			}
+			spin_unlock(&lightfs_cold_lock);
+		}
+		spin_unlock(&ht_item->lock);
+	}
+}
+
+/*
+ * Drop the idle children of an idle directory. It is marked not loaded
+ * first, so once it is looked up again its children are read back from
+ * the device; gen is odd until the drop is done and a scan overlapping it
+ * does not count. A child is dropped with its shard unlocked, so the walk
+ * finds the next one by name under the lock, as readdir does. Every child
+ * looked at costs one of *budget; once it is used up or a child is not
+ * clean the walk stops, saves where it was and sets *cut. *busy: a child
+ * directory still has children. *dirty: a child is not clean yet.
+ */
+static unsigned long lightfs_cache_shrink_dir (struct ht_cache_item *dir, uint32_t clean, unsigned long *budget, bool *busy, bool *dirty, bool *cut)
+{
+	struct dcache_entry *dcache = dir->dcache;
+	struct dcache_shard *s;
+	struct ht_cache_item *child;
+	struct ht_lock_item *ht_item;
+	struct rb_node *node;
+	char name[NAME_MAX + 1] = "";
+	uint8_t shard = 0;
+	uint32_t hkey, fp;
+	unsigned long freed = 0;
+	unsigned int len;
+	bool idle = false, is_big;
+
+	lightfs_ht_func(dir->key, dir->key_len, &hkey, &fp);
+	hash_for_each_possible(lightfs_ht_lock, ht_item, hnode, hkey) {
+		spin_lock(&ht_item->lock);
+		idle = dir->is_weak_del && dir->is_evicted;
+		if (idle) {
+			spin_lock(&dcache->one.lock);
+			dcache->gen++;
+			WRITE_ONCE(dcache->is_loaded, false);
+			spin_unlock(&dcache->one.lock);
+		}
+		spin_unlock(&ht_item->lock);
+	}
+	// only the shrinker, under lightfs_shrink_mutex, uses shrink_at
+	if (idle && dcache->shrink_at) {
+		strscpy(name, dcache->shrink_at, sizeof(name));
+		shard = dcache->shrink_shard;
+	}
+	kfree(dcache->shrink_at);
+	dcache->shrink_at = NULL;
+	if (!idle)
+		return 0;
+
+	for (;;) {
+		if (!*budget || *dirty) {
+			// from the start again if this fails
+			dcache->shrink_at = kstrdup(name, GFP_NOWAIT | __GFP_NOWARN);
+			dcache->shrink_shard = shard;
+			*cut = true;
+			break;
+		}
+		s = lightfs_dcache_lock(dcache, shard);
+		node = lightfs_dcache_after(s, shard, name);
+		if (!node) {
+			is_big = s != &dcache->one;
+			spin_unlock(&s->lock);
+			if (!is_big || ++shard == LIGHTFS_DCACHE_SHARDS)
+				break;
+			name[0] = '\0';
+			continue;
+		}
+		child = container_of(node, struct ht_cache_item, rb_node);
+		len = min_t(unsigned int, child->key_len - PATH_POS - 1, NAME_MAX);
+		memcpy(name, lightfs_key_path(child->key), len);
+		name[len] = '\0';
+		shard = child->shard;
+		spin_unlock(&s->lock);
+
+		(*budget)--;
+		if (child->dcache && lightfs_dcache_next(child->dcache, NULL))
+			*busy = true;
+		else if (lightfs_ht_cache_drop(child, clean, dirty))
+			freed++;
+	}
+
+	spin_lock(&dcache->one.lock);
+	dcache->gen++;
+	spin_unlock(&dcache->one.lock);
+	atomic64_inc(&lightfs_shrink_stat.dirs);
+	return freed;
+}
+
+static unsigned long lightfs_cache_shrink_item (struct ht_cache_item *item, uint32_t clean, unsigned long *budget, bool *dirty, bool *cut)
+{
+	unsigned long freed = 0;
+	bool busy = false;
+
+	if (item->dcache) {
+		freed = lightfs_cache_shrink_dir(item, clean, budget, &busy, dirty, cut);
+		if (*cut)
+			return freed; // the caller puts it first
+		if (busy || *dirty) {
+			// again, after its subdirectories or the flush
+			lightfs_cold_readd(item, &lightfs_cold_list, false);
+			return freed;
+		}
+		if (lightfs_dcache_next(item->dcache, NULL))
+			return freed;
+	}
+	// with a parent it goes when the parent is shrunk
+	if (!item->parent && lightfs_ht_cache_drop(item, clean, dirty))
+		freed++;
+	else if (*dirty)
+		lightfs_cold_readd(item, &lightfs_cold_list, false);
+	return freed;
+}
+
+static unsigned long lightfs_cache_shrink_count (struct shrinker *shrink, struct shrink_control *sc)
+{
+	return vfs_pressure_ratio(atomic64_read(&lightfs_shrink_stat.cold));
+}
+
+/*
+ * Free idle entries, coldest first, as long as they are clean. Flushing
+ * dirty ones is left to the txn handler: reclaim does not wait on the
+ * device here, and a txn still being written stops the scan.
+ */
+static unsigned long lightfs_cache_shrink_scan (struct shrinker *shrink, struct shrink_control *sc)
+{
+	LIST_HEAD(batch);
+	struct ht_cache_item *item;
+	unsigned long freed = 0, budget = sc->nr_to_scan;
+	uint32_t clean;
+	bool dirty = false, cut;
+
+	if (!(sc->gfp_mask & __GFP_FS))
+		return SHRINK_STOP; // from the fs itself, writeback or the txn handler
+	if (!mutex_trylock(&lightfs_shrink_mutex))
+		return SHRINK_STOP;
+
+	clean = lightfs_bstore_txn_durable_id();
+	spin_lock(&lightfs_cold_lock);
+	list_splice_init(&lightfs_cold_list, &batch);
+	spin_unlock(&lightfs_cold_lock);
+
+	// an entry taken off the list is only kept alive by RCU
+	while (budget && !dirty) {
+		rcu_read_lock();
+		spin_lock(&lightfs_cold_lock);
+		item = list_first_entry_or_null(&batch, struct ht_cache_item, cold);
+		if (item) {
+			list_del_init(&item->cold);
+			atomic64_sub(lightfs_cold_weight(item), &lightfs_shrink_stat.cold);
+		}
+		spin_unlock(&lightfs_cold_lock);
+		if (!item) {
+			rcu_read_unlock();
+			break;
+		}
+		budget--;
+		cut = false;
+		freed += lightfs_cache_shrink_item(item, clean, &budget, &dirty, &cut);
+		if (cut) // the rest of the directory comes first next time
+			lightfs_cold_readd(item, &batch, true);
+		rcu_read_unlock();
+		cond_resched();
+	}
+	// what is left is still the coldest
+	spin_lock(&lightfs_cold_lock);
+	list_splice(&batch, &lightfs_cold_list);
+	spin_unlock(&lightfs_cold_lock);
+	mutex_unlock(&lightfs_shrink_mutex);
+
+	atomic64_inc(&lightfs_shrink_stat.scan);
+	atomic64_add(freed, &lightfs_shrink_stat.freed);
+	if (dirty)
+		atomic64_inc(&lightfs_shrink_stat.dirty);
+	return freed ? freed : SHRINK_STOP;
+}
+
+static struct shrinker lightfs_cache_shrinker = {
+	.count_objects = lightfs_cache_shrink_count,
+	.scan_objects = lightfs_cache_shrink_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+#endif
+
+static int lightfs_cache_stat_show(struct seq_file *m, void *v)
+{
+	int64_t items = atomic64_read(&lightfs_cache_stat.items);
+	int64_t bytes = atomic64_read(&lightfs_cache_stat.bytes);
+	int64_t legacy = atomic64_read(&lightfs_cache_stat.legacy_bytes);
+	int i;
+
+	// a directory had the same dcache_entry before, count it on both sides
+	legacy += atomic64_read(&lightfs_cache_stat.dirs) * kmem_cache_size(dcache_entry_cachep);
+	seq_printf(m, "items: %lld\n", items);
+	seq_printf(m, "dirs: %lld\n", atomic64_read(&lightfs_cache_stat.dirs));
+	seq_printf(m, "sharded_dirs: %lld\n", atomic64_read(&lightfs_cache_stat.big_dirs));
+	seq_printf(m, "key_bytes: %lld\n", atomic64_read(&lightfs_cache_stat.key_bytes));
+	seq_printf(m, "bytes: %lld\n", bytes);
+	seq_printf(m, "bytes_per_item: %lld\n", items ? bytes / items : 0);
+	seq_printf(m, "legacy_bytes: %lld\n", legacy);
+	seq_printf(m, "legacy_bytes_per_item: %lld\n", items ? legacy / items : 0);
+	for (i = 0; i < HT_ITEM_CLASSES; i++)
+		seq_printf(m, "class_%u: %u\n", ht_item_class_key[i], kmem_cache_size(ht_item_cachep[i]));
+#ifdef CACHE_SHRINK
+	seq_printf(m, "shrink_cold: %lld\n", atomic64_read(&lightfs_shrink_stat.cold));
+	seq_printf(m, "shrink_scan: %lld\n", atomic64_read(&lightfs_shrink_stat.scan));
+	seq_printf(m, "shrink_dirs: %lld\n", atomic64_read(&lightfs_shrink_stat.dirs));
+	seq_printf(m, "shrink_freed: %lld\n", atomic64_read(&lightfs_shrink_stat.freed));
+	seq_printf(m, "shrink_dirty: %lld\n", atomic64_read(&lightfs_shrink_stat.dirty));
+#endif
+	return 0;
+}
+
+static int lightfs_cache_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lightfs_cache_stat_show, NULL);
+}
+
+static const struct file_operations lightfs_cache_stat_fops = {
+	.owner = THIS_MODULE,
+	.open = lightfs_cache_stat_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int lightfs_ht_cache_close(DB *db, uint32_t flag)
 {
 #ifdef RB_CACHE
@@ -434,6 +1183,13 @@ static int lightfs_ht_cache_close(DB *db, uint32_t flag)
 	struct ht_lock_item *ht_item;
 	struct ht_cache_item *cache_item;
 	struct hlist_node *hnode;
+
+#ifdef CACHE_SHRINK
+	unregister_shrinker(&lightfs_cache_shrinker);
+	INIT_LIST_HEAD(&lightfs_cold_list);
+	atomic64_set(&lightfs_shrink_stat.cold, 0);
+#endif
+	rcu_barrier(); // pending lightfs_ht_cache_item_free_rcu
 	for (i = 0; i < (1 << HASHTABLE_BITS); i++) {
 		ht_item = hlist_entry(lightfs_ht_lock[i].first, struct ht_lock_item, hnode);
 		hash_del(&ht_item->hnode);
@@ -446,8 +1202,9 @@ static int lightfs_ht_cache_close(DB *db, uint32_t flag)
 			lightfs_ht_cache_item_free(cache_item);
 		}
 	}
-	kmem_cache_destroy(meta_cachep);
-	kmem_cache_destroy(ht_cache_item_cachep);
+	debugfs_remove_recursive(lightfs_debugfs_dir);
+	for (i = 0; i < HT_ITEM_CLASSES; i++)
+		kmem_cache_destroy(ht_item_cachep[i]);
 	kmem_cache_destroy(dcache_entry_cachep);
 	kfree(db);
 #endif
@@ -464,63 +1221,47 @@ static int lightfs_dcache_close(DBC *c) {
 static int lightfs_dcache_c_get(DBC *c, DBT *key, DBT *value, uint32_t flags)
 {
 	struct dcache_dbc_wrap *wrap;
-	struct ht_cache_item *cache_item = NULL;
-	struct rb_node *node;
+	struct ht_cache_item *cache_item = NULL, *next;
 	uint32_t hkey;
 	uint32_t fp;
 	//print_key(__func__, key->data, key->size);
 	if (flags == DB_SET_RANGE) {
 		struct ht_lock_item *ht_item;
-		hkey = lightfs_ht_func(FSEED, key->data, key->size);
-		fp = lightfs_ht_func(SSEED, key->data, key->size);
+		lightfs_ht_func(key->data, key->size, &hkey, &fp);
 		wrap = container_of(c, struct dcache_dbc_wrap, dbc);
 		//lightfs_error(__func__, "key_size: %d, hkey: %d, fp: %d\n", key->size, hkey, fp);
 		if (wrap->node) {
 			cache_item = wrap->node;
-			memcpy(key->data, cache_item->key.data, cache_item->key.size);
-			key->size = cache_item->key.size;
-			memcpy(value->data, cache_item->value.data, value->size);
+			memcpy(key->data, cache_item->key, cache_item->key_len);
+			key->size = cache_item->key_len;
+			lightfs_cmeta_unpack(value->data, &cache_item->meta);
 			return 0;
 		}
+		rcu_read_lock();
 		hash_for_each_possible(lightfs_ht_lock, ht_item, hnode, hkey) {
-			down_read(&ht_item->lock);
-
-			hash_for_each_possible(lightfs_ht_cache, cache_item, hnode, hkey) {
-				if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key.data, cache_item->key.size, key->data, key->size)) {
+			hash_for_each_possible_rcu(lightfs_ht_cache, cache_item, hnode, hkey) {
+				if (cache_item->fp == fp && !lightfs_keycmp(cache_item->key, cache_item->key_len, key->data, key->size)) {
 					//lightfs_error(__func__, "found");
 					break;
 				}
 			}
-			up_read(&ht_item->lock);
 			if (cache_item) { // found directory
-				struct rb_node *rb_node;
-				spinlock_t *lock = &(cache_item->dcache->lock);
-				spin_lock(lock);
-				rb_node = rb_first(&(cache_item->dcache->rb_root));
-				if (rb_node) {
-					cache_item = container_of(rb_node, struct ht_cache_item, rb_node);
-				} else {
-					if (cache_item->dcache->is_full) {
-						spin_unlock(lock);
-						return DB_NOTFOUND_DCACHE_FULL;
-					} else {
-       	                                 	spin_unlock(lock);
-						return DB_NOTFOUND_DCACHE_FULL;
-					}
+				cache_item = lightfs_dcache_next(cache_item->dcache, NULL);
+				if (!cache_item) {
+					rcu_read_unlock();
+					return DB_NOTFOUND_DCACHE_FULL;
 				}
-				spin_unlock(lock);
 			} else {
+				rcu_read_unlock();
 				return DB_NOTFOUND_DCACHE_FULL;
 				BUG_ON(1);
 			}
 		}
 		wrap->node = cache_item;
-		memcpy(key->data, cache_item->key.data, cache_item->key.size);
-		key->size = cache_item->key.size;
-		memcpy(value->data, cache_item->value.data, value->size);
-		//key->data = cache_item->key.data;
-		//key->size = cache_item->key.size;
-		//value->data = cache_item->value.data;
+		memcpy(key->data, cache_item->key, cache_item->key_len);
+		key->size = cache_item->key_len;
+		lightfs_cmeta_unpack(value->data, &cache_item->meta);
+		rcu_read_unlock();
 		return 0;
 	} 
 
@@ -535,25 +1276,15 @@ static int lightfs_dcache_c_get(DBC *c, DBT *key, DBT *value, uint32_t flags)
 		print_key(__func__, key->data, key->size);
 	}
 
-	spin_lock(&(cache_item->dcache->lock));
-	node = &(wrap->node->rb_node);
-	node = rb_next(node);
-	if (node == NULL) {
+	next = lightfs_dcache_next(cache_item->dcache, wrap->node);
+	if (next == NULL) {
 		wrap->node = NULL;
-		if (cache_item->dcache->is_full) {
-			spin_unlock(&(cache_item->dcache->lock));
-			return DB_NOTFOUND_DCACHE_FULL;
-		} else {
-			spin_unlock(&(cache_item->dcache->lock));
-			return DB_NOTFOUND_DCACHE_FULL;
-		}
-
+		return DB_NOTFOUND_DCACHE_FULL;
 	}
-	spin_unlock(&(cache_item->dcache->lock));
 
 	if (wrap->right != NULL) {
-		struct ht_cache_item *ht_item = container_of(node, struct ht_cache_item, rb_node);
-		if (lightfs_keycmp(ht_item->key.data, ht_item->key.size, wrap->right->data, wrap->right->size) > 0) {
+		struct ht_cache_item *ht_item = next;
+		if (lightfs_keycmp(ht_item->key, ht_item->key_len, wrap->right->data, wrap->right->size) > 0) {
 			wrap->node = NULL;
 			if (cache_item->dcache->is_full)
 				return DB_NOTFOUND_DCACHE_FULL;
@@ -562,10 +1293,10 @@ static int lightfs_dcache_c_get(DBC *c, DBT *key, DBT *value, uint32_t flags)
 
 		}
 	}
-	wrap->node = container_of(node, struct ht_cache_item, rb_node);
-	memcpy(key->data, wrap->node->key.data, wrap->node->key.size);
-	key->size = wrap->node->key.size;
-	memcpy(value->data, wrap->node->value.data, value->size);
+	wrap->node = next;
+	memcpy(key->data, wrap->node->key, wrap->node->key_len);
+	key->size = wrap->node->key_len;
+	lightfs_cmeta_unpack(value->data, &wrap->node->meta);
 	
 	return 0;
 }
@@ -611,6 +1342,7 @@ int lightfs_cache_create(DB **db, DB_ENV *env, uint32_t flags)
 #else
 	int i;
 	struct ht_lock_item *ht_item;
+	char name[32];
 
 	*db = kmalloc(sizeof(DB), GFP_NOIO);
 	if (*db == NULL) {
@@ -624,15 +1356,26 @@ int lightfs_cache_create(DB **db, DB_ENV *env, uint32_t flags)
 	(*db)->cache_put = lightfs_ht_cache_put;
 	(*db)->cache_del = lightfs_ht_cache_del;
 	(*db)->cache_weak_del = lightfs_ht_cache_weak_del;
+	(*db)->cache_readdir = lightfs_ht_cache_readdir;
 	(*db)->cursor = lightfs_dcache_cursor;
 
+	for (i = 0; i < HT_ITEM_CLASSES; i++) {
+		snprintf(name, sizeof(name), "lightfs_ht_item_%u", ht_item_class_key[i]);
+		ht_item_cachep[i] = kmem_cache_create(name, sizeof(struct ht_cache_item) + ht_item_class_key[i], 0, KMEM_CACHE_FLAG, NULL);
+		if (!ht_item_cachep[i]) {
+			while (i--)
+				kmem_cache_destroy(ht_item_cachep[i]);
+			kfree(*db);
+			*db = NULL;
+			return -ENOMEM;
+		}
+	}
 
 	hash_init(lightfs_ht_cache);
 	hash_init(lightfs_ht_lock);
 	for (i = 0; i < (1 << HASHTABLE_BITS); i++) {
 		ht_item = kmalloc(sizeof(struct ht_lock_item), GFP_NOIO);
-		//spin_lock_init(&ht_item->lock);
-		init_rwsem(&ht_item->lock);
+		spin_lock_init(&ht_item->lock);
 		INIT_HLIST_NODE(&ht_item->hnode);
 		hlist_add_head(&ht_item->hnode, &lightfs_ht_lock[i]);
 	}
@@ -642,13 +1385,16 @@ int lightfs_cache_create(DB **db, DB_ENV *env, uint32_t flags)
 		kmem_cache_destroy(dcache_entry_cachep);
 
 
-	ht_cache_item_cachep = kmem_cache_create("lightfs_ht_cachep", sizeof(struct ht_cache_item), 0, KMEM_CACHE_FLAG, NULL);
-	if (!ht_cache_item_cachep)
-		kmem_cache_destroy(ht_cache_item_cachep);
-
-	meta_cachep = kmem_cache_create("lightfs_meta_cachep", INODE_SIZE, 0, KMEM_CACHE_FLAG, NULL);
-	if (!meta_cachep)
-		kmem_cache_destroy(meta_cachep);
+	lightfs_debugfs_dir = debugfs_create_dir("lightfs", NULL);
+	if (!IS_ERR_OR_NULL(lightfs_debugfs_dir)) {
+		debugfs_create_file("cache", 0444, lightfs_debugfs_dir, NULL, &lightfs_cache_stat_fops);
+#ifdef READA
+		debugfs_create_file("reada", 0444, lightfs_debugfs_dir, NULL, &lightfs_reada_stat_fops);
+#endif
+	}
+#ifdef CACHE_SHRINK
+	register_shrinker(&lightfs_cache_shrinker);
+#endif
 
 #endif
 
@@ -4,30 +4,88 @@
 #include "db.h"
 #include "lightfs_fs.h"
 #include <linux/hashtable.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
+
+/*
+ * Children of a directory are ordered by (shard, name), shard being a hash
+ * of the name. A directory keeps them in one tree until it has
+ * LIGHTFS_DCACHE_SHARD_MIN of them, then splits them into one tree and
+ * lock per shard. The order is the same either way, so a readdir going
+ * on across the split resumes where it was.
+ */
+#define LIGHTFS_DCACHE_SHARD_BITS 4
+#define LIGHTFS_DCACHE_SHARDS (1 << LIGHTFS_DCACHE_SHARD_BITS)
+#define LIGHTFS_DCACHE_SHARD_MIN 1024
+
+struct dcache_shard {
+	spinlock_t lock;
+	struct rb_root rb_root;
+};
+
+struct dcache_shard_big {
+	struct dcache_shard s;
+} ____cacheline_aligned_in_smp;
 
 struct dcache_entry {
 	bool is_full;
-	struct rb_root rb_root;
-	spinlock_t lock;
-	uint32_t child;
-	uint32_t e_child;
+	bool is_loaded; // children read back from the device
+	struct dcache_shard one; // all children until the split
+	struct dcache_shard_big *big; // set once, under one.lock
+	atomic_t child;
+	atomic_t e_child;
+	unsigned int gen; // odd while the shrinker drops children, under one.lock
+	uint32_t cold; // what the dir counts for on the cold list
+	char *shrink_at; // name a cut short shrink resumes after, in shrink_shard
+	uint8_t shrink_shard;
 };
 
+/*
+ * lightfs_ht_cache is read under RCU; writers of a bucket serialize on
+ * the matching ht_lock_item, items are freed after a grace period.
+ */
 struct ht_lock_item {
-	//spinlock_t lock;
-	struct rw_semaphore lock;
+	spinlock_t lock;
 	struct hlist_node hnode;
 };
 
+/*
+ * The cached form of struct lightfs_metadata: only the stat fields lightfs
+ * keeps, st_blksize is always LIGHTFS_BSTORE_BLOCKSIZE.
+ */
+struct lightfs_cmeta {
+	uint64_t ino; // st_ino, or the target of a redirect
+	uint64_t size;
+	uint64_t blocks;
+	int64_t atime, mtime, ctime;
+	uint32_t mode;
+	uint32_t nlink;
+	uint32_t uid, gid;
+	uint32_t dev, rdev; // kernel dev_t, 32 bits
+	uint8_t type;
+};
+
+/*
+ * One allocation per cached key: the key is inline at the end and the
+ * item comes from the slab class that fits it.
+ */
 struct ht_cache_item {
-	DBT key, value;
+	struct lightfs_cmeta meta;
 	bool is_weak_del;
 	bool is_evicted;
+	uint8_t shard; // in the parent's dcache
+	uint8_t class; // slab class
 	uint32_t fp;
+	uint32_t idle_txn; // last committed txn when it went idle
+	seqcount_t seq; // meta and flags, written under the bucket lock
+	uint16_t key_len;
+	struct rcu_head rcu;
 	struct hlist_node hnode;
 	struct rb_node rb_node;
+	struct list_head cold; // on lightfs_cold_list while idle
 	struct dcache_entry *dcache; 
 	struct ht_cache_item *parent;
+	char key[];
 };
 
 struct dcache_dbc_wrap {
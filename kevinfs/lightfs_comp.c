@@ -0,0 +1,172 @@
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/crypto.h>
+#include <linux/crc32.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+
+#include <linux/mm.h>
+#include <linux/bitmap.h>
+#include "lightfs_comp.h"
+
+#ifdef COMPRESS
+// a value is kept compressed only when it saves at least this much
+#define LIGHTFS_COMP_MIN_SAVING	(PAGE_SIZE / 8)
+// sampled bytes and the count of distinct values that marks a page as
+// incompressible (random or already compressed data)
+#define LIGHTFS_COMP_SAMPLE	256
+#define LIGHTFS_COMP_DISTINCT	200
+
+struct lightfs_comp_cpu {
+	struct crypto_comp *tfm;
+	char *buf;
+};
+
+static DEFINE_PER_CPU(struct lightfs_comp_cpu, lightfs_comp_cpu);
+
+static struct {
+	atomic64_t pages;
+	atomic64_t compressed;
+	atomic64_t skipped;
+	atomic64_t bytes_in;
+	atomic64_t bytes_out;
+	atomic64_t comp_ns;
+	atomic64_t decomp_ns;
+	atomic64_t decompressed;
+} lightfs_comp_stat;
+
+static bool lightfs_comp_worth(const char *page)
+{
+	DECLARE_BITMAP(seen, 256);
+	int i, distinct = 0;
+
+	bitmap_zero(seen, 256);
+	for (i = 0; i < LIGHTFS_COMP_SAMPLE; i++) {
+		if (!__test_and_set_bit((uint8_t)page[i * (PAGE_SIZE / LIGHTFS_COMP_SAMPLE)], seen))
+			distinct++;
+	}
+
+	return distinct < LIGHTFS_COMP_DISTINCT;
+}
+
+static inline bool lightfs_comp_magic(const char *val)
+{
+	return ((const struct lightfs_comp_hdr *)val)->magic == LIGHTFS_COMP_MAGIC;
+}
+
+// write page to dst, compressed if that pays off, and return the value length
+uint16_t lightfs_comp_page(const char *page, char *dst)
+{
+	struct lightfs_comp_hdr *hdr = (struct lightfs_comp_hdr *)dst;
+	struct lightfs_comp_cpu *cpu;
+	unsigned int len = PAGE_SIZE - sizeof(*hdr) - LIGHTFS_COMP_MIN_SAVING;
+	bool force = lightfs_comp_magic(page);
+	ktime_t start;
+	int ret;
+
+	atomic64_inc(&lightfs_comp_stat.pages);
+	atomic64_add(PAGE_SIZE, &lightfs_comp_stat.bytes_in);
+	if (!force && !lightfs_comp_worth(page))
+		goto raw;
+
+	if (force)
+		len = PAGE_SIZE - sizeof(*hdr);
+	start = ktime_get();
+	cpu = &get_cpu_var(lightfs_comp_cpu);
+	ret = crypto_comp_compress(cpu->tfm, (const u8 *)page, PAGE_SIZE, (u8 *)dst + sizeof(*hdr), &len);
+	put_cpu_var(lightfs_comp_cpu);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)), &lightfs_comp_stat.comp_ns);
+	if (ret) {
+		// a raw page that looks compressed is still told apart by crc
+		if (force)
+			pr_warn_once("lightfs: raw page with compression magic\n");
+		goto raw;
+	}
+
+	hdr->magic = LIGHTFS_COMP_MAGIC;
+	hdr->len = len;
+	hdr->pad = 0;
+	hdr->crc = crc32_le(~0, (const u8 *)page, PAGE_SIZE);
+	atomic64_inc(&lightfs_comp_stat.compressed);
+	atomic64_add(sizeof(*hdr) + len, &lightfs_comp_stat.bytes_out);
+
+	return sizeof(*hdr) + len;
+raw:
+	atomic64_inc(&lightfs_comp_stat.skipped);
+	atomic64_add(PAGE_SIZE, &lightfs_comp_stat.bytes_out);
+	memcpy(dst, page, PAGE_SIZE);
+
+	return PAGE_SIZE;
+}
+
+// val is a PAGE_SIZE slot of a data value, decompressed in place
+void lightfs_decomp_page(char *val)
+{
+	struct lightfs_comp_hdr *hdr = (struct lightfs_comp_hdr *)val;
+	struct lightfs_comp_cpu *cpu;
+	unsigned int len = PAGE_SIZE;
+	ktime_t start;
+	int ret;
+
+	if (!lightfs_comp_magic(val) || hdr->len > PAGE_SIZE - sizeof(*hdr))
+		return;
+
+	start = ktime_get();
+	cpu = &get_cpu_var(lightfs_comp_cpu);
+	ret = crypto_comp_decompress(cpu->tfm, (const u8 *)val + sizeof(*hdr), hdr->len, (u8 *)cpu->buf, &len);
+	if (!ret && len == PAGE_SIZE && crc32_le(~0, (const u8 *)cpu->buf, PAGE_SIZE) == hdr->crc) {
+		memcpy(val, cpu->buf, PAGE_SIZE);
+		atomic64_inc(&lightfs_comp_stat.decompressed);
+	}
+	put_cpu_var(lightfs_comp_cpu);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)), &lightfs_comp_stat.decomp_ns);
+}
+
+int lightfs_comp_init(void)
+{
+	struct lightfs_comp_cpu *cpu;
+	int i;
+
+	for_each_possible_cpu(i) {
+		cpu = per_cpu_ptr(&lightfs_comp_cpu, i);
+		cpu->tfm = crypto_alloc_comp("lz4", 0, 0);
+		if (IS_ERR(cpu->tfm)) {
+			cpu->tfm = NULL;
+			goto err;
+		}
+		cpu->buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		if (!cpu->buf)
+			goto err;
+	}
+
+	return 0;
+err:
+	lightfs_comp_exit();
+	return -ENOMEM;
+}
+
+void lightfs_comp_exit(void)
+{
+	struct lightfs_comp_cpu *cpu;
+	int i;
+
+	for_each_possible_cpu(i) {
+		cpu = per_cpu_ptr(&lightfs_comp_cpu, i);
+		if (cpu->tfm)
+			crypto_free_comp(cpu->tfm);
+		kfree(cpu->buf);
+		cpu->tfm = NULL;
+		cpu->buf = NULL;
+	}
+
+	pr_info("LIGHTFS COMP SUMMARY: pages %lld compressed %lld skipped %lld bytes_in %lld bytes_out %lld comp_us %lld decompressed %lld decomp_us %lld\n",
+	        atomic64_read(&lightfs_comp_stat.pages),
+	        atomic64_read(&lightfs_comp_stat.compressed),
+	        atomic64_read(&lightfs_comp_stat.skipped),
+	        atomic64_read(&lightfs_comp_stat.bytes_in),
+	        atomic64_read(&lightfs_comp_stat.bytes_out),
+	        atomic64_read(&lightfs_comp_stat.comp_ns) / 1000,
+	        atomic64_read(&lightfs_comp_stat.decompressed),
+	        atomic64_read(&lightfs_comp_stat.decomp_ns) / 1000);
+}
+#endif
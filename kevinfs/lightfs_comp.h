@@ -0,0 +1,27 @@
+#ifndef __LIGHTFS_COMP_H__
+#define __LIGHTFS_COMP_H__
+
+#include <linux/types.h>
+
+#ifdef COMPRESS
+/*
+ * A compressed data value starts with this header, the LZ4 stream follows.
+ * Any other value is a raw page. crc (of the page) tells a raw page that
+ * merely starts with the magic from a compressed one.
+ */
+#define LIGHTFS_COMP_MAGIC	0x6b6576696e4c5a34ULL // "kevinLZ4"
+
+struct lightfs_comp_hdr {
+	uint64_t magic;
+	uint16_t len;
+	uint16_t pad;
+	uint32_t crc;
+};
+
+int lightfs_comp_init(void);
+void lightfs_comp_exit(void);
+uint16_t lightfs_comp_page(const char *page, char *dst);
+void lightfs_decomp_page(char *val);
+#endif
+
+#endif
@@ -23,6 +23,10 @@ int lightfs_db_get (DB *db, DB_TXN *txn, DBT *key, DBT *value, enum lightfs_req_
 	return lightfs_bstore_txn_get(db, txn, key, value, 0, type);
 }
 
+int lightfs_db_get_async (DB *db, DB_TXN *txn, DBT *key, DBT *value, enum lightfs_req_type type, struct lightfs_get_async *ga) {
+	return lightfs_bstore_txn_get_async(db, txn, key, value, 0, type, ga);
+}
+
 int lightfs_db_put (DB *db, DB_TXN *txn, DBT *key, DBT *value, enum lightfs_req_type type)
 {
 	return lightfs_bstore_txn_insert(db, txn, key, value, 0, type);
@@ -109,6 +113,7 @@ int lightfs_db_create(DB **db, DB_ENV *env, uint32_t flags)
 	(*db)->open = lightfs_db_open;
 	(*db)->close = lightfs_db_close;
 	(*db)->get = lightfs_db_get;
+	(*db)->get_async = lightfs_db_get_async;
 	(*db)->put = lightfs_db_put;
 	(*db)->sync_put = lightfs_db_sync_put;
 	(*db)->seq_put = lightfs_db_seq_put;
@@ -36,6 +36,8 @@ int lightfs_db_env_close (DB_ENV *env, uint32_t a)
 
 int lightfs_db_env_create(DB_ENV **envp, uint32_t flags)
 {
+	int r;
+
 	*envp = kmalloc(sizeof(DB_ENV), GFP_NOIO);
 	if (*envp == NULL) {
 		return -ENOMEM;
@@ -47,7 +49,12 @@ int lightfs_db_env_create(DB_ENV **envp, uint32_t flags)
 	(*envp)->open = lightfs_db_env_open;
 	(*envp)->close = lightfs_db_env_close;
 
-	lightfs_txn_hdlr_init();
+	r = lightfs_txn_hdlr_init();
+	if (r) {
+		db_env_close(*envp, 0);
+		kfree(*envp);
+		*envp = NULL;
+	}
 
-	return 0;
+	return r;
 }
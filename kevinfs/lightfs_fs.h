@@ -7,7 +7,10 @@
 #include <linux/fscache.h>
 #include <linux/list_sort.h>
 #include <linux/slab.h>
+#include <linux/highmem.h>
 #include <linux/ktime.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
 
 #include "lightfs_debug.h"
 #include "db.h"
@@ -61,6 +64,15 @@ void exit_lightfs_fs(void);
 #define lightfs_get_block_num_by_size(size)	\
 		(((size) == 0) ? 0 : (((size) - 1) >> (LIGHTFS_BSTORE_BLOCKSIZE_BITS)) + 1)
 
+static inline bool lightfs_page_is_zero(struct page *page)
+{
+	void *buf = kmap_atomic(page);
+	bool ret = !memchr_inv(buf, 0, PAGE_SIZE);
+
+	kunmap_atomic(buf);
+	return ret;
+}
+
 #define LIGHTFS_SUPER_MAGIC 0XF7F5
 
 #define TIME_T_TO_TIMESPEC(ts, t) do \
@@ -76,13 +88,33 @@ void exit_lightfs_fs(void);
 
 #define LARGE_IO_THRESHOLD 256
 
-#define LIGHTFS_INO_INC        1000
+#ifdef EXTENT
+#if !defined(PINK) || !defined(WB)
+#error "EXTENT needs PINK (del_multi by count) and WB"
+#endif
+// a group of LIGHTFS_EXTENT_PAGES pages (aligned by page index) that is
+// dirty from its start up to its end or EOF is stored as one record,
+// keyed by the first block. Page records written later override it.
+#define LIGHTFS_EXTENT_PAGES 16
+
+static inline uint64_t lightfs_extent_start(uint64_t block_num)
+{
+	return ((block_num - 1) & ~((uint64_t)LIGHTFS_EXTENT_PAGES - 1)) + 1;
+}
+#endif
+
+#define LIGHTFS_INO_LEASE_MIN	1024
+#define LIGHTFS_INO_LEASE_MAX	65536
+#define LIGHTFS_INO_PREFETCH	(LIGHTFS_INO_LEASE_MAX * 4)
 #define LIGHTFS_INO_MAX		1000000000000ULL
 #define LIGHTFS_INO_CUR		1ULL
 
+// per-cpu lease of inode numbers [next_ino, max_ino)
 struct lightfs_info {
 	ino_t next_ino;
 	ino_t max_ino;
+	unsigned int lease;
+	unsigned long refill_time;
 };
 
 // LIGHTFS superblock info
@@ -92,25 +124,47 @@ struct lightfs_sb_info {
 	DB *data_db;
 	DB *meta_db;
 	DB *cache_db;
-	unsigned s_nr_cpus;
 	struct lightfs_info __percpu *s_lightfs_info;
+	// inode numbers below s_ino_next are leased to cpus, numbers below
+	// s_ino_committed are covered by a committed next_ino record
+	spinlock_t s_ino_lock;
+	ino_t s_ino_next;
+	ino_t s_ino_committed;
+	ino_t s_ino_target;
+	int s_ino_err; // last lease write failed, retried on the next refill
+	struct work_struct s_ino_work;
+	wait_queue_head_t s_ino_wq;
 };
 
 enum reada_state {
 	READA_EMPTY = 1,
 	READA_FULL = 2,
 	READA_DONE = 4,
+	READA_CANCEL = 8, // drop the pages instead of filling them
+};
+
+// the sequential stream of an open file, under the inode's reada_spin
+struct lightfs_reada_stream {
+	pgoff_t seq_next; // page after the last read
+	unsigned long run; // pages read in sequence
+	pgoff_t next; // first page not read ahead yet
+	unsigned int entry_cnt; // its windows in flight
+	unsigned int gen; // ra_gen its next was set under
 };
 
+// a readahead window: locked page cache pages a GET_MULTI fills on completion
 struct reada_entry {
 	char *buf;
+	struct lightfs_io *lightfs_io;
 	uint64_t reada_block_start;
 	unsigned reada_block_len;
 	int tag;
-	struct completion reada_acked;
+	uint32_t ubuf_len; // 0: the whole window is a hole
 	void *extra;
+	struct lightfs_reada_stream *stream; // NULL: VFS readahead with no file
 	enum reada_state reada_state;
 	struct list_head list;
+	struct work_struct work;
 };
 
 struct lightfs_inode {
@@ -119,15 +173,14 @@ struct lightfs_inode {
 	DBT meta_dbt;
 	struct list_head rename_locked;
 	uint64_t lightfs_flags;
-	//enum reada_state reada_state;
-	uint64_t last_block_start;
-	unsigned last_block_len;
-	struct reada_entry *ra_entry;
-	struct list_head ra_list;
-	uint8_t ra_entry_cnt;
+	struct list_head ra_list; // windows in flight, of all streams
+	unsigned int ra_entry_cnt;
+	unsigned int ra_gen; // bumped when all windows are cancelled
 	spinlock_t reada_spin;
 	bool is_lookuped;
 	//struct rw_semaphore reada_spin;
+	struct mutex load_mutex; // serializes lightfs_bstore_meta_load_dir
+	uint32_t last_txn_id; // newest txn with this inode's pages or metadata
 };
 
 #define LIGHTFS_FLAG_DELETED ((uint64_t)(1 << 0))
@@ -221,6 +274,21 @@ static inline struct lightfs_inode *LIGHTFS_I(struct inode *inode)
 	return container_of(inode, struct lightfs_inode, vfs_inode);
 }
 
+// remember the newest txn that fsync of this inode has to wait for
+static inline void lightfs_inode_txn_update(struct inode *inode, uint32_t txn_id)
+{
+	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
+	uint32_t old;
+
+	if (!txn_id)
+		return;
+	do {
+		old = READ_ONCE(lightfs_inode->last_txn_id);
+		if (old && (int32_t)(txn_id - old) <= 0)
+			return;
+	} while (cmpxchg(&lightfs_inode->last_txn_id, old, txn_id) != old);
+}
+
 enum lightfs_metadata_type {
 	LIGHTFS_METADATA_TYPE_NORMAL = 0,
 	LIGHTFS_METADATA_TYPE_REDIRECT = 1,
@@ -282,6 +350,20 @@ static inline int dbt_alloc(DBT *dbt, size_t size)
 	return 0;
 }
 
+// one child as the dcache hands it to readdir, 8-byte aligned in a batch
+struct lightfs_dirent {
+	u64 ino; // the target ino of a redirect
+	uint16_t mode;
+	uint8_t is_redirect;
+	uint8_t name_len;
+	char name[];
+};
+
+#define LIGHTFS_DIRENT_SIZE(name_len) \
+	ALIGN(sizeof(struct lightfs_dirent) + (name_len), 8)
+// keeps a readdir_ctx within one 4K object
+#define LIGHTFS_READDIR_BATCH 3584
+
 struct readdir_ctx {
 	DB_TXN *txn;
 	DBC *cursor;
@@ -290,6 +372,12 @@ struct readdir_ctx {
 	DBC *dcursor;
 #endif
 	uint32_t emit_cnt;
+	// listing from the dcache (pos == 4): the batch being emitted and
+	// the name the next one starts after
+	uint32_t batch_len, batch_off;
+	bool batch_end;
+	char last_name[NAME_MAX + 1];
+	char batch[LIGHTFS_READDIR_BATCH];
 };
 
 struct lightfs_io_vec {
@@ -427,20 +515,45 @@ static inline void lightfs_io_unlock_pages(struct lightfs_io *lightfs_io)
 		unlock_page((lightfs_io->lightfs_io_vec + i)->fv_page);
 }
 
+#ifdef ASYNC_GET
+// async gets one caller keeps in flight
+#define LIGHTFS_ASYNC_GET_MAX 32
+
+// the pages left span more than twice their number, a get_multi over the
+// range would mostly move blocks that are already cached
+static inline bool lightfs_io_is_sparse(struct lightfs_io *lightfs_io)
+{
+	unsigned left = lightfs_io->lightfs_vcnt - lightfs_io->lightfs_bvidx;
+
+	if (left < 2)
+		return false;
+	return lightfs_io_last_page(lightfs_io)->index -
+	       lightfs_io_current_page(lightfs_io)->index + 1 > 2 * left;
+}
+#endif
+
 
 
 #ifdef LIGHTFS
 int lightfs_bstore_group_eviction(struct inode *inode);
 int lightfs_ht_cache_group_eviction (DBT *);
+int lightfs_ht_cache_fill (DBT *, DBT *, struct inode *, bool);
+bool lightfs_ht_cache_dir_is_loaded (DBT *);
+unsigned int lightfs_ht_cache_dir_gen (DBT *);
+bool lightfs_ht_cache_dir_set_loaded (DBT *, unsigned int);
 int __lightfs_bstore_txn_begin(DB_TXN *, DB_TXN **, uint32_t);
 int lightfs_bstore_txn_commit(DB_TXN *, uint32_t);
+int lightfs_bstore_txn_commit_id(DB_TXN *, uint32_t, uint32_t *);
+int lightfs_bstore_txn_sync(uint32_t);
+uint32_t lightfs_bstore_txn_last_id(void);
+uint32_t lightfs_bstore_txn_durable_id(void);
 int lightfs_bstore_txn_abort(DB_TXN *);
 #define lightfs_bstore_txn_begin(env, parent, txn, flags)  \
                 __lightfs_bstore_txn_begin(parent, txn, flags)
 #endif
 
 int lightfs_bstore_get_ino(DB *meta_db, DB_TXN *txn, ino_t *ino);
-int lightfs_bstore_update_ino(DB *meta_db, DB_TXN *txn, ino_t ino);
+int lightfs_bstore_put_ino(DB *meta_db, DB_TXN *txn, ino_t ino);
 
 int lightfs_bstore_meta_get_tmp(DB *meta_db, DBT *meta_dbt, DB_TXN *txn,
                          struct lightfs_metadata *metadata);
@@ -451,13 +564,22 @@ int lightfs_bstore_env_close(struct lightfs_sb_info *sbi);
 
 int lightfs_bstore_meta_get(DB *meta_db, DBT *meta_dbt, DB_TXN *txn,
                          struct lightfs_metadata *metadata);
+int lightfs_bstore_meta_lookup(DB *meta_db, DBT *meta_dbt, DB_TXN *txn,
+                         struct lightfs_metadata *metadata);
+int lightfs_bstore_meta_load_dir(DB *meta_db, DB_TXN *txn, struct inode *dir);
 
 #ifdef LIGHTFS
 int lightfs_bstore_meta_readdir(DB *meta_db, DBT *meta_dbt, DB_TXN *txn,
                              struct dir_context *ctx, struct inode *inode, struct readdir_ctx *);
+int lightfs_bstore_meta_readdir_cached(DB *meta_db, DBT *meta_dbt,
+                             struct dir_context *ctx, struct readdir_ctx *dir_ctx);
 int lightfs_bstore_get(DB *data_db, DBT *data_dbt, DB_TXN *txn, void *buf, struct inode *inode); //TODO
 int lightfs_bstore_put(DB *data_db, DBT *data_dbt, DB_TXN *txn,
                     const void *buf, size_t len, int is_seq); //TODO
+#ifdef EXTENT
+int lightfs_bstore_put_extent(DB *data_db, DBT *data_dbt, DB_TXN *txn,
+                              struct page **pages, unsigned nr_pages);
+#endif
 int lightfs_bstore_put_page(DB *data_db, DBT *data_dbt, DB_TXN *txn,
                     struct page *page, size_t len, int is_seq); //TODO
 int lightfs_bstore_update(DB *data_db, DBT *data_dbt, DB_TXN *txn,
@@ -492,15 +614,25 @@ int lightfs_bstore_meta_put_tmp(DB *meta_db, DBT *meta_dbt, DB_TXN *txn,
 // truncate a file in data_db (we dont do extend-like falloc in our truncate),
 // preserve offset bytes in block new_num, (offset == 0) means delete that block
 #ifdef LIGHTFS
+int lightfs_bstore_del_range(DB *data_db, struct inode *inode,
+                          uint64_t block_num, uint64_t block_cnt);
 int lightfs_bstore_trunc(DB *data_db, DBT *meta_dbt, DB_TXN *txn,
                       uint64_t new_num, uint64_t offset, struct inode *inode);
 int lightfs_bstore_scan_one_page(DB *data_db, DBT *meta_dbt, DB_TXN *txn,
                               struct page *page, struct inode *inode);
 int lightfs_bstore_scan_pages(DB *data_db, DBT *meta_dbt, DB_TXN *txn,
                            struct lightfs_io *lightfs_io, struct inode *inode);
+#ifdef ASYNC_GET
+int lightfs_bstore_scan_sparse_pages(DB *data_db, DB_TXN *txn,
+                           struct lightfs_io *lightfs_io, struct inode *inode);
+#endif
+int lightfs_bstore_scan_user_pages(DB *data_db, DB_TXN *txn, struct inode *inode,
+                           uint64_t block_num, struct page **pages, unsigned nr_pages);
+int lightfs_bstore_seek(DB *data_db, DB_TXN *txn, struct inode *inode,
+                           uint64_t block_num, int whence, uint64_t *found);
 #ifdef READA
-int lightfs_bstore_reada_pages(DB *data_db, DBT *meta_dbt, DB_TXN *txn,
-                           struct lightfs_io *lightfs_io, struct inode *inode, unsigned iter);
+int lightfs_bstore_reada_pages(DB *data_db, DB_TXN *txn, struct inode *inode,
+                           struct reada_entry *ra_entry);
 #endif
 int lightfs_dir_is_empty(DB *meta_db, DBT *meta_dbt, DB_TXN *txn, int *ret, struct inode *inode);
 #else
@@ -0,0 +1,108 @@
+#ifndef __LIGHTFS_HASH_H__
+#define __LIGHTFS_HASH_H__
+
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#ifdef CONFIG_X86_64
+#include <asm/cpufeature.h>
+#endif
+
+/*
+ * Single pass 64-bit key hash.
+ * The low half selects the hash bucket and the high half is the
+ * fingerprint, bloom filters derive all of their probes from it.
+ * With SSE4.2, two crc32c lanes run over the same words (the second one
+ * over rotated words, so the lanes are not affine to each other).
+ */
+
+#define LIGHTFS_HASH_C1 0x87c37b91114253d5ULL
+#define LIGHTFS_HASH_C2 0x4cf5ad432745937fULL
+
+static inline uint64_t lightfs_hash_fmix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static inline uint64_t lightfs_hash_tail(const uint8_t *p, uint32_t len)
+{
+	uint64_t v = 0;
+
+	memcpy(&v, p, len & 7);
+	return v;
+}
+
+#ifdef CONFIG_X86_64
+static inline uint64_t lightfs_hash_crc32c_u64(uint64_t crc, uint64_t v)
+{
+	asm("crc32q %1, %0" : "+r" (crc) : "rm" (v));
+	return crc;
+}
+
+static inline uint64_t lightfs_hash64_crc32c(const void *buf, uint32_t len)
+{
+	const uint8_t *p = buf;
+	uint64_t a = len, b = ~(uint64_t)len;
+	uint64_t v;
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		memcpy(&v, p + i, 8);
+		a = lightfs_hash_crc32c_u64(a, v);
+		b = lightfs_hash_crc32c_u64(b, rol64(v, 32));
+	}
+	if (len & 7) {
+		v = lightfs_hash_tail(p + i, len);
+		a = lightfs_hash_crc32c_u64(a, v);
+		b = lightfs_hash_crc32c_u64(b, rol64(v, 32));
+	}
+
+	return lightfs_hash_fmix64((b << 32) | (uint32_t)a);
+}
+#endif
+
+static inline uint64_t lightfs_hash64_soft(const void *buf, uint32_t len)
+{
+	const uint8_t *p = buf;
+	uint64_t h = len * LIGHTFS_HASH_C2;
+	uint64_t v;
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		memcpy(&v, p + i, 8);
+		h ^= rol64(v * LIGHTFS_HASH_C1, 31) * LIGHTFS_HASH_C2;
+		h = rol64(h, 27) * 5 + 0x52dce729;
+	}
+	if (len & 7) {
+		v = lightfs_hash_tail(p + i, len);
+		h ^= rol64(v * LIGHTFS_HASH_C1, 31) * LIGHTFS_HASH_C2;
+	}
+
+	return lightfs_hash_fmix64(h);
+}
+
+static inline uint64_t lightfs_hash64(const void *buf, uint32_t len)
+{
+#ifdef CONFIG_X86_64
+	if (static_cpu_has(X86_FEATURE_XMM4_2))
+		return lightfs_hash64_crc32c(buf, len);
+#endif
+	return lightfs_hash64_soft(buf, len);
+}
+
+static inline uint32_t lightfs_hash_bucket(uint64_t hash)
+{
+	return (uint32_t)hash;
+}
+
+static inline uint32_t lightfs_hash_fp(uint64_t hash)
+{
+	return (uint32_t)(hash >> 32);
+}
+
+#endif
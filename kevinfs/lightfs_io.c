@@ -3,9 +3,12 @@
 #include <linux/signal.h>
 #include <linux/sched/signal.h>
 #include <linux/completion.h>
+#include <linux/jhash.h>
+#include <linux/vmalloc.h>
 #include "lightfs_io.h"
 #include "lightfs_txn_hdlr.h"
 #include "rbtreekv.h"
+#include "lightfs_reada.h"
 #include "./cheeze/cheeze.h"
 
 static struct kmem_cache *lightfs_io_small_buf_cachep;
@@ -14,9 +17,41 @@ extern int cheeze_init(void);
 extern void cheeze_exit(void);
 static DB_IO *db_io_XXX; 
 
+// one block of a data key: its own record or, under EXTENT, the extent
+// of its group. A page record is always newer than the extent.
+static int rb_io_get_block (DB *db, char *key, uint16_t key_len, char *buf)
+{
+	DBT key_dbt, value;
+	int ret;
+#ifdef EXTENT
+	uint64_t block_num = lightfs_data_key_get_blocknum(key, key_len);
+	uint64_t start = lightfs_extent_start(block_num);
+#endif
+
+	dbt_setup(&key_dbt, key, key_len);
+	dbt_setup(&value, buf, PAGE_SIZE);
+	ret = db_get(db, NULL, &key_dbt, &value, 0);
+#ifdef EXTENT
+	if (ret == DB_NOTFOUND && start != block_num) {
+		lightfs_data_key_set_blocknum(key, key_len, start);
+		ret = db_get_off(db, &key_dbt, &value,
+		                 (block_num - start) << PAGE_SHIFT);
+		lightfs_data_key_set_blocknum(key, key_len, block_num);
+	}
+#endif
+
+	return ret;
+}
+
 int rb_io_get (DB *db, DB_TXN_BUF *txn_buf)
 {
 	DBT key, value;
+
+	if (txn_buf->type == LIGHTFS_DATA_GET) {
+		txn_buf->ret = rb_io_get_block(txn_buf->db, txn_buf->key,
+		                               txn_buf->key_len, txn_buf->buf);
+		return 0;
+	}
 	dbt_setup(&key, txn_buf->key, txn_buf->key_len);
 	dbt_setup(&value, txn_buf->buf+txn_buf->off, txn_buf->len);
 	txn_buf->ret = db_get(txn_buf->db, NULL, &key, &value, 0);
@@ -24,6 +59,14 @@ int rb_io_get (DB *db, DB_TXN_BUF *txn_buf)
 	return 0;
 }
 
+int rb_io_get_async (DB *db, DB_TXN_BUF *txn_buf, struct lightfs_get_async *ga)
+{
+	rb_io_get(db, txn_buf);
+	lightfs_bstore_txn_get_end(ga);
+
+	return 0;
+}
+
 int rb_io_iter (DB *db, DBC *dbc, DB_TXN_BUF *txn_buf)
 {
 	return 0;
@@ -38,6 +81,114 @@ int rb_io_sync_put (DB *db, DB_TXN_BUF *txn_buf)
 	return 0;
 }
 
+static void rb_io_put_page (DB_TXN_BUF *txn_buf)
+{
+	struct page *page = (struct page *)txn_buf->buf;
+	DBT key, value;
+#ifdef COMPRESS
+	char *buf = kmalloc(PAGE_SIZE, GFP_NOIO | __GFP_NOFAIL);
+#endif
+
+#ifdef COMPRESS
+	dbt_setup(&key, txn_buf->key, txn_buf->key_len);
+	dbt_setup(&value, buf, lightfs_comp_page(kmap(page), buf));
+	kunmap(page);
+	db_put(txn_buf->db, NULL, &key, &value, 0);
+	kfree(buf);
+#else
+	dbt_setup(&key, txn_buf->key, txn_buf->key_len);
+	dbt_setup(&value, kmap(page), PAGE_SIZE);
+	db_put(txn_buf->db, NULL, &key, &value, 0);
+	kunmap(page);
+#endif
+	end_page_writeback(page);
+	txn_buf->buf = NULL;
+}
+
+#ifdef EXTENT
+static void rb_io_put_extent (DB_TXN_BUF *txn_buf)
+{
+	struct page **pages = (struct page **)txn_buf->buf;
+	DBT key, value;
+	char *buf;
+	int i;
+
+	buf = kvmalloc(txn_buf->len, GFP_NOIO);
+	BUG_ON(!buf);
+	for (i = 0; i < txn_buf->off; i++) {
+		memcpy(buf + (i << PAGE_SHIFT), kmap(pages[i]), PAGE_SIZE);
+		kunmap(pages[i]);
+		end_page_writeback(pages[i]);
+	}
+	dbt_setup(&key, txn_buf->key, txn_buf->key_len);
+	dbt_setup(&value, buf, txn_buf->len);
+	db_put(txn_buf->db, NULL, &key, &value, 0);
+	kvfree(buf);
+	kfree(pages);
+	txn_buf->buf = NULL;
+}
+#endif
+
+#ifdef EXTENT
+// the pages of the extent of tail's group from tail on become page
+// records, so cutting or deleting the extent keeps them. A page record
+// already there is newer and stays.
+static void rb_io_split_extent (DB *db, char *data_key, uint16_t key_len,
+                                uint64_t tail)
+{
+	uint64_t start = lightfs_extent_start(tail);
+	DBT key, value, probe;
+	char *buf;
+
+	if (start == tail)
+		return;
+	buf = kmalloc(PAGE_SIZE, GFP_NOIO | __GFP_NOFAIL);
+	dbt_setup(&key, data_key, key_len);
+	dbt_setup(&value, buf, PAGE_SIZE);
+	dbt_setup(&probe, buf, 0);
+	for (; tail < start + LIGHTFS_EXTENT_PAGES; tail++) {
+		lightfs_data_key_set_blocknum(data_key, key_len, tail);
+		if (db_get(db, NULL, &key, &probe, 0) != DB_NOTFOUND)
+			continue;
+		lightfs_data_key_set_blocknum(data_key, key_len, start);
+		if (db_get_off(db, &key, &value, (tail - start) << PAGE_SHIFT) == DB_NOTFOUND)
+			break; // past the end of the extent
+		lightfs_data_key_set_blocknum(data_key, key_len, tail);
+		db_put(db, NULL, &key, &value, 0);
+	}
+	kfree(buf);
+}
+#endif
+
+// delete off blocks from the key on. An extent reaching into the range
+// is split: its head stays an extent cut where the range starts, its
+// tail past the range is kept as page records.
+static void rb_io_del_multi (DB_TXN_BUF *txn_buf)
+{
+	char *data_key = txn_buf->key;
+	uint16_t key_len = txn_buf->key_len;
+	uint64_t block_num = lightfs_data_key_get_blocknum(data_key, key_len);
+	DBT key;
+	int i;
+#ifdef EXTENT
+	uint64_t start = lightfs_extent_start(block_num);
+#endif
+
+	dbt_setup(&key, data_key, key_len);
+#ifdef EXTENT
+	rb_io_split_extent(txn_buf->db, data_key, key_len, block_num + txn_buf->off);
+	if (start != block_num) {
+		lightfs_data_key_set_blocknum(data_key, key_len, start);
+		db_trunc(txn_buf->db, &key, (block_num - start) << PAGE_SHIFT);
+	}
+#endif
+	for (i = 0; i < txn_buf->off; i++) {
+		lightfs_data_key_set_blocknum(data_key, key_len, block_num + i);
+		db_del(txn_buf->db, NULL, &key, 0);
+	}
+	lightfs_data_key_set_blocknum(data_key, key_len, block_num);
+}
+
 int rb_io_transfer (DB *db, DB_C_TXN *c_txn, void *(*cb)(void *data), void *extra)
 {
 	DBT key, value;
@@ -54,9 +205,21 @@ int rb_io_transfer (DB *db, DB_C_TXN *c_txn, void *(*cb)(void *data), void *extr
 				case LIGHTFS_DATA_SEQ_SET:
 					db_put(txn_buf->db, NULL, &key, &value, 0);
 					break;
+				case LIGHTFS_DATA_SET_WB:
+					rb_io_put_page(txn_buf);
+					break;
+#ifdef EXTENT
+				case LIGHTFS_DATA_EXT_WB:
+					rb_io_put_extent(txn_buf);
+					break;
+#endif
 				case LIGHTFS_META_DEL:
 				case LIGHTFS_DATA_DEL:
 					db_del(txn_buf->db, NULL, &key, 0);
+					if (txn_buf->buf) { // zero page
+						end_page_writeback((struct page *)txn_buf->buf);
+						txn_buf->buf = NULL;
+					}
 					break;
 				case LIGHTFS_META_UPDATE:
 				case LIGHTFS_DATA_UPDATE:
@@ -65,6 +228,7 @@ int rb_io_transfer (DB *db, DB_C_TXN *c_txn, void *(*cb)(void *data), void *extr
 					break;
 				case LIGHTFS_DATA_DEL_MULTI:
 					// offset = key_cnt;
+					rb_io_del_multi(txn_buf);
 					break;
 				default:
 					break;
@@ -82,18 +246,22 @@ int rb_io_commit (DB_TXN_BUF *txn_buf)
 
 int rb_io_get_multi (DB *db, DB_TXN_BUF *txn_buf)
 {
-	DBT key, value;
 	int i;
 	char *meta_key = txn_buf->key;
 	uint64_t block_num = lightfs_data_key_get_blocknum(meta_key, txn_buf->key_len);
 
-	dbt_setup(&key, txn_buf->key, txn_buf->key_len);
 	for (i = 0; i < txn_buf->len; i++) {
-		lightfs_data_key_set_blocknum(meta_key, key.size, block_num++);
-		dbt_setup(&value, txn_buf->buf + (i * PAGE_SIZE), PAGE_SIZE);
-		txn_buf->ret = db_get(txn_buf->db, NULL, &key, &value, 0);
+		lightfs_data_key_set_blocknum(meta_key, txn_buf->key_len, block_num++);
+		txn_buf->ret = rb_io_get_block(txn_buf->db, meta_key,
+		                               txn_buf->key_len,
+		                               txn_buf->buf + (i * PAGE_SIZE));
 		if (txn_buf->ret == DB_NOTFOUND) {
-			memset(value.data, 0, PAGE_SIZE);
+			memset(txn_buf->buf + (i * PAGE_SIZE), 0, PAGE_SIZE);
+#ifdef COMPRESS
+		} else {
+			// rb_io_put_page stored it compressed, callers expect pages
+			lightfs_decomp_page(txn_buf->buf + (i * PAGE_SIZE));
+#endif
 		}
 	}
 	txn_buf->ret = 0;
@@ -101,22 +269,460 @@ int rb_io_get_multi (DB *db, DB_TXN_BUF *txn_buf)
 	return 0;
 }
 
+#ifdef GET_COALESCE
+static void lightfs_inflight_exit (void);
+#endif
+
 int rb_io_close (DB_IO *db_io)
 {
+#ifdef GET_COALESCE
+	lightfs_inflight_exit();
+#endif
+#ifdef COMPRESS
+	lightfs_comp_exit();
+#endif
 	kfree(db_io);
 	kmem_cache_destroy(lightfs_io_small_buf_cachep);
 
 	return 0;
 }
 
+#ifdef NULL_IO
+/*
+ * null backend: puts, transfers and commits are acked as soon as they
+ * are issued and nothing is stored but the meta records that fit a small
+ * direct-mapped table, so mount and lookups still resolve. Data reads see
+ * zeroes. What it measures is the fs above the io layer on its own.
+ */
+#define NULL_IO_SLOTS 1024
+#define NULL_IO_KEY_MAX 64
+#define NULL_IO_VAL_MAX 256
+
+struct null_io_slot {
+	spinlock_t lock;
+	uint16_t key_len;
+	uint16_t val_len;
+	char key[NULL_IO_KEY_MAX];
+	char val[NULL_IO_VAL_MAX];
+};
+
+static struct null_io_slot *null_io_slots;
+static char *null_io_zero; // answers every multi-page read
+
+int lightfs_io_close (DB_IO *db_io);
+
+static struct null_io_slot *null_io_slot (char *key, uint16_t key_len)
+{
+	return &null_io_slots[jhash(key, key_len, 0) & (NULL_IO_SLOTS - 1)];
+}
+
+static inline bool null_io_slot_match (struct null_io_slot *slot, char *key, uint16_t key_len)
+{
+	return slot->key_len == key_len && !memcmp(slot->key, key, key_len);
+}
+
+// values are kept up to NULL_IO_VAL_MAX bytes, which holds a metadata
+static void null_io_put (DB_TXN_BUF *txn_buf, char *val, uint32_t off, uint32_t len, bool update)
+{
+	struct null_io_slot *slot;
+
+	if (txn_buf->key_len > NULL_IO_KEY_MAX || off >= NULL_IO_VAL_MAX)
+		return;
+	len = min_t(uint32_t, len, NULL_IO_VAL_MAX - off);
+	slot = null_io_slot(txn_buf->key, txn_buf->key_len);
+	spin_lock(&slot->lock);
+	if (!update || !null_io_slot_match(slot, txn_buf->key, txn_buf->key_len)) {
+		// a colliding key is simply evicted
+		memset(slot->val, 0, NULL_IO_VAL_MAX);
+		memcpy(slot->key, txn_buf->key, txn_buf->key_len);
+		slot->key_len = txn_buf->key_len;
+		slot->val_len = update ? NULL_IO_VAL_MAX : len;
+	}
+	memcpy(slot->val + off, val + off, len);
+	spin_unlock(&slot->lock);
+}
+
+static void null_io_del (DB_TXN_BUF *txn_buf)
+{
+	struct null_io_slot *slot;
+
+	if (txn_buf->key_len > NULL_IO_KEY_MAX)
+		return;
+	slot = null_io_slot(txn_buf->key, txn_buf->key_len);
+	spin_lock(&slot->lock);
+	if (null_io_slot_match(slot, txn_buf->key, txn_buf->key_len))
+		slot->key_len = 0;
+	spin_unlock(&slot->lock);
+}
+
+int null_io_get (DB *db, DB_TXN_BUF *txn_buf)
+{
+	struct null_io_slot *slot;
+
+#ifdef MONITOR
+	atomic64_inc(&db_io_XXX->mon.ops_num[txn_buf->type]);
+#endif
+	txn_buf->ret = DB_NOTFOUND;
+	if (txn_buf->type == LIGHTFS_DATA_GET || txn_buf->key_len > NULL_IO_KEY_MAX)
+		return 0;
+	slot = null_io_slot(txn_buf->key, txn_buf->key_len);
+	spin_lock(&slot->lock);
+	if (null_io_slot_match(slot, txn_buf->key, txn_buf->key_len)) {
+		memcpy(txn_buf->buf + txn_buf->off, slot->val,
+		       min_t(uint32_t, txn_buf->len, NULL_IO_VAL_MAX));
+		txn_buf->ret = slot->val_len;
+	}
+	spin_unlock(&slot->lock);
+
+	return 0;
+}
+
+int null_io_get_async (DB *db, DB_TXN_BUF *txn_buf, struct lightfs_get_async *ga)
+{
+	null_io_get(db, txn_buf);
+	lightfs_bstore_txn_get_end(ga);
+
+	return 0;
+}
+
+int null_io_iter (DB *db, DBC *dbc, DB_TXN_BUF *txn_buf)
+{
+#ifdef MONITOR
+	atomic64_inc(&db_io_XXX->mon.ops_num[txn_buf->type]);
+#endif
+	txn_buf->ret = DB_NOTFOUND;
+
+	return -1; // no buffer to free
+}
+
+int null_io_sync_put (DB *db, DB_TXN_BUF *txn_buf)
+{
+#ifdef MONITOR
+	atomic64_inc(&db_io_XXX->mon.ops_num[txn_buf->type]);
+#endif
+	null_io_put(txn_buf, txn_buf->buf + txn_buf->off, 0, txn_buf->len, false);
+	txn_buf->ret = 0;
+
+	return 0;
+}
+
+int null_io_transfer (DB *db, DB_C_TXN *c_txn, void *(*cb)(void *data), void *extra)
+{
+	DB_TXN_BUF *txn_buf;
+	DB_TXN *txn;
+#ifdef EXTENT
+	struct page **pages;
+	int i;
+#endif
+
+#ifdef MONITOR
+	atomic64_inc(&db_io_XXX->mon.ops_num[LIGHTFS_TXN_TRANSFER]);
+#endif
+	list_for_each_entry(txn, &c_txn->txn_list, txn_list) {
+		list_for_each_entry(txn_buf, &txn->txn_buf_list, txn_buf_list) {
+#ifdef MONITOR
+			atomic64_inc(&db_io_XXX->mon.ops_num[txn_buf->type]);
+#endif
+			switch (txn_buf->type) {
+				case LIGHTFS_META_SET:
+					null_io_put(txn_buf, txn_buf->buf, 0, txn_buf->len, false);
+					break;
+				case LIGHTFS_META_UPDATE:
+					null_io_put(txn_buf, txn_buf->buf, txn_buf->off, txn_buf->update, true);
+					break;
+				case LIGHTFS_META_DEL:
+					null_io_del(txn_buf);
+					break;
+				case LIGHTFS_DATA_SET_WB:
+					end_page_writeback((struct page *)txn_buf->buf);
+					txn_buf->buf = NULL;
+					break;
+				case LIGHTFS_DATA_DEL:
+					if (txn_buf->buf) { // zero page
+						end_page_writeback((struct page *)txn_buf->buf);
+						txn_buf->buf = NULL;
+					}
+					break;
+#ifdef EXTENT
+				case LIGHTFS_DATA_EXT_WB:
+					pages = (struct page **)txn_buf->buf;
+					for (i = 0; i < txn_buf->off; i++)
+						end_page_writeback(pages[i]);
+					kfree(pages);
+					txn_buf->buf = NULL;
+					break;
+#endif
+				default:
+					break;
+			}
+		}
+	}
+	if (c_txn->state & TXN_FLUSH || c_txn->state & TXN_ORDERED) {
+#ifdef MONITOR
+		atomic64_inc(&db_io_XXX->mon.ops_num[LIGHTFS_COMMIT]);
+#endif
+	}
+	cb(extra);
+
+	return 0;
+}
+
+int null_io_commit (DB_TXN_BUF *txn_buf)
+{
+#ifdef MONITOR
+	atomic64_inc(&db_io_XXX->mon.ops_num[txn_buf->type]);
+#endif
+	return 0;
+}
+
+int null_io_get_multi (DB *db, DB_TXN_BUF *txn_buf)
+{
+#ifdef MONITOR
+	atomic64_add(txn_buf->len, &db_io_XXX->mon.ops_num[LIGHTFS_GET_MULTI_REAL]);
+	atomic64_inc(&db_io_XXX->mon.ops_num[txn_buf->type]);
+#endif
+	BUG_ON(txn_buf->len > CHEEZE_BUF_SIZE / PAGE_SIZE);
+	txn_buf->buf = null_io_zero;
+	txn_buf->ret = 0;
+
+	return 0;
+}
+
+int null_io_get_multi_reada (DB *db, DB_TXN_BUF *txn_buf, void *extra)
+{
+	struct reada_entry *ra_entry = (struct reada_entry *)extra;
+
+#ifdef MONITOR
+	atomic64_add(txn_buf->len, &db_io_XXX->mon.ops_num[LIGHTFS_GET_MULTI_READA_REAL]);
+	atomic64_inc(&db_io_XXX->mon.ops_num[txn_buf->type]);
+#endif
+	BUG_ON(txn_buf->len > CHEEZE_BUF_SIZE / PAGE_SIZE);
+	txn_buf->buf = null_io_zero;
+	txn_buf->ret = 0;
+	ra_entry->tag = -1;
+	ra_entry->buf = null_io_zero;
+	ra_entry->ubuf_len = txn_buf->len * PAGE_SIZE;
+	lightfs_reada_end(ra_entry);
+
+	return 0;
+}
+
+int null_io_close (DB_IO *db_io)
+{
+	lightfs_io_close(db_io);
+	vfree(null_io_slots);
+	vfree(null_io_zero);
+
+	return 0;
+}
+
+static int null_io_init (void)
+{
+	int i;
+
+	BUILD_BUG_ON(sizeof(struct lightfs_metadata) > NULL_IO_VAL_MAX);
+	null_io_slots = vzalloc(NULL_IO_SLOTS * sizeof(struct null_io_slot));
+	null_io_zero = vzalloc(CHEEZE_BUF_SIZE);
+	if (!null_io_slots || !null_io_zero) {
+		vfree(null_io_slots);
+		vfree(null_io_zero);
+		return -ENOMEM;
+	}
+	for (i = 0; i < NULL_IO_SLOTS; i++)
+		spin_lock_init(&null_io_slots[i].lock);
+
+	return 0;
+}
+#endif
+
+#ifdef GET_COALESCE
+/*
+ * Identical gets in flight share one device request. The first one (the
+ * leader) is hashed by (type, key, len) until its reply is in; later ones
+ * wait for it and read the reply from the leader's cheeze buffer, whose
+ * tag is freed by the last of them to let go of it. A get joins only a
+ * leader issued after the last txn it must see was committed, a write
+ * committed since the leader left may not be in its reply.
+ */
+#define LIGHTFS_INFLIGHT_BUCKETS 256
+
+struct lightfs_inflight {
+	struct hlist_node hnode;
+	enum lightfs_req_type type;
+	char *key; // the leader's, valid while hashed
+	uint16_t key_len;
+	uint32_t len;
+	TXNID_T txn_id; // last committed txn when the leader was issued
+	atomic_t ref;
+	struct completion done;
+	int ret; // ubuf_len of the reply, 0 if not found
+	int tag;
+	char *buf;
+};
+
+struct lightfs_inflight_bucket {
+	spinlock_t lock;
+	struct hlist_head head;
+};
+
+static struct kmem_cache *lightfs_inflight_cachep;
+static struct lightfs_inflight_bucket *lightfs_inflight_buckets;
+// users of a tag's buffer past the first, 0 if it is not shared
+static atomic_t *lightfs_tag_ref;
+static atomic64_t lightfs_coalesced_get, lightfs_coalesced_get_multi;
+
+static struct lightfs_inflight_bucket *lightfs_inflight_bucket (enum lightfs_req_type type, char *key, uint16_t key_len, uint32_t len)
+{
+	uint32_t hash = jhash(key, key_len, ((uint32_t)type << 24) ^ len);
+
+	return &lightfs_inflight_buckets[hash & (LIGHTFS_INFLIGHT_BUCKETS - 1)];
+}
+
+/*
+ * The request txn_buf joins with a reference taken, *leader tells whether
+ * it is a new one the caller must send. NULL if there is no memory, the
+ * caller then sends its own request unshared.
+ */
+static struct lightfs_inflight *lightfs_inflight_begin (DB_TXN_BUF *txn_buf, bool *leader)
+{
+	struct lightfs_inflight_bucket *b;
+	struct lightfs_inflight *e, *new;
+	TXNID_T txn_id = lightfs_bstore_txn_last_id();
+
+	*leader = true;
+	b = lightfs_inflight_bucket(txn_buf->type, txn_buf->key, txn_buf->key_len, txn_buf->len);
+	spin_lock(&b->lock);
+	hlist_for_each_entry(e, &b->head, hnode) {
+		if (e->type == txn_buf->type && e->len == txn_buf->len &&
+		    e->key_len == txn_buf->key_len &&
+		    !txn_id_before(e->txn_id, txn_id) &&
+		    !memcmp(e->key, txn_buf->key, e->key_len)) {
+			atomic_inc(&e->ref);
+			spin_unlock(&b->lock);
+			*leader = false;
+			return e;
+		}
+	}
+	spin_unlock(&b->lock);
+
+	// a leader hashed meanwhile only costs a second request
+	new = kmem_cache_alloc(lightfs_inflight_cachep, GFP_NOIO);
+	if (!new)
+		return NULL;
+	new->type = txn_buf->type;
+	new->key = txn_buf->key;
+	new->key_len = txn_buf->key_len;
+	new->len = txn_buf->len;
+	new->txn_id = txn_id;
+	atomic_set(&new->ref, 1);
+	init_completion(&new->done);
+	spin_lock(&b->lock);
+	hlist_add_head(&new->hnode, &b->head);
+	spin_unlock(&b->lock);
+
+	return new;
+}
+
+// by the leader once the reply is in buf, before it uses the reply
+static void lightfs_inflight_done (struct lightfs_inflight *e, int ret, int tag, char *buf)
+{
+	struct lightfs_inflight_bucket *b;
+
+	b = lightfs_inflight_bucket(e->type, e->key, e->key_len, e->len);
+	spin_lock(&b->lock);
+	hlist_del(&e->hnode);
+	spin_unlock(&b->lock);
+	// no one joins any more, ref is the number of users of the reply
+	if (ret && atomic_read(&e->ref) > 1)
+		atomic_set(&lightfs_tag_ref[tag], atomic_read(&e->ref));
+	e->key = NULL;
+	e->ret = ret;
+	e->tag = tag;
+	e->buf = buf;
+	complete_all(&e->done);
+}
+
+static void lightfs_inflight_put (struct lightfs_inflight *e)
+{
+	if (atomic_dec_and_test(&e->ref))
+		kmem_cache_free(lightfs_inflight_cachep, e);
+}
+
+static int lightfs_inflight_init (void)
+{
+	int i;
+
+	lightfs_inflight_cachep = kmem_cache_create("lightfs_inflight",
+	                          sizeof(struct lightfs_inflight), 0, 0, NULL);
+	lightfs_inflight_buckets = kmalloc(LIGHTFS_INFLIGHT_BUCKETS * sizeof(struct lightfs_inflight_bucket), GFP_KERNEL);
+	lightfs_tag_ref = kcalloc(CHEEZE_QUEUE_SIZE, sizeof(atomic_t), GFP_KERNEL);
+	if (!lightfs_inflight_cachep || !lightfs_inflight_buckets || !lightfs_tag_ref) {
+		kfree(lightfs_tag_ref);
+		kfree(lightfs_inflight_buckets);
+		if (lightfs_inflight_cachep)
+			kmem_cache_destroy(lightfs_inflight_cachep);
+		return -ENOMEM;
+	}
+	for (i = 0; i < LIGHTFS_INFLIGHT_BUCKETS; i++) {
+		spin_lock_init(&lightfs_inflight_buckets[i].lock);
+		INIT_HLIST_HEAD(&lightfs_inflight_buckets[i].head);
+	}
+	atomic64_set(&lightfs_coalesced_get, 0);
+	atomic64_set(&lightfs_coalesced_get_multi, 0);
+
+	return 0;
+}
+
+static void lightfs_inflight_exit (void)
+{
+	pr_info("LIGHTFS COALESCE SUMMARY: get %lld, get_multi %lld\n",
+	        atomic64_read(&lightfs_coalesced_get),
+	        atomic64_read(&lightfs_coalesced_get_multi));
+	kfree(lightfs_tag_ref);
+	kfree(lightfs_inflight_buckets);
+	kmem_cache_destroy(lightfs_inflight_cachep);
+}
+#endif
+
+// give back the buffer a get, get_multi, iter or readahead was answered in
+void lightfs_io_free_buf (int tag)
+{
+#ifdef GET_COALESCE
+	if (atomic_read(&lightfs_tag_ref[tag]) && !atomic_dec_and_test(&lightfs_tag_ref[tag]))
+		return;
+#endif
+#ifndef NULL_IO
+	cheeze_free_io(tag);
+#endif
+}
+
 int lightfs_io_get (DB *db, DB_TXN_BUF *txn_buf)
 {
 	int buf_idx = 0;
 	char *buf;
 	uint64_t io_seq;
 	struct cheeze_req_user req;
+#ifdef GET_COALESCE
+	struct lightfs_inflight *e;
+	bool leader;
+
+	e = lightfs_inflight_begin(txn_buf, &leader);
+	if (!leader) {
+		atomic64_inc(&lightfs_coalesced_get);
+		wait_for_completion(&e->done);
+		if (e->ret == 0) {
+			txn_buf->ret = DB_NOTFOUND;
+		} else {
+			txn_buf->ret = e->ret;
+			memcpy(txn_buf->buf, e->buf, e->ret);
+			lightfs_io_free_buf(e->tag);
+		}
+		lightfs_inflight_put(e);
+		return 0;
+	}
+#endif
 
-	io_seq = cheeze_prepare_io(&req, 1, NULL, false);
+	io_seq = cheeze_prepare_io(&req, 1, NULL, false, CHEEZE_LANE_SYNC);
 	buf = req.buf;
 
 #ifdef TIME_CHECK
@@ -135,6 +741,12 @@ int lightfs_io_get (DB *db, DB_TXN_BUF *txn_buf)
 	//lightfs_error(__func__, "buf: %p, len: %d\n", txn_buf->buf, txn_buf->len);
 	lightfs_io_set_cheeze_req(&req, buf_idx, buf, txn_buf->buf, txn_buf->len);
 	cheeze_io(&req, NULL, NULL, io_seq);
+#ifdef GET_COALESCE
+	if (e) {
+		lightfs_inflight_done(e, req.ubuf_len, req.id, buf);
+		lightfs_inflight_put(e);
+	}
+#endif
 
 	if (req.ubuf_len == 0) {
 		txn_buf->ret = DB_NOTFOUND;
@@ -150,7 +762,70 @@ int lightfs_io_get (DB *db, DB_TXN_BUF *txn_buf)
 #ifdef CHEEZE
 	return rb_io_get(db, txn_buf);
 #endif
-	cheeze_free_io(req.id);
+	lightfs_io_free_buf(req.id);
+	return 0;
+}
+
+// an async get in flight, lives until its completion
+struct lightfs_io_async {
+	struct cheeze_req_user req;
+	char *buf;
+	DB_TXN_BUF *txn_buf;
+	struct lightfs_get_async *ga;
+};
+
+static void lightfs_io_get_async_end (void *extra)
+{
+	struct lightfs_io_async *io = extra;
+	DB_TXN_BUF *txn_buf = io->txn_buf;
+
+	if (io->req.ubuf_len == 0) {
+		txn_buf->ret = DB_NOTFOUND;
+	} else {
+		txn_buf->ret = io->req.ubuf_len;
+		memcpy(txn_buf->buf, io->buf, io->req.ubuf_len);
+	}
+#ifdef TIME_CHECK
+	lightfs_get_time(&txn_buf->complete);
+#endif
+	cheeze_free_io(io->req.id);
+	lightfs_bstore_txn_get_end(io->ga);
+	kfree(io);
+}
+
+int lightfs_io_get_async (DB *db, DB_TXN_BUF *txn_buf, struct lightfs_get_async *ga)
+{
+	int buf_idx = 0;
+	char *buf;
+	uint64_t io_seq;
+	struct lightfs_io_async *io;
+
+#ifdef CHEEZE
+	lightfs_io_get(db, txn_buf);
+	lightfs_bstore_txn_get_end(ga);
+	return 0;
+#endif
+	io = kmalloc(sizeof(struct lightfs_io_async), GFP_NOIO | __GFP_NOFAIL);
+	io->txn_buf = txn_buf;
+	io->ga = ga;
+	io_seq = cheeze_prepare_io(&io->req, 0, NULL, false, CHEEZE_LANE_SYNC);
+	buf = io->buf = io->req.buf;
+
+#ifdef TIME_CHECK
+	lightfs_get_time(&txn_buf->transfer);
+#endif
+
+#ifdef MONITOR
+	atomic64_inc(&db_io_XXX->mon.ops_num[txn_buf->type]);
+#endif
+
+	buf_idx = lightfs_io_set_txn_id(buf, txn_buf->txn_id, buf_idx);
+	buf_idx = lightfs_io_set_cnt(buf + buf_idx, 1, buf_idx);
+	buf_idx = lightfs_io_set_buf_get(buf, txn_buf->type, txn_buf->key_len, txn_buf->key, txn_buf->len, buf_idx);
+
+	lightfs_io_set_cheeze_req(&io->req, buf_idx, buf, txn_buf->buf, txn_buf->len);
+	cheeze_io_async(&io->req, lightfs_io_get_async_end, io, io_seq);
+
 	return 0;
 }
 
@@ -161,7 +836,7 @@ int lightfs_io_sync_put (DB *db, DB_TXN_BUF *txn_buf)
 	uint64_t io_seq;
 	struct cheeze_req_user req;
 
-	io_seq = cheeze_prepare_io(&req, 1, NULL, false);
+	io_seq = cheeze_prepare_io(&req, 1, NULL, false, CHEEZE_LANE_BULK);
 	buf = req.buf;
 
 #ifdef TIME_CHECK
@@ -198,7 +873,7 @@ int lightfs_io_iter (DB *db, DBC *dbc, DB_TXN_BUF *txn_buf)
 	struct cheeze_req_user req;
 	int ret;
 
-	io_seq = cheeze_prepare_io(&req, 1, NULL, false);
+	io_seq = cheeze_prepare_io(&req, 1, NULL, false, CHEEZE_LANE_SYNC);
 	buf = req.buf;
 	txn_buf->buf = buf;
 #ifdef TIME_CHECK
@@ -232,6 +907,32 @@ int lightfs_io_iter (DB *db, DBC *dbc, DB_TXN_BUF *txn_buf)
 	return ret;
 }
 
+#ifdef EXTENT
+// an extent goes out as DATA_SEQ_SET, off is the count of pages and the
+// value holds all of them. Like SET_WB, writeback ends once copied.
+static int lightfs_io_set_buf_ext_wb(char *buf, DB_TXN_BUF *txn_buf, int idx)
+{
+	struct page **pages = (struct page **)txn_buf->buf;
+	int i;
+
+	idx = lightfs_io_set_type(buf + idx, LIGHTFS_DATA_SEQ_SET, idx);
+	idx = lightfs_io_set_key_len(buf + idx, txn_buf->key_len, idx);
+	idx = lightfs_io_set_key(buf + idx, txn_buf->key_len, txn_buf->key, idx);
+	idx = lightfs_io_set_off(buf + idx, txn_buf->off, idx);
+	idx = lightfs_io_set_value_len(buf + idx, PAGE_SIZE, idx);
+	for (i = 0; i < txn_buf->off; i++) {
+		idx = lightfs_io_set_value(buf + idx, PAGE_SIZE, kmap(pages[i]), idx);
+		flush_dcache_page(pages[i]);
+		kunmap(pages[i]);
+		end_page_writeback(pages[i]);
+	}
+	kfree(pages);
+	txn_buf->buf = NULL;
+
+	return idx;
+}
+#endif
+
 int lightfs_io_transfer (DB *db, DB_C_TXN *c_txn, void *(*cb)(void *data), void *extra)
 {
 	DB_TXN_BUF *txn_buf;
@@ -251,9 +952,9 @@ int lightfs_io_transfer (DB *db, DB_C_TXN *c_txn, void *(*cb)(void *data), void
 
 
 	if (c_txn->state & TXN_FLUSH || c_txn->state & TXN_ORDERED) {
-		io_seq = cheeze_prepare_io(&req, 1, NULL, true);
+		io_seq = cheeze_prepare_io(&req, 1, NULL, true, CHEEZE_LANE_BULK);
 	} else {
-		io_seq = cheeze_prepare_io(&req, 0, NULL, true);
+		io_seq = cheeze_prepare_io(&req, 0, NULL, true, CHEEZE_LANE_BULK);
 	}
 	buf = req.buf;
 
@@ -282,7 +983,11 @@ int lightfs_io_transfer (DB *db, DB_C_TXN *c_txn, void *(*cb)(void *data), void
 					page = (struct page *)(txn_buf->buf);
 					//lock_page(page);
 					page_buf = kmap(page);
+#ifdef COMPRESS
+					buf_idx = lightfs_io_set_buf_set_page(buf, txn_buf->key_len, txn_buf->key, page_buf, buf_idx);
+#else
 					buf_idx = lightfs_io_set_buf_set(buf, LIGHTFS_DATA_SET, txn_buf->key_len, txn_buf->key, txn_buf->off, txn_buf->len, page_buf, buf_idx);
+#endif
 					flush_dcache_page(page);
 					kunmap(page_buf);
 					end_page_writeback(page);
@@ -290,9 +995,19 @@ int lightfs_io_transfer (DB *db, DB_C_TXN *c_txn, void *(*cb)(void *data), void
 					txn_buf->buf = NULL;
 					cnt++;
 					break;
+#ifdef EXTENT
+				case LIGHTFS_DATA_EXT_WB:
+					buf_idx = lightfs_io_set_buf_ext_wb(buf, txn_buf, buf_idx);
+					cnt++;
+					break;
+#endif
 				case LIGHTFS_META_DEL:
 				case LIGHTFS_DATA_DEL:
 					buf_idx = lightfs_io_set_buf_del(buf, txn_buf->type, txn_buf->key_len, txn_buf->key, buf_idx);
+					if (txn_buf->buf) { // zero page
+						end_page_writeback((struct page *)txn_buf->buf);
+						txn_buf->buf = NULL;
+					}
 					cnt++;
 					d_cnt++;
 					break;
@@ -355,7 +1070,7 @@ int lightfs_io_commit (DB_TXN_BUF *txn_buf)
 	uint64_t io_seq;
 	struct cheeze_req_user req;
 
-	io_seq = cheeze_prepare_io(&req, 1, NULL, false);
+	io_seq = cheeze_prepare_io(&req, 1, NULL, false, CHEEZE_LANE_BULK);
 	buf = req.buf;
 
 #ifdef TIME_CHECK
@@ -384,11 +1099,32 @@ int lightfs_io_commit (DB_TXN_BUF *txn_buf)
 int lightfs_io_get_multi (DB *db, DB_TXN_BUF *txn_buf)
 {
 	int buf_idx = 0;
+#ifdef COMPRESS
+	int i;
+#endif
 	struct cheeze_req_user req;
 	char *buf;
 	uint64_t io_seq;
+#ifdef GET_COALESCE
+	struct lightfs_inflight *e;
+	bool leader;
+
+	e = lightfs_inflight_begin(txn_buf, &leader);
+	if (!leader) {
+		atomic64_inc(&lightfs_coalesced_get_multi);
+		wait_for_completion(&e->done);
+		if (e->ret == 0) {
+			txn_buf->ret = DB_NOTFOUND;
+		} else {
+			txn_buf->buf = e->buf;
+			txn_buf->ret = e->tag;
+		}
+		lightfs_inflight_put(e);
+		return 0;
+	}
+#endif
 
-	io_seq = cheeze_prepare_io(&req, 1, NULL, false);
+	io_seq = cheeze_prepare_io(&req, 1, NULL, false, CHEEZE_LANE_SYNC);
 	buf = req.buf;
 
 #ifdef TIME_CHECK
@@ -408,10 +1144,21 @@ int lightfs_io_get_multi (DB *db, DB_TXN_BUF *txn_buf)
 
 	lightfs_io_set_cheeze_req(&req, buf_idx, buf, txn_buf->buf, 0);
 	cheeze_io(&req, NULL, NULL, io_seq);
+#ifdef COMPRESS
+	// in place, once, before the buffer may be shared with joiners
+	for (i = 0; req.ubuf_len && i < txn_buf->len; i++)
+		lightfs_decomp_page(buf + i * PAGE_SIZE);
+#endif
+#ifdef GET_COALESCE
+	if (e) {
+		lightfs_inflight_done(e, req.ubuf_len, req.id, buf);
+		lightfs_inflight_put(e);
+	}
+#endif
 
 	if (req.ubuf_len == 0) {
 		txn_buf->ret = DB_NOTFOUND;
-		cheeze_free_io(req.id);
+		lightfs_io_free_buf(req.id);
 	} else {
 		txn_buf->ret = req.id;
 	}
@@ -426,16 +1173,37 @@ int lightfs_io_get_multi (DB *db, DB_TXN_BUF *txn_buf)
 	return 0;
 }
 
+// a readahead window in flight, lives until its completion
+struct lightfs_io_reada {
+	struct cheeze_req_user req;
+	struct reada_entry *ra_entry;
+};
+
+static void lightfs_io_get_multi_reada_end (void *extra)
+{
+	struct lightfs_io_reada *io = extra;
+	struct reada_entry *ra_entry = io->ra_entry;
+
+	// the tag is freed once the window is filled
+	ra_entry->ubuf_len = io->req.ubuf_len;
+	kfree(io);
+	lightfs_reada_end(ra_entry);
+}
+
 int lightfs_io_get_multi_reada (DB *db, DB_TXN_BUF *txn_buf, void *extra)
 {
 	int buf_idx = 0;
-	struct cheeze_req_user req;
 	char *buf;
 	uint64_t io_seq;
 	struct reada_entry *ra_entry = (struct reada_entry *)extra;
+	struct lightfs_io_reada *io;
 
-	io_seq = cheeze_prepare_io(&req, 0, extra, false);
-	buf = req.buf;
+	BUG_ON(txn_buf->len > CHEEZE_BUF_SIZE / PAGE_SIZE);
+	io = kmalloc(sizeof(struct lightfs_io_reada), GFP_NOIO | __GFP_NOFAIL);
+	io->ra_entry = ra_entry;
+	// speculative, it must not hold back writes as a waited-for read does
+	io_seq = cheeze_prepare_io(&io->req, 0, NULL, false, CHEEZE_LANE_BULK);
+	buf = io->req.buf;
 
 #ifdef TIME_CHECK
 	lightfs_get_time(&txn_buf->transfer);
@@ -453,19 +1221,12 @@ int lightfs_io_get_multi_reada (DB *db, DB_TXN_BUF *txn_buf, void *extra)
 	txn_buf->buf = buf;
 	txn_buf->ret = 0;
 
-	ra_entry->tag = req.id;
+	ra_entry->tag = io->req.id;
 	ra_entry->buf = buf;
 
-	lightfs_io_set_cheeze_req(&req, buf_idx, buf, buf, 0);
-	cheeze_io(&req, NULL, NULL, io_seq);
-
-#ifdef TIME_CHECK
-	lightfs_get_time(&txn_buf->complete);
-#endif
+	lightfs_io_set_cheeze_req(&io->req, buf_idx, buf, buf, 0);
+	cheeze_io_async(&io->req, lightfs_io_get_multi_reada_end, io, io_seq);
 
-#ifdef CHEEZE
-	return rb_io_get_multi(db, txn_buf);
-#endif
 	return 0;
 }
 
@@ -500,7 +1261,16 @@ int lightfs_io_close (DB_IO *db_io)
 	cmds.name[LIGHTFS_GET_MULTI_READA_REAL] = "LIGHTFS_GET_MULTI_READA_REAL";
 	cmds.name[LIGHTFS_DEL_MULTI_REAL] = "LIGHTFS_DEL_MULTI_REAL";
 	cmds.name[LIGHTFS_TXN_TRANSFER] = "LIGHTFS_TXN_TRANSFER";
+	cmds.name[LIGHTFS_DATA_EXT_WB] = "LIGHTFS_DATA_EXT_WB";
+#ifndef NULL_IO
 	cheeze_exit();
+#endif
+#ifdef GET_COALESCE
+	lightfs_inflight_exit();
+#endif
+#ifdef COMPRESS
+	lightfs_comp_exit();
+#endif
 
 #ifdef MONITOR
 	pr_info("\n \
@@ -528,6 +1298,7 @@ int lightfs_io_close (DB_IO *db_io)
 		\r[%30s]: %ld\n \
 		\r[%30s]: %ld\n \
 		\r[%30s]: %ld\n \
+		\r[%30s]: %ld\n \
 		\r======================================\n\n"
 			, cmds.name[LIGHTFS_META_GET], atomic64_read(&db_io_XXX->mon.ops_num[LIGHTFS_META_GET])
 			, cmds.name[LIGHTFS_META_SET], atomic64_read(&db_io_XXX->mon.ops_num[LIGHTFS_META_SET])
@@ -548,6 +1319,7 @@ int lightfs_io_close (DB_IO *db_io)
 			, cmds.name[LIGHTFS_GET_MULTI], atomic64_read(&db_io_XXX->mon.ops_num[LIGHTFS_GET_MULTI])
 			, cmds.name[LIGHTFS_GET_MULTI_READA], atomic64_read(&db_io_XXX->mon.ops_num[LIGHTFS_GET_MULTI_READA])
 			, cmds.name[LIGHTFS_DATA_SET_WB], atomic64_read(&db_io_XXX->mon.ops_num[LIGHTFS_DATA_SET_WB])
+			, cmds.name[LIGHTFS_DATA_EXT_WB], atomic64_read(&db_io_XXX->mon.ops_num[LIGHTFS_DATA_EXT_WB])
 			, cmds.name[LIGHTFS_TXN_TRANSFER], atomic64_read(&db_io_XXX->mon.ops_num[LIGHTFS_TXN_TRANSFER])
 			, cmds.name[LIGHTFS_GET_MULTI_REAL], atomic64_read(&db_io_XXX->mon.ops_num[LIGHTFS_GET_MULTI_REAL])
 			, cmds.name[LIGHTFS_GET_MULTI_READA_REAL], atomic64_read(&db_io_XXX->mon.ops_num[LIGHTFS_GET_MULTI_READA_REAL])
@@ -563,19 +1335,36 @@ int lightfs_io_close (DB_IO *db_io)
 int lightfs_io_create (DB_IO **db_io) {
 #ifdef MONITOR
 	int i;
+#endif
+#if defined(GET_COALESCE) || defined(COMPRESS)
+	int ret;
 #endif
 	(*db_io) = (DB_IO *)kmalloc(sizeof(DB_IO), GFP_KERNEL);
+	if (!*db_io)
+		return -ENOMEM;
 
 #ifdef EMULATION
 	(*db_io)->get = rb_io_get;
+	(*db_io)->get_async = rb_io_get_async;
 	(*db_io)->sync_put = rb_io_sync_put;
 	(*db_io)->iter = rb_io_iter;
 	(*db_io)->transfer = rb_io_transfer;
 	(*db_io)->commit = rb_io_commit;
 	(*db_io)->close = rb_io_close;
 	(*db_io)->get_multi = rb_io_get_multi;
+#elif defined NULL_IO
+	(*db_io)->get = null_io_get;
+	(*db_io)->get_async = null_io_get_async;
+	(*db_io)->sync_put = null_io_sync_put;
+	(*db_io)->iter = null_io_iter;
+	(*db_io)->transfer = null_io_transfer;
+	(*db_io)->commit = null_io_commit;
+	(*db_io)->close = null_io_close;
+	(*db_io)->get_multi = null_io_get_multi;
+	(*db_io)->get_multi_reada = null_io_get_multi_reada;
 #else
 	(*db_io)->get = lightfs_io_get;
+	(*db_io)->get_async = lightfs_io_get_async;
 	(*db_io)->sync_put = lightfs_io_sync_put;
 	(*db_io)->iter = lightfs_io_iter;
 	(*db_io)->transfer = lightfs_io_transfer;
@@ -585,7 +1374,26 @@ int lightfs_io_create (DB_IO **db_io) {
 	(*db_io)->get_multi_reada = lightfs_io_get_multi_reada;
 #endif
 
+#ifdef NULL_IO
+	lightfs_error(__func__, "null_io_init %d\n", null_io_init());
+#else
 	lightfs_error(__func__, "cheeze_init %d\n", cheeze_init());
+#endif
+#ifdef GET_COALESCE
+	ret = lightfs_inflight_init();
+	if (ret)
+		goto out_io_exit;
+#endif
+#ifdef COMPRESS
+	// compressed sets and gets use the per-cpu tfms unchecked
+	ret = lightfs_comp_init();
+	if (ret) {
+#ifdef GET_COALESCE
+		lightfs_inflight_exit();
+#endif
+		goto out_io_exit;
+	}
+#endif
 
 #ifdef MONITOR
 	for (i = 0; i < OPS_CNT; i++) {
@@ -596,5 +1404,19 @@ int lightfs_io_create (DB_IO **db_io) {
 	db_io_XXX = *db_io;
 
 	return 0;
+
+#if defined(GET_COALESCE) || defined(COMPRESS)
+out_io_exit:
+	lightfs_error(__func__, "io init failed %d\n", ret);
+#ifdef NULL_IO
+	vfree(null_io_slots);
+	vfree(null_io_zero);
+#else
+	cheeze_exit();
+#endif
+	kfree(*db_io);
+	*db_io = NULL;
+	return ret;
+#endif
 }
 
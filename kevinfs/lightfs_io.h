@@ -3,8 +3,14 @@
 
 #include "lightfs.h"
 #include "./cheeze/cheeze.h"
+#include "lightfs_comp.h"
+
+#if (defined NULL_IO && (defined EMULATION || defined CHEEZE))
+#error "NULL_IO replaces the device, it cannot be combined with EMULATION or CHEEZE"
+#endif
 
 int lightfs_io_create (DB_IO **db_io);
+void lightfs_io_free_buf (int tag);
 
 static inline void lightfs_io_print (char *buf, int len)
 {
@@ -95,6 +101,26 @@ static inline int lightfs_io_set_buf_set(char *buf, uint8_t type, uint16_t key_l
 	return idx;
 }
 
+#ifdef COMPRESS
+// a data page, compressed straight into buf when that pays off
+static inline int lightfs_io_set_buf_set_page(char *buf, uint16_t key_len, char *key, char *page, int idx)
+{
+	int len_idx;
+	uint16_t value_len;
+
+	idx = lightfs_io_set_type(buf + idx, LIGHTFS_DATA_SET, idx);
+	idx = lightfs_io_set_key_len(buf + idx, key_len, idx);
+	idx = lightfs_io_set_key(buf + idx, key_len, key, idx);
+	idx = lightfs_io_set_off(buf + idx, 0, idx);
+	len_idx = idx;
+	idx += sizeof(uint16_t);
+	value_len = lightfs_comp_page(page, buf + idx);
+	lightfs_io_set_value_len(buf + len_idx, value_len, len_idx);
+
+	return idx + value_len;
+}
+#endif
+
 static inline int lightfs_io_set_buf_meta_set(char *buf, uint8_t type, uint16_t key_len, char *key, uint16_t off, uint16_t value_len, char *value, int idx)
 {
 	idx = lightfs_io_set_type(buf + idx, type, idx);
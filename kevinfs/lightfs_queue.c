@@ -1,138 +1,140 @@
-#include <linux/module.h>
-#include <linux/delay.h>
-#include <linux/semaphore.h>
-#include <linux/blkdev.h>
-#include <linux/genhd.h>
-#include <linux/backing-dev.h>
-#include <linux/blk-mq.h>
-#include <linux/spinlock.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/processor.h>
+
+#include "lightfs_queue.h"
+
+static void lightfs_ring_init(struct lightfs_ring *r, int cnt)
+{
+	unsigned int i, size = roundup_pow_of_two(cnt);
+
+	r->cells = kcalloc(size, sizeof(struct lightfs_ring_cell), GFP_KERNEL);
+	for (i = 0; i < size; i++)
+		atomic_set(&r->cells[i].seq, i);
+	r->mask = size - 1;
+	atomic_set(&r->head, 0);
+	atomic_set(&r->tail, 0);
+}
 
-#include "db.h"
-#include "lightfs.h"
+/*
+ * A ring has a cell for every tag, so it is never really full. The cell
+ * at tail may still be held for a moment by a dequeue of the previous lap
+ * that took its ticket but has not yet freed it (diff < 0): wait for it.
+ */
+static void lightfs_ring_enqueue(struct lightfs_ring *r, int id)
+{
+	struct lightfs_ring_cell *cell;
+	unsigned int pos = atomic_read(&r->tail);
+	int diff;
+
+	for (;;) {
+		cell = &r->cells[pos & r->mask];
+		diff = (int)(atomic_read_acquire(&cell->seq) - pos);
+		if (diff == 0) {
+			if (atomic_cmpxchg(&r->tail, pos, pos + 1) == pos)
+				break;
+		} else if (diff < 0) {
+			cpu_relax();
+		}
+		pos = atomic_read(&r->tail);
+	}
+	cell->id = id;
+	atomic_set_release(&cell->seq, pos + 1);
+}
 
+// returns -1 when the ring is empty
+static int lightfs_ring_dequeue(struct lightfs_ring *r)
+{
+	struct lightfs_ring_cell *cell;
+	unsigned int pos = atomic_read(&r->head);
+	int diff, id;
+
+	for (;;) {
+		cell = &r->cells[pos & r->mask];
+		diff = (int)(atomic_read_acquire(&cell->seq) - (pos + 1));
+		if (diff == 0) {
+			if (atomic_cmpxchg(&r->head, pos, pos + 1) == pos)
+				break;
+		} else if (diff < 0) {
+			return -1;
+		}
+		pos = atomic_read(&r->head);
+	}
+	id = cell->id;
+	atomic_set_release(&cell->seq, pos + r->mask + 1);
 
-// Lock must be held and freed before and after push()
-int lightfs_queue_push(struct lightfs_queue *q, void *data) {
-	int id;
-	unsigned long irqflags;
-	struct lightfs_queue_item *item; 
+	return id;
+}
 
-	while(down_interruptible(&q->slots) == -EINTR) {
-		//pr_info("interrupt - 1\n");
-	}
-	spin_lock_irqsave(&q->queue_spin, irqflags);
+static inline void lightfs_queue_wake(wait_queue_head_t *wq)
+{
+	if (wq_has_sleeper(wq))
+		wake_up(wq);
+}
 
-	item = list_first_entry(&q->free_tag_list, struct lightfs_queue_item, tag);
-	list_move_tail(&item->tag, &q->processing_tag_list);
-	id = item->id;
-	item->data = data;
+// sleeps only while all tags are taken
+int lightfs_queue_push(struct lightfs_queue *q, void *data) {
+	int id;
 
-	spin_unlock_irqrestore(&q->queue_spin, irqflags);
+	wait_event(q->slots_wait, (id = lightfs_ring_dequeue(&q->free_tags)) >= 0);
+	q->item_arr[id].data = data;
+	lightfs_ring_enqueue(&q->ready_tags, id);
+	lightfs_queue_wake(&q->items_wait);
 
-	up(&q->items);	/* Announce available item */
 	return id;
 }
 
-// Queue is locked until pop
+// the tag stays taken until pop
 void *lightfs_queue_peek(struct lightfs_queue *q) {
-	struct lightfs_queue_item *item;
-	unsigned long irqflags;
-
-	while(down_interruptible(&q->items) == -EINTR) {}	/* Wait for available item */
-
-	/* Lock the buffer */
-	spin_lock_irqsave(&q->queue_spin, irqflags);
-
-	item = list_first_entry(&q->processing_tag_list, struct lightfs_queue_item, tag);
-	list_del(&item->tag);
+	int id;
 
-	spin_unlock_irqrestore(&q->queue_spin, irqflags);
+	wait_event(q->items_wait, (id = lightfs_ring_dequeue(&q->ready_tags)) >= 0);
 
-	return item->data;
+	return q->item_arr[id].data;
 }
 
 void lightfs_queue_pop(struct lightfs_queue *q, int id) {
-	unsigned long irqflags;
-	struct lightfs_queue_item *item;
-
-	spin_lock_irqsave(&q->queue_spin, irqflags);
-
-	item = (q->item_arr)[id];
-	
-	list_add_tail(&item->tag, &q->free_tag_list);
-
-	spin_unlock_irqrestore(&q->queue_spin, irqflags);
-
-	up(&q->slots);	/* Announce available slot */
+	lightfs_ring_enqueue(&q->free_tags, id);
+	lightfs_queue_wake(&q->slots_wait);
 }
 
 void *lightfs_queue_peek_and_pop(struct lightfs_queue *q) {
-	struct lightfs_queue_item *item;
-	unsigned long irqflags;
-
-	while(down_interruptible(&q->items) == -EINTR) {}	/* Wait for available item */
-
-	/* Lock the buffer */
-	spin_lock_irqsave(&q->queue_spin, irqflags);
-
-	item = list_first_entry(&q->processing_tag_list, struct lightfs_queue_item, tag);
-	list_del(&item->tag);
-
-	list_add_tail(&item->tag, &q->free_tag_list);
-
-	spin_unlock_irqrestore(&q->queue_spin, irqflags);
+	void *data;
+	int id;
 
-	up(&q->slots);	/* Announce available slot */
+	wait_event(q->items_wait, (id = lightfs_ring_dequeue(&q->ready_tags)) >= 0);
+	data = q->item_arr[id].data;
+	lightfs_queue_pop(q, id);
 
-	return item->data;
+	return data;
 }
 
 bool lightfs_queue_is_empty(struct lightfs_queue *q) {
-	bool ret;
-	unsigned long irqflags;
-	spin_lock_irqsave(&q->queue_spin, irqflags);
-	ret = list_empty(&q->processing_tag_list);
-	spin_unlock_irqrestore(&q->queue_spin, irqflags);
-	return ret;
+	return atomic_read(&q->ready_tags.head) == atomic_read(&q->ready_tags.tail);
 }
 
-
-
-
 void lightfs_queue_init(struct lightfs_queue **q, int cnt) {
 	int i;
-	struct lightfs_queue_item *item;
 	struct lightfs_queue *_q;
 	*q = kzalloc(sizeof(struct lightfs_queue), GFP_KERNEL);
 	
 	_q = *q;
 
-	INIT_LIST_HEAD(&_q->free_tag_list);
-	INIT_LIST_HEAD(&_q->processing_tag_list);
-	spin_lock_init(&_q->queue_spin);
-
-	_q->item_arr = vzalloc(sizeof(struct lightfs_queue_item *) * cnt);
-	for (i = 0; i < cnt; i++) {
-		item = kzalloc(sizeof(struct lightfs_queue_item), GFP_KERNEL);
-		item->id = i;
-		(_q->item_arr)[i] = item;
-		INIT_LIST_HEAD(&item->tag);
-		list_add_tail(&item->tag, &_q->free_tag_list);
-	}
-
-	sema_init(&_q->slots, cnt);	/* Initially, buf has n empty slots */
-	sema_init(&_q->items, 0);	/* Initially, buf has zero data items */
+	_q->item_arr = vzalloc(sizeof(struct lightfs_queue_item) * cnt);
+	lightfs_ring_init(&_q->free_tags, cnt);
+	lightfs_ring_init(&_q->ready_tags, cnt);
+	init_waitqueue_head(&_q->slots_wait);
+	init_waitqueue_head(&_q->items_wait);
+	for (i = 0; i < cnt; i++)
+		lightfs_ring_enqueue(&_q->free_tags, i);
 	_q->cap = cnt;
 }
 
 
 void lightfs_queue_exit(struct lightfs_queue *q) {
-	int i;
-	struct lightfs_queue_item *item;
-	for (i = 0; i < q->cap; i++) {
-		item = (q->item_arr)[i];
-		kfree(item);
-	}
+	kfree(q->free_tags.cells);
+	kfree(q->ready_tags.cells);
 	vfree(q->item_arr);
 	kfree(q);
 }
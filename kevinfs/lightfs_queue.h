@@ -1,8 +1,42 @@
 #ifndef __LIGHTFS_QUEUE__
 #define __LIGHTFS_QUEUE__
 
-#include <linux/spinlock.h>
-#include <linux/list.h>
+#include <linux/types.h>
+#include <linux/atomic.h>
+#include <linux/wait.h>
+#include <linux/cache.h>
+
+/*
+ * Bounded MPMC ring of tag ids. The cell for ticket t is free for the
+ * enqueue with that ticket when seq == t and holds an id for the dequeue
+ * with that ticket when seq == t + 1, so producers and consumers only
+ * meet on the head/tail cmpxchg.
+ */
+struct lightfs_ring_cell {
+	atomic_t seq;
+	int id;
+};
+
+struct lightfs_ring {
+	atomic_t head ____cacheline_aligned_in_smp;
+	atomic_t tail ____cacheline_aligned_in_smp;
+	unsigned int mask;
+	struct lightfs_ring_cell *cells;
+};
+
+struct lightfs_queue_item {
+	void *data;
+};
+
+// tags move free_tags -> (push) -> ready_tags -> (peek) -> user -> (pop) -> free_tags
+struct lightfs_queue {
+	struct lightfs_ring free_tags;
+	struct lightfs_ring ready_tags;
+	wait_queue_head_t slots_wait;
+	wait_queue_head_t items_wait;
+	struct lightfs_queue_item *item_arr;
+	int cap;
+};
 
 int lightfs_queue_push(struct lightfs_queue *q, void *data); 
 void *lightfs_queue_peek(struct lightfs_queue *q); 
@@ -1,211 +1,468 @@
+#include <linux/moduleparam.h>
+#include <linux/pagemap.h>
+#include <linux/pagevec.h>
+#include <linux/backing-dev.h>
+#include <linux/seq_file.h>
+#include <linux/wait.h>
 #include "lightfs_reada.h"
 #include "./cheeze/cheeze.h"
+#include "lightfs_io.h"
 #include "lightfs.h"
 
-struct reada_entry *lightfs_reada_alloc(struct inode *inode, uint64_t current_block_num, unsigned block_cnt) {
-	struct reada_entry *ra_entry = kmalloc(sizeof(struct reada_entry), GFP_KERNEL);
-	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
+/*
+ * Pipelined readahead: a sequential stream keeps up to reada_windows
+ * GET_MULTI windows in flight ahead of the reader. Each open file has its
+ * own stream, the windows of all of them are on the inode so truncate,
+ * direct I/O and evict can cancel them. A window owns locked page cache
+ * pages; its completion fills them on lightfs_reada_wq and unlocks them,
+ * so the reader only waits on pages that are not in yet. The VFS
+ * readahead (file_ra_state, fadvise and madvise WILLNEED) goes through the
+ * same windows from lightfs_readpages, on the stream of its file.
+ *
+ * Pages a window fills are PageChecked until a read consumes them, the
+ * ones that leave the page cache still checked were fetched for nothing.
+ */
+static unsigned int reada_windows = READA_QD;
+module_param(reada_windows, uint, 0644);
+MODULE_PARM_DESC(reada_windows, "readahead windows in flight per sequential stream, 0 disables");
 
-	//BUG_ON(ra_entry->reada_state & READA_FULL);
+static struct workqueue_struct *lightfs_reada_wq;
+static DECLARE_WAIT_QUEUE_HEAD(lightfs_reada_waitq);
 
-	ra_entry->reada_state = READA_FULL;
-	ra_entry->reada_block_start = current_block_num;
-	ra_entry->reada_block_len = block_cnt;
-	ra_entry->tag = 0;
-	init_completion(&ra_entry->reada_acked);
-	ra_entry->extra = lightfs_inode;
+static struct {
+	atomic64_t windows; // issued by the stream
+	atomic64_t vfs_windows; // issued by the VFS readahead
+	atomic64_t cancelled;
+	atomic64_t pages; // filled
+	atomic64_t hits; // filled and then read
+	atomic64_t wasted; // fetched and dropped unread
+} lightfs_reada_stat;
 
-	INIT_LIST_HEAD(&ra_entry->list);
-	list_add_tail(&ra_entry->list, &lightfs_inode->ra_list);
-	lightfs_inode->ra_entry_cnt++;
-	if (lightfs_inode->ra_entry_cnt == 1) {
-		BUG_ON(lightfs_inode->ra_entry);
-		lightfs_inode->ra_entry = ra_entry;
-	}
+static inline unsigned int lightfs_reada_windows(void)
+{
+	return min_t(unsigned int, READ_ONCE(reada_windows), READA_QD_MAX);
+}
 
-	return ra_entry;
+// POSIX_FADV_SEQUENTIAL doubled the file's VFS window, double ours too
+static inline unsigned long lightfs_reada_window_pages(struct file *file)
+{
+	struct inode *inode = file_inode(file);
+
+	if (READ_ONCE(file->f_ra.ra_pages) > inode_to_bdi(inode)->ra_pages)
+		return min_t(unsigned long, 2 * READA_BLOCK_CNT, CHEEZE_BUF_SIZE / PAGE_SIZE);
+	return READA_BLOCK_CNT;
 }
 
-void lightfs_reada_free(struct reada_entry *ra_entry, struct inode *inode) {
-	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
-	struct reada_entry *tmp = NULL;
-	//BUG_ON(!(ra_entry->reada_state & READA_DONE));
-	spin_lock(&lightfs_inode->reada_spin);
-	if (!(ra_entry->reada_state & READA_DONE)) {
-		spin_unlock(&lightfs_inode->reada_spin);
-		wait_for_completion(&ra_entry->reada_acked);
-		spin_lock(&lightfs_inode->reada_spin);
+/*
+ * Cancel the windows of stream, of every stream if NULL; those streams
+ * then read ahead again from where their reader is. Under reada_spin.
+ */
+static void __lightfs_reada_cancel(struct lightfs_inode *lightfs_inode,
+                                   struct lightfs_reada_stream *stream)
+{
+	struct reada_entry *ra_entry;
+
+	list_for_each_entry(ra_entry, &lightfs_inode->ra_list, list) {
+		if (stream && ra_entry->stream != stream)
+			continue;
+		if (!(ra_entry->reada_state & READA_CANCEL))
+			atomic64_inc(&lightfs_reada_stat.cancelled);
+		ra_entry->reada_state |= READA_CANCEL;
 	}
-	cheeze_free_io(lightfs_inode->ra_entry->tag);
-	list_del(&ra_entry->list);
-	lightfs_inode->ra_entry_cnt--;
-	if (lightfs_inode->ra_entry_cnt == 0) {
-		lightfs_inode->ra_entry = NULL;
+	if (stream) {
+		stream->run = 0;
+		stream->next = 0;
 	} else {
-		lightfs_inode->ra_entry = list_first_entry(&lightfs_inode->ra_list, struct reada_entry, list);
+		lightfs_inode->ra_gen++;
 	}
-	spin_unlock(&lightfs_inode->reada_spin);
-	kfree(tmp);
 }
 
-void lightfs_reada_all_flush(struct inode *inode) {
-	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
-	struct reada_entry *ra_entry, *next;
-
-	list_for_each_entry_safe(ra_entry, next, &lightfs_inode->ra_list, list) {
-		lightfs_reada_free(ra_entry, inode);
+// under reada_spin, before the stream state is used
+static inline void lightfs_reada_stream_sync(struct lightfs_inode *lightfs_inode,
+                                             struct lightfs_reada_stream *stream)
+{
+	if (stream->gen != lightfs_inode->ra_gen) {
+		stream->gen = lightfs_inode->ra_gen;
+		stream->next = 0;
 	}
 }
 
-void lightfs_reada_flush(struct inode *inode, int cnt) {
-	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
-	struct reada_entry *ra_entry, *next;
-	volatile int i = 0;
+static void lightfs_reada_fill(struct work_struct *work)
+{
+	struct reada_entry *ra_entry = container_of(work, struct reada_entry, work);
+	struct lightfs_inode *lightfs_inode = ra_entry->extra;
+	struct lightfs_io *lightfs_io = ra_entry->lightfs_io;
+	loff_t size = i_size_read(&lightfs_inode->vfs_inode);
+	pgoff_t last = size ? (size - 1) >> PAGE_SHIFT : 0;
+	struct page *page;
+	char *page_buf;
+	bool cancel;
+	unsigned i, filled = 0;
 
-	list_for_each_entry_safe(ra_entry, next, &lightfs_inode->ra_list, list) {
-		if (cnt == i)
-			break;
-		lightfs_reada_free(ra_entry, inode);
-		i++;
+	spin_lock(&lightfs_inode->reada_spin);
+	cancel = ra_entry->reada_state & READA_CANCEL;
+	ra_entry->reada_state |= READA_DONE;
+	spin_unlock(&lightfs_inode->reada_spin);
+
+	for (i = 0; i < lightfs_io->lightfs_vcnt; i++) {
+		page = lightfs_io->lightfs_io_vec[i].fv_page;
+		if (cancel || !size || page->index > last) {
+			get_page(page);
+			delete_from_page_cache(page);
+			unlock_page(page);
+			put_page(page);
+			if (ra_entry->tag >= 0)
+				atomic64_inc(&lightfs_reada_stat.wasted);
+			continue;
+		}
+		page_buf = kmap_atomic(page);
+		if (ra_entry->ubuf_len) {
+			memcpy(page_buf, ra_entry->buf + (PAGE_TO_BLOCK_NUM(page) - ra_entry->reada_block_start) * PAGE_SIZE, PAGE_SIZE);
+#ifdef COMPRESS
+			lightfs_decomp_page(page_buf);
+#endif
+		} else {
+			memset(page_buf, 0, PAGE_SIZE);
+		}
+		kunmap_atomic(page_buf);
+		if (page->index == last && (size & ~PAGE_MASK))
+			zero_user_segment(page, size & ~PAGE_MASK, PAGE_SIZE);
+		flush_dcache_page(page);
+		SetPageChecked(page);
+		SetPageUptodate(page);
+		filled++;
+		unlock_page(page);
 	}
-}
+	atomic64_add(filled, &lightfs_reada_stat.pages);
+
+	/*
+	 * Only now the window is gone: lightfs_reada_cancel(inode, true)
+	 * returns with no page of it locked, and evict waits for this, so the
+	 * inode lives until the count drops.
+	 */
+	spin_lock(&lightfs_inode->reada_spin);
+	list_del(&ra_entry->list);
+	lightfs_inode->ra_entry_cnt--;
+	if (ra_entry->stream)
+		ra_entry->stream->entry_cnt--;
+	spin_unlock(&lightfs_inode->reada_spin);
+	wake_up_all(&lightfs_reada_waitq);
 
+	if (ra_entry->tag >= 0)
+		lightfs_io_free_buf(ra_entry->tag);
+	lightfs_io_free(lightfs_io);
+	kfree(ra_entry);
+}
 
-struct reada_entry *lightfs_reada_reuse(struct inode *inode, uint64_t current_block_num, unsigned block_cnt) {
-	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
-	struct reada_entry *ra_entry = lightfs_inode->ra_entry;
+// completion of a window, must not sleep
+void lightfs_reada_end(struct reada_entry *ra_entry)
+{
+	queue_work(lightfs_reada_wq, &ra_entry->work);
+}
 
-	//BUG_ON(lightfs_inode->reada_state & READA_EMPTY);
+// a window that could not be issued
+void lightfs_reada_drop(struct reada_entry *ra_entry)
+{
+	ra_entry->reada_state |= READA_CANCEL;
+	lightfs_reada_fill(&ra_entry->work);
+}
 
-	cheeze_free_io(ra_entry->tag);
+// ->open, a file that gets no stream just reads without our windows
+int lightfs_reada_open(struct inode *inode, struct file *file)
+{
+	file->private_data = kzalloc(sizeof(struct lightfs_reada_stream), GFP_KERNEL);
+	return 0;
+}
 
-	ra_entry->reada_state = READA_FULL;
-	ra_entry->reada_block_start = current_block_num;
-	ra_entry->reada_block_len = block_cnt;
-	ra_entry->tag = 0;
-	reinit_completion(&ra_entry->reada_acked);
-	ra_entry->extra = lightfs_inode;
+// ->release, the windows of the stream are cancelled and waited for
+int lightfs_reada_release(struct inode *inode, struct file *file)
+{
+	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
+	struct lightfs_reada_stream *stream = file->private_data;
 
+	if (!stream)
+		return 0;
 	spin_lock(&lightfs_inode->reada_spin);
-	list_move_tail(&ra_entry->list, &lightfs_inode->ra_list);
+	__lightfs_reada_cancel(lightfs_inode, stream);
 	spin_unlock(&lightfs_inode->reada_spin);
+	wait_event(lightfs_reada_waitq, !READ_ONCE(stream->entry_cnt));
+	kfree(stream);
+	file->private_data = NULL;
 
-	return ra_entry;
+	return 0;
 }
 
+/*
+ * Account a buffered read of [pos, pos + count) to the stream of the file.
+ * A read that does not continue the stream is a seek and cancels its
+ * windows in flight. Returns whether windows should be issued.
+ */
+bool lightfs_reada_stream(struct file *file, loff_t pos, size_t count)
+{
+	struct lightfs_inode *lightfs_inode = LIGHTFS_I(file_inode(file));
+	struct lightfs_reada_stream *stream = file->private_data;
+	pgoff_t index = pos >> PAGE_SHIFT;
+	pgoff_t end = (pos + count - 1) >> PAGE_SHIFT;
+	unsigned int windows = lightfs_reada_windows();
+	bool ret;
 
-bool lightfs_reada_need(struct inode *inode, struct lightfs_io *lightfs_io, unsigned nr_pages, bool fg_read) {
-	uint64_t current_start_block;
-	bool ret = false;
-	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
-
-	if (nr_pages < READA_THRESHOLD) {
+	// POSIX_FADV_RANDOM, nothing is fetched speculatively
+	if (!stream || (file->f_mode & FMODE_RANDOM))
 		return false;
-	}
-
-	current_start_block = PAGE_TO_BLOCK_NUM(lightfs_io_first_page(lightfs_io));
 
 	spin_lock(&lightfs_inode->reada_spin);
-	if (lightfs_inode->ra_entry_cnt >= READA_QD) {
-		ret = false;
-	} else {
-		if (fg_read) {
-			if(current_start_block == lightfs_inode->last_block_start + lightfs_inode->last_block_len) {
-				ret = true;
-			}
-		} else if (lightfs_inode->ra_entry) {
-			if (current_start_block + nr_pages == lightfs_inode->ra_entry->reada_block_start + lightfs_inode->ra_entry->reada_block_len) {
-				ret = true;
-			}
-		}
-	}
-	lightfs_inode->last_block_start = current_start_block;
-	lightfs_inode->last_block_len = nr_pages;
+	lightfs_reada_stream_sync(lightfs_inode, stream);
+	// unaligned reads go on in the last page of the previous one
+	if (index != stream->seq_next && index + 1 != stream->seq_next)
+		__lightfs_reada_cancel(lightfs_inode, stream);
+	stream->run += end + 1 - index;
+	stream->seq_next = end + 1;
+	ret = windows && stream->entry_cnt < windows &&
+	      (stream->run >= READA_THRESHOLD ||
+	       lightfs_reada_window_pages(file) > READA_BLOCK_CNT);
 	spin_unlock(&lightfs_inode->reada_spin);
+
 	return ret;
 }
 
-#if 0
-static bool lightfs_reada_wait_finished(struct inode *inode) {
-	bool ret;
-	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
+// a seek away from the stream cancels its windows
+void lightfs_reada_seek(struct file *file, loff_t pos)
+{
+	struct lightfs_inode *lightfs_inode = LIGHTFS_I(file_inode(file));
+	struct lightfs_reada_stream *stream = file->private_data;
+	pgoff_t index = pos >> PAGE_SHIFT;
+
+	if (!stream)
+		return;
 	spin_lock(&lightfs_inode->reada_spin);
-	ret = lightfs_inode->ra_entry->reada_state & READA_DONE;
+	if (index != stream->seq_next && index + 1 != stream->seq_next) {
+		__lightfs_reada_cancel(lightfs_inode, stream);
+		stream->seq_next = index;
+	}
 	spin_unlock(&lightfs_inode->reada_spin);
-	return ret;
 }
-#endif
 
-unsigned lightfs_reada_buffer_get(struct reada_entry *ra_entry, struct inode *inode, struct lightfs_io *lightfs_io, unsigned nr_pages) {
-	unsigned ret;
-	unsigned processed_pages = 0;
-	uint64_t current_block_num;
-	struct page *page;
-	char *page_buf;
-	int idx;
+/*
+ * Claim the next window of the stream and add its pages, locked, to the
+ * page cache. The window starts past the VFS readahead window that covers
+ * the reader, if any, and stops at the first page that is already cached.
+ * Returns NULL once reada_windows windows are in flight or the stream is
+ * that far ahead of the reader.
+ */
+struct reada_entry *lightfs_reada_next(struct file *file)
+{
+	struct inode *inode = file_inode(file);
 	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
-	
-	if (!lightfs_inode->ra_entry) {
-		ret = ENORA;
-		goto out;
-	}
+	struct lightfs_reada_stream *stream = file->private_data;
+	struct address_space *mapping = inode->i_mapping;
+	gfp_t gfp = readahead_gfp_mask(mapping);
+	unsigned int windows = lightfs_reada_windows();
+	unsigned long win = lightfs_reada_window_pages(file);
+	loff_t size = i_size_read(inode);
+	pgoff_t vfs_start = READ_ONCE(file->f_ra.start);
+	pgoff_t vfs_end = vfs_start + READ_ONCE(file->f_ra.size);
+	struct reada_entry *ra_entry;
+	struct lightfs_io *lightfs_io;
+	struct page *page;
+	pgoff_t start, last, hole;
+	unsigned long cnt, i;
 
-	if (nr_pages < READA_THRESHOLD) {
-		ret = ESMALL;
-		goto out;
-	}
+	if (!size)
+		return NULL;
+	last = (size - 1) >> PAGE_SHIFT;
 
+again:
+	ra_entry = kmalloc(sizeof(struct reada_entry), GFP_KERNEL);
+	if (!ra_entry)
+		return NULL;
+	lightfs_io = lightfs_io_alloc(win);
+	if (!lightfs_io) {
+		kfree(ra_entry);
+		return NULL;
+	}
 
 	spin_lock(&lightfs_inode->reada_spin);
-	if (ra_entry->reada_state & READA_EMPTY || nr_pages < READA_THRESHOLD) {
+	lightfs_reada_stream_sync(lightfs_inode, stream);
+	start = max(stream->next, stream->seq_next);
+	if (vfs_start <= stream->seq_next && vfs_end > start)
+		start = vfs_end;
+	if (!stream->run || stream->entry_cnt >= windows || start > last ||
+	    start - stream->seq_next >= (pgoff_t)windows * win) {
 		spin_unlock(&lightfs_inode->reada_spin);
-		ret = ENORA;
-		goto out;
+		lightfs_io_free(lightfs_io);
+		kfree(ra_entry);
+		return NULL;
 	}
+	cnt = min_t(pgoff_t, win, last - start + 1);
+	stream->next = start + cnt;
+	ra_entry->reada_state = READA_FULL;
+	ra_entry->stream = stream;
+	list_add_tail(&ra_entry->list, &lightfs_inode->ra_list);
+	lightfs_inode->ra_entry_cnt++;
+	stream->entry_cnt++;
+	spin_unlock(&lightfs_inode->reada_spin);
 
-	current_block_num = PAGE_TO_BLOCK_NUM(lightfs_io_current_page(lightfs_io));
-	if (current_block_num >=  ra_entry->reada_block_start) {
-		idx = current_block_num - ra_entry->reada_block_start;
-		if (current_block_num + nr_pages <= ra_entry->reada_block_start + ra_entry->reada_block_len) { // buf is enough to serve requests
-			if (!(ra_entry->reada_state & READA_DONE)) {
-				spin_unlock(&lightfs_inode->reada_spin);
-				wait_for_completion(&ra_entry->reada_acked);
-				spin_lock(&lightfs_inode->reada_spin);
-			}
-			BUG_ON(!(ra_entry->reada_state & READA_DONE));
-			while (!lightfs_io_job_done(lightfs_io)) {
-				page = lightfs_io_current_page(lightfs_io);
-				page_buf = kmap_atomic(page);
-				memcpy(page_buf, ra_entry->buf + idx, PAGE_SIZE);
-				kunmap_atomic(page_buf);
-				lightfs_io_advance_page(lightfs_io);
-				idx++;
-				processed_pages++;
-			}
-		} else if (current_block_num < ra_entry->reada_block_start + ra_entry->reada_block_len) { // buf is not enough
-			if (!(ra_entry->reada_state & READA_DONE)) {
-				spin_unlock(&lightfs_inode->reada_spin);
-				wait_for_completion(&ra_entry->reada_acked);
-				spin_lock(&lightfs_inode->reada_spin);
-			}
-			BUG_ON(!(ra_entry->reada_state & READA_DONE));
-			while(idx < ra_entry->reada_block_len) {
-				page = lightfs_io_current_page(lightfs_io);
-				page_buf = kmap_atomic(page);
-				memcpy(page_buf, ra_entry->buf + idx, PAGE_SIZE);
-				kunmap_atomic(page_buf);
-				lightfs_io_advance_page(lightfs_io);
-				idx++;
-				processed_pages++;
+	rcu_read_lock();
+	hole = page_cache_next_hole(mapping, start, cnt);
+	rcu_read_unlock();
+	cnt -= min_t(unsigned long, hole - start, cnt);
+	start = hole;
+
+	for (i = 0; i < cnt; i++) {
+		page = __page_cache_alloc(gfp);
+		if (!page)
+			break;
+		if (add_to_page_cache_lru(page, mapping, start + i, gfp)) {
+			put_page(page);
+			break;
+		}
+		lightfs_io_add_page(lightfs_io, page);
+		put_page(page);
+	}
+
+	ra_entry->lightfs_io = lightfs_io;
+	ra_entry->reada_block_start = start + 1; // data block numbers start from 1
+	ra_entry->reada_block_len = lightfs_io->lightfs_vcnt;
+	ra_entry->tag = -1;
+	ra_entry->buf = NULL;
+	ra_entry->ubuf_len = 0;
+	ra_entry->extra = lightfs_inode;
+	INIT_WORK(&ra_entry->work, lightfs_reada_fill);
+
+	// nothing to read, this part of the file is cached
+	if (!lightfs_io->lightfs_vcnt) {
+		lightfs_reada_drop(ra_entry);
+		goto again;
+	}
+
+	atomic64_inc(&lightfs_reada_stat.windows);
+	return ra_entry;
+}
+
+/*
+ * Turn the pages readpages got from the VFS readahead of file into a
+ * window on the stream of that file, so the readahead does not wait for
+ * them and only a seek through the same file cancels it. The pages have
+ * to be contiguous and fit one GET_MULTI, otherwise NULL and the caller
+ * reads them itself.
+ */
+struct reada_entry *lightfs_reada_vfs(struct inode *inode, struct file *file,
+                                      struct lightfs_io *lightfs_io)
+{
+	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
+	struct lightfs_reada_stream *stream = file ? file->private_data : NULL;
+	struct page *first = lightfs_io_first_page(lightfs_io);
+	struct reada_entry *ra_entry;
+
+	if (!lightfs_io->lightfs_vcnt || lightfs_io->lightfs_vcnt > CHEEZE_BUF_SIZE / PAGE_SIZE ||
+	    lightfs_io_last_page(lightfs_io)->index - first->index + 1 != lightfs_io->lightfs_vcnt)
+		return NULL;
+	ra_entry = kmalloc(sizeof(struct reada_entry), GFP_NOIO);
+	if (!ra_entry)
+		return NULL;
+
+	ra_entry->lightfs_io = lightfs_io;
+	ra_entry->reada_block_start = PAGE_TO_BLOCK_NUM(first);
+	ra_entry->reada_block_len = lightfs_io->lightfs_vcnt;
+	ra_entry->tag = -1;
+	ra_entry->buf = NULL;
+	ra_entry->ubuf_len = 0;
+	ra_entry->extra = lightfs_inode;
+	ra_entry->reada_state = READA_FULL;
+	ra_entry->stream = stream;
+	INIT_WORK(&ra_entry->work, lightfs_reada_fill);
+
+	spin_lock(&lightfs_inode->reada_spin);
+	list_add_tail(&ra_entry->list, &lightfs_inode->ra_list);
+	lightfs_inode->ra_entry_cnt++;
+	if (stream)
+		stream->entry_cnt++;
+	spin_unlock(&lightfs_inode->reada_spin);
+
+	atomic64_inc(&lightfs_reada_stat.vfs_windows);
+	return ra_entry;
+}
+
+// a read of [pos, pos + len) consumed the read-ahead pages in it
+void lightfs_reada_consume(struct inode *inode, loff_t pos, size_t len)
+{
+	pgoff_t start = pos >> PAGE_SHIFT;
+	pgoff_t end = (pos + len - 1) >> PAGE_SHIFT;
+	struct page *pages[PAGEVEC_SIZE];
+	unsigned nr, i, hits = 0;
+
+	while (start <= end &&
+	       (nr = find_get_pages_range(inode->i_mapping, &start, end, PAGEVEC_SIZE, pages))) {
+		for (i = 0; i < nr; i++) {
+			if (PageChecked(pages[i])) {
+				ClearPageChecked(pages[i]);
+				hits++;
 			}
-		} else { // buffer miss
-			processed_pages = 0;
+			put_page(pages[i]);
 		}
-	} else { // buffer miss
-		processed_pages = 0;
 	}
-	ret = processed_pages;
+	if (hits)
+		atomic64_add(hits, &lightfs_reada_stat.hits);
+}
+
+// ->freepage, a read-ahead page leaves the page cache unread
+void lightfs_reada_freepage(struct page *page)
+{
+	if (PageChecked(page)) {
+		ClearPageChecked(page);
+		atomic64_inc(&lightfs_reada_stat.wasted);
+	}
+}
+
+static int lightfs_reada_stat_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "windows: %lld\n", atomic64_read(&lightfs_reada_stat.windows));
+	seq_printf(m, "vfs_windows: %lld\n", atomic64_read(&lightfs_reada_stat.vfs_windows));
+	seq_printf(m, "cancelled: %lld\n", atomic64_read(&lightfs_reada_stat.cancelled));
+	seq_printf(m, "pages: %lld\n", atomic64_read(&lightfs_reada_stat.pages));
+	seq_printf(m, "hits: %lld\n", atomic64_read(&lightfs_reada_stat.hits));
+	seq_printf(m, "wasted: %lld\n", atomic64_read(&lightfs_reada_stat.wasted));
+	return 0;
+}
+
+static int lightfs_reada_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lightfs_reada_stat_show, NULL);
+}
+
+const struct file_operations lightfs_reada_stat_fops = {
+	.owner = THIS_MODULE,
+	.open = lightfs_reada_stat_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/*
+ * Cancel the windows in flight of every stream, their pages are dropped
+ * instead of filled. With wait, no page of them is locked on return.
+ */
+void lightfs_reada_cancel(struct inode *inode, bool wait)
+{
+	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
+
+	spin_lock(&lightfs_inode->reada_spin);
+	__lightfs_reada_cancel(lightfs_inode, NULL);
 	spin_unlock(&lightfs_inode->reada_spin);
-out:
-	return ret;
+
+	if (wait)
+		wait_event(lightfs_reada_waitq, !READ_ONCE(lightfs_inode->ra_entry_cnt));
+}
+
+int lightfs_reada_init(void)
+{
+	lightfs_reada_wq = alloc_workqueue("lightfs_reada", WQ_MEM_RECLAIM | WQ_UNBOUND, 0);
+	if (!lightfs_reada_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void lightfs_reada_exit(void)
+{
+	destroy_workqueue(lightfs_reada_wq);
 }
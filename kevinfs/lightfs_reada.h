@@ -3,11 +3,19 @@
 
 #include "lightfs_fs.h"
 
-struct reada_entry *lightfs_reada_alloc(struct inode *inode, uint64_t current_block_num, unsigned block_cnt);
-void lightfs_reada_free(struct reada_entry *ra_entry, struct inode *inode);
-void lightfs_reada_all_flush(struct inode *inode);
-void lightfs_reada_flush(struct inode *inode, int cnt);
-struct reada_entry *lightfs_reada_reuse(struct inode *inode, uint64_t current_block_num, unsigned block_cnt);
-bool lightfs_reada_need(struct inode *inode, struct lightfs_io *lightfs_io, unsigned nr_pages, bool fg_read);
-unsigned lightfs_reada_buffer_get(struct reada_entry *ra_entry, struct inode *inode, struct lightfs_io *lightfs_io, unsigned nr_pages);
+void lightfs_reada_end(struct reada_entry *ra_entry);
+void lightfs_reada_drop(struct reada_entry *ra_entry);
+int lightfs_reada_open(struct inode *inode, struct file *file);
+int lightfs_reada_release(struct inode *inode, struct file *file);
+bool lightfs_reada_stream(struct file *file, loff_t pos, size_t count);
+void lightfs_reada_seek(struct file *file, loff_t pos);
+struct reada_entry *lightfs_reada_next(struct file *file);
+struct reada_entry *lightfs_reada_vfs(struct inode *inode, struct file *file,
+                                      struct lightfs_io *lightfs_io);
+void lightfs_reada_consume(struct inode *inode, loff_t pos, size_t len);
+void lightfs_reada_freepage(struct page *page);
+void lightfs_reada_cancel(struct inode *inode, bool wait);
+int lightfs_reada_init(void);
+extern const struct file_operations lightfs_reada_stat_fops;
+void lightfs_reada_exit(void);
 #endif
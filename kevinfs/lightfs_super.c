@@ -12,6 +12,7 @@
 #include <linux/kallsyms.h>
 #include <linux/sched.h>
 #include <linux/quotaops.h>
+#include <linux/falloc.h>
 
 #include "lightfs_fs.h"
 #include "lightfs.h"
@@ -30,6 +31,7 @@ static void lightfs_i_init_once(void *inode)
 	struct lightfs_inode *lightfs_inode = inode;
 
 	dbt_init(&lightfs_inode->meta_dbt);
+	mutex_init(&lightfs_inode->load_mutex);
 
 	inode_init_once(&lightfs_inode->vfs_inode);
 }
@@ -136,44 +138,138 @@ static inline void lightfs_put_write_lock(struct lightfs_inode *f_inode)
 #endif
 
 
-// get the next available (unused ino)
-// we alloc some ino to each cpu, if more are needed, we will do update_ino
-static int lightfs_next_ino(struct lightfs_sb_info *sbi, ino_t *ino)
+/*
+ * Store the lease target in the next_ino record. The work item never runs
+ * concurrently with itself, so the stored value only grows. A lease is
+ * handed out only after the txn covering it reached the device, so after
+ * a crash mount restarts past every number that may have been used.
+ */
+static void lightfs_ino_lease_work(struct work_struct *work)
 {
-	int ret = 0;
-	unsigned int cpu;
-	ino_t new_max;
+	struct lightfs_sb_info *sbi = container_of(work, struct lightfs_sb_info,
+	                                           s_ino_work);
+	ino_t target, committed;
+	uint32_t txn_id;
 	DB_TXN *txn;
+	int ret;
 
-	new_max = 0;
-	cpu = get_cpu();
-	*ino = per_cpu_ptr(sbi->s_lightfs_info, cpu)->next_ino;
-	if (*ino >= per_cpu_ptr(sbi->s_lightfs_info, cpu)->max_ino) {
-		// we expand for all cpus here, it is lavish
-		// we can't do txn while holding cpu
-		new_max = per_cpu_ptr(sbi->s_lightfs_info, cpu)->max_ino +
-		          sbi->s_nr_cpus * LIGHTFS_INO_INC;
-		per_cpu_ptr(sbi->s_lightfs_info, cpu)->max_ino = new_max;
-	}
-	per_cpu_ptr(sbi->s_lightfs_info, cpu)->next_ino += sbi->s_nr_cpus;
-	put_cpu();
+	for (;;) {
+		spin_lock(&sbi->s_ino_lock);
+		target = sbi->s_ino_target;
+		committed = sbi->s_ino_committed;
+		spin_unlock(&sbi->s_ino_lock);
+		if (target <= committed)
+			break;
 
-	if (new_max) {
 		TXN_GOTO_LABEL(retry);
 		lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_MAY_WRITE);
-		ret = lightfs_bstore_update_ino(sbi->meta_db, txn, new_max);
+		ret = lightfs_bstore_put_ino(sbi->meta_db, txn, target);
 		if (ret) {
 			DBOP_JUMP_ON_CONFLICT(ret, retry);
 			lightfs_bstore_txn_abort(txn);
-			// we already updated max_cpu, if we get error here
-			//  it is hard to go back
-			BUG();
+			lightfs_error(__func__, "lease write err=%d\n", ret);
+			// fail the waiting allocators, the next refill kicks us again
+			spin_lock(&sbi->s_ino_lock);
+			sbi->s_ino_err = (ret == -ENOMEM) ? -ENOMEM : -EIO;
+			sbi->s_ino_target = sbi->s_ino_committed;
+			spin_unlock(&sbi->s_ino_lock);
+			wake_up_all(&sbi->s_ino_wq);
+			break;
 		}
-		ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+		ret = lightfs_bstore_txn_commit_id(txn, DB_TXN_NOSYNC, &txn_id);
 		COMMIT_JUMP_ON_CONFLICT(ret, retry);
+		lightfs_bstore_txn_sync(txn_id);
+
+		spin_lock(&sbi->s_ino_lock);
+		sbi->s_ino_committed = target;
+		spin_unlock(&sbi->s_ino_lock);
+		wake_up_all(&sbi->s_ino_wq);
 	}
+}
 
-	return ret;
+// 1 once the record covers end, the lease error if writing it failed
+static inline int lightfs_ino_lease_state(struct lightfs_sb_info *sbi,
+                                          ino_t end)
+{
+	if (READ_ONCE(sbi->s_ino_committed) >= end)
+		return 1;
+	return READ_ONCE(sbi->s_ino_err);
+}
+
+// get the next available (unused ino)
+// each cpu allocates from its own lease, a lease grows while the cpu
+// refills more often than every 100ms and shrinks after a quiet second.
+// The next_ino record is kept LIGHTFS_INO_PREFETCH ahead by
+// lightfs_ino_lease_work, so a refill normally does not wait for a txn.
+static int lightfs_next_ino(struct lightfs_sb_info *sbi, ino_t *ino)
+{
+	struct lightfs_info *info;
+	ino_t start, end, target;
+	bool kick = false;
+	int ret;
+
+	info = get_cpu_ptr(sbi->s_lightfs_info);
+	if (info->next_ino < info->max_ino) {
+		*ino = info->next_ino++;
+		put_cpu_ptr(sbi->s_lightfs_info);
+		return 0;
+	}
+
+	if (time_before(jiffies, info->refill_time + HZ / 10))
+		info->lease = min_t(unsigned int, info->lease * 2,
+		                    LIGHTFS_INO_LEASE_MAX);
+	else if (time_after(jiffies, info->refill_time + HZ))
+		info->lease = LIGHTFS_INO_LEASE_MIN;
+	info->refill_time = jiffies;
+
+	spin_lock(&sbi->s_ino_lock);
+	start = sbi->s_ino_next;
+	if (start >= LIGHTFS_INO_MAX) {
+		spin_unlock(&sbi->s_ino_lock);
+		put_cpu_ptr(sbi->s_lightfs_info);
+		return -ENOSPC;
+	}
+	end = min_t(ino_t, start + info->lease, LIGHTFS_INO_MAX);
+	sbi->s_ino_next = end;
+	target = min_t(ino_t, end + LIGHTFS_INO_PREFETCH / 2, LIGHTFS_INO_MAX);
+	if (sbi->s_ino_target < target) {
+		sbi->s_ino_target = min_t(ino_t, end + LIGHTFS_INO_PREFETCH,
+		                          LIGHTFS_INO_MAX);
+		sbi->s_ino_err = 0;
+		kick = true;
+	}
+	if (sbi->s_ino_committed >= end) {
+		info->next_ino = start + 1;
+		info->max_ino = end;
+		spin_unlock(&sbi->s_ino_lock);
+		put_cpu_ptr(sbi->s_lightfs_info);
+		goto out;
+	}
+	spin_unlock(&sbi->s_ino_lock);
+	put_cpu_ptr(sbi->s_lightfs_info);
+
+	// the lease ran ahead of the record, wait for it
+	if (kick)
+		schedule_work(&sbi->s_ino_work);
+	kick = false;
+	wait_event(sbi->s_ino_wq, (ret = lightfs_ino_lease_state(sbi, end)));
+	// the numbers of this lease are skipped, never handed out
+	if (ret < 0)
+		return ret;
+
+	// we may run on another cpu now, if its lease is still in use
+	// the rest of ours is skipped, numbers are never reused
+	info = get_cpu_ptr(sbi->s_lightfs_info);
+	if (info->next_ino >= info->max_ino) {
+		info->next_ino = start + 1;
+		info->max_ino = end;
+	}
+	put_cpu_ptr(sbi->s_lightfs_info);
+out:
+	if (kick)
+		schedule_work(&sbi->s_ino_work);
+	*ino = start;
+	return 0;
 }
 
 void copy_meta_dbt_from_ino(DBT *dbt, uint64_t ino)
@@ -443,19 +539,81 @@ static int lightfs_readpage(struct file *file, struct page *page)
 	return ret;
 }
 
+#ifdef READA
+// issue the GET_MULTI of a window, its pages are unlocked on completion
+static void lightfs_reada_submit(struct inode *inode, struct reada_entry *ra_entry)
+{
+	struct lightfs_sb_info *sbi = inode->i_sb->s_fs_info;
+	DB_TXN *txn;
+	int ret;
+
+	lightfs_get_read_lock(LIGHTFS_I(inode));
+	TXN_GOTO_LABEL(retry);
+	lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_READONLY);
+	ret = lightfs_bstore_reada_pages(sbi->data_db, txn, inode, ra_entry);
+	if (ret) {
+		DBOP_JUMP_ON_CONFLICT(ret, retry);
+		lightfs_bstore_txn_abort(txn);
+	} else {
+		ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+		COMMIT_JUMP_ON_CONFLICT(ret, retry);
+	}
+	lightfs_put_read_lock(LIGHTFS_I(inode));
+	if (ret)
+		lightfs_reada_drop(ra_entry);
+}
+#endif
+
+// read the locked pages of lightfs_io with one GET_MULTI, or async gets
+// when they are scattered, and unlock them
+static int lightfs_read_io(struct inode *inode, struct lightfs_io *lightfs_io)
+{
+	struct lightfs_sb_info *sbi = inode->i_sb->s_fs_info;
+	struct lightfs_inode *lightfs_inode = LIGHTFS_I(inode);
+	DBT *meta_dbt;
+	DB_TXN *txn;
+	int ret;
+
+	meta_dbt = lightfs_get_read_lock(lightfs_inode);
+
+	TXN_GOTO_LABEL(retry);
+	lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_READONLY);
+
+#ifdef ASYNC_GET
+	if (lightfs_io_is_sparse(lightfs_io))
+		ret = lightfs_bstore_scan_sparse_pages(sbi->data_db, txn, lightfs_io, inode);
+	else
+#endif
+	ret = lightfs_bstore_scan_pages(sbi->data_db, meta_dbt, txn, lightfs_io, inode);
+
+	if (ret) {
+		DBOP_JUMP_ON_CONFLICT(ret, retry);
+		lightfs_bstore_txn_abort(txn);
+	} else {
+		ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+		COMMIT_JUMP_ON_CONFLICT(ret, retry);
+	}
+
+	lightfs_put_read_lock(lightfs_inode);
+
+	if (ret)
+		lightfs_io_set_pages_error(lightfs_io);
+	else
+		lightfs_io_set_pages_uptodate(lightfs_io);
+	lightfs_io_unlock_pages(lightfs_io);
+
+	return ret;
+}
+
 static int lightfs_readpages(struct file *filp, struct address_space *mapping,
                           struct list_head *pages, unsigned nr_pages)
 {
 	int ret = 0;
-	struct lightfs_sb_info *sbi = mapping->host->i_sb->s_fs_info;
-	struct lightfs_inode *lightfs_inode = LIGHTFS_I(mapping->host);
 	struct lightfs_io *lightfs_io;
-	DBT *meta_dbt = NULL;
-	DB_TXN *txn;
 	struct inode *inode = mapping->host;
-	unsigned buffer_processed_pages = 0, free_ra_entry_num = 0;
-	volatile bool fg_read = true;
+#ifdef READA
 	struct reada_entry *ra_entry;
+#endif
 #ifdef CALL_TRACE_TIME
 	struct time_break tb; 
 	lightfs_tb_init(&tb);
@@ -474,139 +632,16 @@ static int lightfs_readpages(struct file *filp, struct address_space *mapping,
 	}
 	lightfs_io_setup(lightfs_io, pages, nr_pages, mapping);
 
-	/* 
-	 * step1: search the read ahead buffer of issue foreground read
-	 *   case 1: buffer found. ==> service the request
-	 *   case 2: buffer found but partialy ==> issue foreground read 
-	 *   case 3: buffer not found
-	*      case 3-1: read ahead is already issued ==> wait the issued read
-	 *     case 3-2: issue foreground read
-	 * step2: decide whether read ahead is needed or not
-	 *   condition: if requested number of pages to be read is greater/equal than READA_THRESHOLD and start page number of requests is equal last_request_page_number + 1 then, we issue read ahead
-	 */
-
 #ifdef READA
-	list_for_each_entry(ra_entry, &lightfs_inode->ra_list, list) {
-		ret = buffer_processed_pages = lightfs_reada_buffer_get(ra_entry, inode, lightfs_io, nr_pages);
-		buffer_processed_pages += ret;
-		if (ret == ENORA) { // no buffer
-			//fg_read = true;
-			//should_free_ra_entry = false;
-			break;
-		} else if (ret == ESMALL) { // small request
-			//fg_read = true;
-			//should_free_ra_entry = true;
-			break;
-		} else if (ret) { // buffer hit
-			if (ret == nr_pages) {
-				//fg_read = false;
-				//should_free_ra_entry = false;
-				break;
-			} else if (buffer_processed_pages == nr_pages) {
-				//fg_read = false;
-				//should_free_ra_entry = true;
-				break;
-			} else {
-				free_ra_entry_num++;
-			}
-		} else { // buffer miss
-			//fg_read = true;
-			//should_free_ra_entry = true;
-			free_ra_entry_num++;
-		}
-	}
-
-	if (ret == ESMALL) { // all flush
-		//pr_info("ESMALL: %d\n", nr_pages);
-		lightfs_reada_all_flush(inode);
-		fg_read = true;
-	} else if (free_ra_entry_num) { // buffer hit or not
-		lightfs_reada_flush(inode, free_ra_entry_num);
-		fg_read = true;
-	}
-
-	if (buffer_processed_pages == nr_pages) {
-		fg_read = false;
-	}
-
-	/*
-	buffer_processed_pages = lightfs_reada_buffer_get(inode, lightfs_io, nr_pages);
-
-	if (buffer_processed_pages != ENORA) { // buffer exists
-		if (buffer_processed_pages) { // buffer hit
-			if (buffer_processed_pages == nr_pages) { // case 1
-				fg_read = false;
-			} else { // case 2
-				fg_read = true;		
-			}
-		} else { // should free reada case 3: buffer miss
-			lightfs_reada_free(inode);
-			fg_read = true;
-		}
-	} else { // case 3-2: buffer is not occupied
-		fg_read = true;
+	// the readahead, fadvise or madvise WILLNEED does not wait for the pages
+	ra_entry = lightfs_reada_vfs(inode, filp, lightfs_io);
+	if (ra_entry) {
+		lightfs_reada_submit(inode, ra_entry);
+		return 0;
 	}
-	*/
 #endif
 
-	if (fg_read) {
-		meta_dbt = lightfs_get_read_lock(lightfs_inode);
-
-		TXN_GOTO_LABEL(retry);
-		lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_READONLY);
-	
-		ret = lightfs_bstore_scan_pages(sbi->data_db, meta_dbt, txn, lightfs_io, inode);
-
-		if (ret) {
-			DBOP_JUMP_ON_CONFLICT(ret, retry);
-			lightfs_bstore_txn_abort(txn);
-		} else {
-			ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
-			COMMIT_JUMP_ON_CONFLICT(ret, retry);
-		}
-	
-		lightfs_put_read_lock(lightfs_inode);
-	
-		if (ret)
-			lightfs_io_set_pages_error(lightfs_io);
-		else
-			lightfs_io_set_pages_uptodate(lightfs_io);
-		lightfs_io_unlock_pages(lightfs_io);
-	} else {
-		lightfs_io_set_pages_uptodate(lightfs_io);
-		lightfs_io_unlock_pages(lightfs_io);
-	}
-
-#ifdef READA
-	if (lightfs_reada_need(inode, lightfs_io, nr_pages, fg_read)) {
-		volatile bool is_eof = false;
-		unsigned iter = 0, max_reada;
-		spin_lock(&lightfs_inode->reada_spin);
-		max_reada = READA_QD - lightfs_inode->ra_entry_cnt;
-		while (iter < max_reada) {
-			TXN_GOTO_LABEL(retry_reada);
-			lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_READONLY);
-
-			ret = lightfs_bstore_reada_pages(sbi->data_db, meta_dbt, txn, lightfs_io, inode, iter);
-
-			if (ret && ret != EEOF) {
-				DBOP_JUMP_ON_CONFLICT(ret, retry);
-				lightfs_bstore_txn_abort(txn);
-			} else {
-				if (ret == EEOF) {
-					is_eof = true;
-				}
-				ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
-				COMMIT_JUMP_ON_CONFLICT(ret, retry_reada);
-			}
-			if (is_eof) {
-				break;
-			}
-			iter++;
-		}
-		spin_unlock(&lightfs_inode->reada_spin);
-	}
-#endif
+	ret = lightfs_read_io(inode, lightfs_io);
 	lightfs_io_free(lightfs_io);
 
 #ifdef CALL_TRACE_TIME
@@ -672,6 +707,7 @@ lightfs_writepage(struct page *page, struct writeback_control *wbc)
 	pgoff_t end_index;
 	unsigned offset;
 	DB_TXN *txn;
+	uint32_t txn_id;
 #ifdef CALL_TRACE_TIME
 	struct time_break tb; 
 	lightfs_tb_init(&tb);
@@ -709,8 +745,9 @@ lightfs_writepage(struct page *page, struct writeback_control *wbc)
 			mapping_set_error(page->mapping, ret);
 		}
 	} else {
-		ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+		ret = lightfs_bstore_txn_commit_id(txn, DB_TXN_NOSYNC, &txn_id);
 		COMMIT_JUMP_ON_CONFLICT(ret, retry);
+		lightfs_inode_txn_update(inode, txn_id);
 	}
 	
 	//end_page_writeback(page); //WBWB
@@ -736,6 +773,59 @@ struct lightfs_wp_node {
 
 static struct kmem_cache *lightfs_writepages_cachep;
 
+#ifdef EXTENT
+// the count of list pages from it on that fill an extent group: they
+// have to start the group and run to its end or to EOF, else 1
+static unsigned
+lightfs_wp_extent_len(struct lightfs_wp_node *it, int nr_pages,
+                      pgoff_t end_index, unsigned offset)
+{
+	pgoff_t index = it->page->index;
+	pgoff_t last;
+	unsigned i, n;
+
+	if (!end_index && !offset)
+		return 1;
+	last = offset ? end_index : end_index - 1;
+	if ((index & (LIGHTFS_EXTENT_PAGES - 1)) || index > last)
+		return 1;
+	n = min_t(pgoff_t, LIGHTFS_EXTENT_PAGES, last - index + 1);
+	if (n < 2 || n > nr_pages)
+		return 1;
+	for (i = 1; i < n; i++) {
+		it = it->next;
+		if (it->page->index != index + i)
+			return 1;
+	}
+
+	return n;
+}
+
+static int
+__lightfs_writepages_put_extent(struct lightfs_sb_info *sbi, DBT *data_dbt,
+                                DB_TXN *txn, struct lightfs_wp_node *it,
+                                unsigned n, pgoff_t end_index, unsigned offset)
+{
+	struct page **pages;
+	unsigned i;
+	int ret;
+
+	pages = kmalloc_array(n, sizeof(struct page *), GFP_NOIO);
+	if (!pages)
+		return -ENOMEM;
+	for (i = 0; i < n; i++, it = it->next) {
+		pages[i] = it->page;
+		if (pages[i]->index == end_index && offset)
+			zero_user_segment(pages[i], offset, PAGE_SIZE);
+	}
+	ret = lightfs_bstore_put_extent(sbi->data_db, data_dbt, txn, pages, n);
+	if (ret)
+		kfree(pages);
+
+	return ret;
+}
+#endif
+
 static int
 __lightfs_writepages_write_pages(struct lightfs_wp_node *list, int nr_pages,
                               struct writeback_control *wbc,
@@ -751,9 +841,14 @@ __lightfs_writepages_write_pages(struct lightfs_wp_node *list, int nr_pages,
 	DBT *meta_dbt;
 	char *data_key;
 	DB_TXN *txn = NULL;
+	uint32_t txn_id;
+	int txn_pages = 0;
 #ifndef WB
 	char *buf;
 #endif
+#ifdef EXTENT
+	unsigned n;
+#endif
 #ifdef CALL_TRACE_TIME
 	struct time_break tb; 
 	lightfs_tb_init(&tb);
@@ -769,6 +864,7 @@ __lightfs_writepages_write_pages(struct lightfs_wp_node *list, int nr_pages,
 	if (unlikely(!key_is_same_of_key((char *)meta_dbt->data, data_key))) // KOO:key: is it necessary?
 		copy_data_dbt_from_meta_dbt(data_dbt, meta_dbt, 0);
 retry:
+	txn = NULL;
 	i_size = i_size_read(inode);
 	end_index = i_size >> PAGE_SHIFT;
 	offset = i_size & (PAGE_SIZE - 1);
@@ -776,8 +872,9 @@ retry:
 	//lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_MAY_WRITE);
 	// we did a lazy approach about the list, so we need an additional i here
 	for (i = 0, it = list->next; i < nr_pages; i++, it = it->next) {
-		if (!(i % LIGHTFS_TXN_LIMIT)) {
+		if (!txn) {
 			lightfs_bstore_txn_begin(sbi->db_dev, NULL, &txn, TXN_MAY_WRITE);
+			txn_pages = 0;
 		}
 		page = it->page;
 		lightfs_data_key_set_blocknum(data_key, data_dbt->size,
@@ -795,6 +892,17 @@ retry:
 			ret = 0;
 		kunmap_atomic(buf); //WBWB
 #else
+#ifdef EXTENT
+		n = lightfs_wp_extent_len(it, nr_pages - i, end_index, offset);
+		if (n > 1) {
+			ret = __lightfs_writepages_put_extent(sbi, data_dbt, txn,
+			                                      it, n, end_index,
+			                                      offset);
+			// the loop steps over the last page of the extent
+			for (; n > 1; n--, i++, txn_pages++)
+				it = it->next;
+		} else
+#endif
 		if (page->index < end_index)
 			ret = lightfs_bstore_put_page(sbi->data_db, data_dbt, txn, page, PAGE_SIZE, is_seq);
 
@@ -813,16 +921,18 @@ retry:
 			lightfs_bstore_txn_abort(txn);
 			goto out;
 		}
-		if ((i % LIGHTFS_TXN_LIMIT) == LIGHTFS_TXN_LIMIT-1) {
-			ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+		if (++txn_pages >= LIGHTFS_TXN_LIMIT) {
+			ret = lightfs_bstore_txn_commit_id(txn, DB_TXN_NOSYNC, &txn_id);
 			COMMIT_JUMP_ON_CONFLICT(ret, retry);
+			lightfs_inode_txn_update(inode, txn_id);
 			txn = NULL;
 		}
 
 	}
 	if (txn) {
-		ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+		ret = lightfs_bstore_txn_commit_id(txn, DB_TXN_NOSYNC, &txn_id);
 		COMMIT_JUMP_ON_CONFLICT(ret, retry);
+		lightfs_inode_txn_update(inode, txn_id);
 	}
 out:
 	lightfs_put_read_lock(LIGHTFS_I(inode));
@@ -843,87 +953,81 @@ out:
 	return ret;
 }
 
-/**
- * (mostly) copied from write_cache_pages
- *
- * however, instead of calling mm/page-writeback.c:__writepage, we
- * detect large I/Os and potentially issue a special seq_put to our
- * B^e tree
+#define LIGHTFS_WB_CHUNK_PAGES 1024
+#define LIGHTFS_WB_WORKERS 16
+
+static struct workqueue_struct *lightfs_wb_workq;
+
+// shared by the flusher and the wb workers writing back one range
+struct lightfs_wb_ctx {
+	struct address_space *mapping;
+	struct writeback_control *wbc;
+	int tag;
+	atomic_long_t nr_to_write;
+	// chunks start below last, the final one ends at end
+	atomic_long_t next_index;
+	pgoff_t last, end;
+	atomic_t pending;
+	struct completion finished;
+	spinlock_t lock;
+	int ret;
+	int done;
+	pgoff_t done_index;
+	long pages_skipped;
+};
+
+struct lightfs_wb_work {
+	struct work_struct work;
+	struct lightfs_wb_ctx *ctx;
+};
+
+static int lightfs_wb_dbt_alloc(struct inode *inode, DBT *data_dbt)
+{
+	int ret;
+
+	lightfs_get_read_lock(LIGHTFS_I(inode));
+	ret = dbt_alloc(data_dbt, DATA_KEY_MAX_LEN);
+	if (!ret)
+		copy_data_dbt_from_inode(data_dbt, inode, 0);
+	lightfs_put_read_lock(LIGHTFS_I(inode));
+
+	return ret;
+}
+
+/*
+ * the page loop of write_cache_pages for [index, end], the tagged pages
+ * are written in batches of
+ * LIGHTFS_WRITEPAGES_LIST_SIZE, every page stays locked until the txn
+ * holding it is committed. *done is set when nr_to_write runs out and
+ * *done_index is where the next writeback should start.
  */
-static int lightfs_writepages(struct address_space *mapping,
-			struct writeback_control *wbc)
+static int __lightfs_writepages_range(struct lightfs_wb_ctx *ctx,
+                                      struct writeback_control *wbc,
+                                      DBT *data_dbt, pgoff_t index,
+                                      pgoff_t end, pgoff_t *done_index,
+                                      int *done)
 {
 	int ret = 0;
-	int done = 0;
 	struct pagevec pvec;
 	int nr_pages;
-	pgoff_t uninitialized_var(writeback_index);
-	pgoff_t index;
-	pgoff_t end;		/* Inclusive */
-	pgoff_t done_index, txn_done_index;
-	int cycled;
-	int range_whole = 0;
-	int tag;
-	//int is_seq = 0;
-	struct inode *inode;
-	struct lightfs_sb_info *sbi;
-	DBT *meta_dbt, data_dbt;
+	pgoff_t txn_done_index;
+	struct address_space *mapping = ctx->mapping;
+	struct inode *inode = mapping->host;
+	struct lightfs_sb_info *sbi = inode->i_sb->s_fs_info;
 	int nr_list_pages;
 	struct lightfs_wp_node list, *tail, *it;
-#ifdef CALL_TRACE_TIME
-	struct time_break tb; 
-	lightfs_tb_init(&tb);
-	lightfs_tb_check(&tb);
-#endif
-
-#ifdef CALL_TRACE
-	lightfs_error(__func__, "\n");
-#endif
 
 	pagevec_init(&pvec);
-	if (wbc->range_cyclic) {
-		writeback_index = mapping->writeback_index; /* prev offset */
-		index = writeback_index;
-		if (index == 0)
-			cycled = 1;
-		else
-			cycled = 0;
-		end = -1;
-	} else {
-		index = wbc->range_start >> PAGE_SHIFT;
-		end = wbc->range_end >> PAGE_SHIFT;
-		if (wbc->range_start == 0 && wbc->range_end == LLONG_MAX)
-			range_whole = 1;
-		cycled = 1; /* ignore range_cyclic tests */
-	}
-	if (wbc->sync_mode == WB_SYNC_ALL || wbc->tagged_writepages)
-		tag = PAGECACHE_TAG_TOWRITE;
-	else
-		tag = PAGECACHE_TAG_DIRTY;
-retry:
-	if (wbc->sync_mode == WB_SYNC_ALL || wbc->tagged_writepages)
-		tag_pages_for_writeback(mapping, index, end);
-	done_index = index;
+	*done_index = index;
 	txn_done_index = index;
 
-	inode = mapping->host;
-	sbi = inode->i_sb->s_fs_info;
-	meta_dbt = lightfs_get_read_lock(LIGHTFS_I(inode));
-	ret = dbt_alloc(&data_dbt, DATA_KEY_MAX_LEN);
-	if (ret) {
-		lightfs_put_read_lock(LIGHTFS_I(inode));
-		goto out;
-	}
-	//copy_data_dbt_from_meta_dbt(&data_dbt, meta_dbt, 0); //TODO:key
-	copy_data_dbt_from_inode(&data_dbt, inode, 0);
-	lightfs_put_read_lock(LIGHTFS_I(inode));
-
 	nr_list_pages = 0;
 	list.next = NULL;
 	tail = &list;
-	while (!done && (index <= end)) {
+	while (!*done && (index <= end)) {
 		int i;
-		nr_pages = pagevec_lookup_range_tag(&pvec, mapping, &index, end, tag);
+		nr_pages = pagevec_lookup_range_tag(&pvec, mapping, &index, end,
+		                                    ctx->tag);
 		if (nr_pages == 0)
 			break;
 
@@ -931,7 +1035,7 @@ retry:
 			struct page *page = pvec.pages[i];
 
 			if (page->index > end) {
-				done = 1;
+				*done = 1;
 				break;
 			}
 
@@ -973,17 +1077,19 @@ continue_unlock:
 			if (nr_list_pages >= LIGHTFS_WRITEPAGES_LIST_SIZE) {
 				ret = __lightfs_writepages_write_pages(&list,
 					nr_list_pages, wbc, inode, sbi,
-					&data_dbt, 0);
-				if (ret)
-					goto free_dkey_out;
-				done_index = txn_done_index;
+					data_dbt, 0);
+				if (ret) {
+					pagevec_release(&pvec);
+					goto free_list_out;
+				}
+				*done_index = txn_done_index;
 				nr_list_pages = 0;
 				tail = &list;
 			}
 
-			if (--wbc->nr_to_write <= 0 &&
+			if (atomic_long_dec_return(&ctx->nr_to_write) <= 0 &&
 			    wbc->sync_mode == WB_SYNC_NONE) {
-				done = 1;
+				*done = 1;
 				break;
 			}
 		}
@@ -993,25 +1099,215 @@ continue_unlock:
 
 	if (nr_list_pages > 0) {
 		ret = __lightfs_writepages_write_pages(&list, nr_list_pages, wbc,
-			inode, sbi, &data_dbt, 0);
+			inode, sbi, data_dbt, 0);
 		if (!ret)
-			done_index = txn_done_index;
+			*done_index = txn_done_index;
 	}
-free_dkey_out:
-	dbt_destroy(&data_dbt);
+free_list_out:
 	tail = list.next;
 	while (tail != NULL) {
 		it = tail->next;
 		kmem_cache_free(lightfs_writepages_cachep, tail);
 		tail = it;
 	}
+	return ret;
+}
+
+// claim chunks of the range until it is written back or the budget ends
+static void lightfs_wb_run_chunks(struct lightfs_wb_ctx *ctx)
+{
+	struct writeback_control wbc = *ctx->wbc;
+	DBT data_dbt;
+	pgoff_t index, end, done_index = 0;
+	int ret, done = 0;
+
+	wbc.pages_skipped = 0;
+	ret = lightfs_wb_dbt_alloc(ctx->mapping->host, &data_dbt);
+	if (ret)
+		goto out;
+	while (!done && !READ_ONCE(ctx->done)) {
+		index = atomic_long_add_return(LIGHTFS_WB_CHUNK_PAGES,
+		                               &ctx->next_index) -
+		        LIGHTFS_WB_CHUNK_PAGES;
+		if (index > ctx->last)
+			break;
+		end = index + LIGHTFS_WB_CHUNK_PAGES - 1;
+		if (end >= ctx->last)
+			end = ctx->end;
+		ret = __lightfs_writepages_range(ctx, &wbc, &data_dbt, index,
+		                                 end, &done_index, &done);
+		if (ret)
+			break;
+	}
+	dbt_destroy(&data_dbt);
 out:
-	if (!cycled && !done) {
+	spin_lock(&ctx->lock);
+	if (ret && !ctx->ret)
+		ctx->ret = ret;
+	if ((ret || done) &&
+	    (!ctx->done || done_index < ctx->done_index)) {
+		WRITE_ONCE(ctx->done, 1);
+		ctx->done_index = done_index;
+	}
+	ctx->pages_skipped += wbc.pages_skipped;
+	spin_unlock(&ctx->lock);
+
+	if (atomic_dec_and_test(&ctx->pending))
+		complete(&ctx->finished);
+}
+
+static void lightfs_wb_work_fn(struct work_struct *work)
+{
+	struct lightfs_wb_work *wb_work =
+		container_of(work, struct lightfs_wb_work, work);
+
+	lightfs_wb_run_chunks(wb_work->ctx);
+}
+
+// workers for [index, end], a range shorter than two chunks (or
+// a budget that small) stays on the flusher
+static int lightfs_wb_nr_workers(struct lightfs_wb_ctx *ctx, pgoff_t index,
+                                 pgoff_t end)
+{
+	loff_t i_size = i_size_read(ctx->mapping->host);
+	pgoff_t last, span;
+	long budget;
+
+	if (!lightfs_wb_workq || i_size == 0)
+		return 1;
+	last = (i_size - 1) >> PAGE_SHIFT;
+	if (last > end)
+		last = end;
+	if (index > last)
+		return 1;
+	span = last - index + 1;
+	budget = atomic_long_read(&ctx->nr_to_write);
+	if (ctx->wbc->sync_mode == WB_SYNC_NONE && budget < (long)span)
+		span = budget > 0 ? budget : 0;
+
+	return clamp_t(pgoff_t, span / LIGHTFS_WB_CHUNK_PAGES, 1,
+	               min_t(pgoff_t, LIGHTFS_WB_WORKERS, num_online_cpus()));
+}
+
+/*
+ * Write back [index, end]. A large range is split into chunks of
+ * LIGHTFS_WB_CHUNK_PAGES that the flusher and up to LIGHTFS_WB_WORKERS-1
+ * workers claim in order, so page gathering and txn building run on
+ * several cpus. Chunks lock their pages until commit like the serial
+ * path, so truncate_pagecache still waits for them, and we return only
+ * when all chunks are done, so fsync sees every txn id.
+ */
+static int lightfs_writepages_range(struct lightfs_wb_ctx *ctx, pgoff_t index,
+                                    pgoff_t end, pgoff_t *done_index,
+                                    int *done)
+{
+	struct lightfs_wb_work *works;
+	DBT data_dbt;
+	int i, ret, nr_workers;
+
+	nr_workers = lightfs_wb_nr_workers(ctx, index, end);
+	works = NULL;
+	if (nr_workers > 1)
+		works = kmalloc_array(nr_workers - 1, sizeof(*works), GFP_NOFS);
+	if (!works) {
+		ret = lightfs_wb_dbt_alloc(ctx->mapping->host, &data_dbt);
+		if (ret)
+			return ret;
+		ret = __lightfs_writepages_range(ctx, ctx->wbc, &data_dbt, index,
+		                                 end, done_index, done);
+		dbt_destroy(&data_dbt);
+		return ret;
+	}
+
+	atomic_long_set(&ctx->next_index, index);
+	ctx->last = min_t(pgoff_t, end,
+	                  (i_size_read(ctx->mapping->host) - 1) >> PAGE_SHIFT);
+	ctx->end = end;
+	atomic_set(&ctx->pending, nr_workers);
+	init_completion(&ctx->finished);
+	ctx->ret = 0;
+	ctx->done = 0;
+	ctx->pages_skipped = 0;
+	for (i = 0; i < nr_workers - 1; i++) {
+		INIT_WORK(&works[i].work, lightfs_wb_work_fn);
+		works[i].ctx = ctx;
+		queue_work(lightfs_wb_workq, &works[i].work);
+	}
+	lightfs_wb_run_chunks(ctx);
+	wait_for_completion(&ctx->finished);
+	kfree(works);
+
+	ctx->wbc->pages_skipped += ctx->pages_skipped;
+	*done = ctx->done;
+	*done_index = ctx->done ? ctx->done_index : ctx->last;
+	return ctx->ret;
+}
+
+/**
+ * (mostly) copied from write_cache_pages
+ *
+ * however, instead of calling mm/page-writeback.c:__writepage, we
+ * detect large I/Os and potentially issue a special seq_put to our
+ * B^e tree
+ */
+static int lightfs_writepages(struct address_space *mapping,
+			struct writeback_control *wbc)
+{
+	int ret = 0;
+	int done = 0;
+	pgoff_t uninitialized_var(writeback_index);
+	pgoff_t index;
+	pgoff_t end;		/* Inclusive */
+	pgoff_t done_index;
+	int cycled;
+	int range_whole = 0;
+	struct lightfs_wb_ctx ctx;
+#ifdef CALL_TRACE_TIME
+	struct time_break tb; 
+	lightfs_tb_init(&tb);
+	lightfs_tb_check(&tb);
+#endif
+
+#ifdef CALL_TRACE
+	lightfs_error(__func__, "\n");
+#endif
+
+	ctx.mapping = mapping;
+	ctx.wbc = wbc;
+	atomic_long_set(&ctx.nr_to_write, wbc->nr_to_write);
+	spin_lock_init(&ctx.lock);
+	if (wbc->range_cyclic) {
+		writeback_index = mapping->writeback_index; /* prev offset */
+		index = writeback_index;
+		if (index == 0)
+			cycled = 1;
+		else
+			cycled = 0;
+		end = -1;
+	} else {
+		index = wbc->range_start >> PAGE_SHIFT;
+		end = wbc->range_end >> PAGE_SHIFT;
+		if (wbc->range_start == 0 && wbc->range_end == LLONG_MAX)
+			range_whole = 1;
+		cycled = 1; /* ignore range_cyclic tests */
+	}
+	if (wbc->sync_mode == WB_SYNC_ALL || wbc->tagged_writepages)
+		ctx.tag = PAGECACHE_TAG_TOWRITE;
+	else
+		ctx.tag = PAGECACHE_TAG_DIRTY;
+retry:
+	if (wbc->sync_mode == WB_SYNC_ALL || wbc->tagged_writepages)
+		tag_pages_for_writeback(mapping, index, end);
+
+	ret = lightfs_writepages_range(&ctx, index, end, &done_index, &done);
+
+	if (!ret && !cycled && !done) {
 		cycled = 1;
 		index = 0;
 		end = writeback_index - 1;
 		goto retry;
 	}
+	wbc->nr_to_write = atomic_long_read(&ctx.nr_to_write);
 	if (wbc->range_cyclic || (range_whole && wbc->nr_to_write > 0))
 		mapping->writeback_index = done_index;
 
@@ -1178,33 +1474,220 @@ lightfs_write_end(struct file *file, struct address_space *mapping,
 	}
 
 
-#ifdef CALL_TRACE_TIME
-	lightfs_tb_check(&tb);
-#endif
-	if (old_size < pos)
-		pagecache_isize_extended(inode, old_size, pos);
+#ifdef CALL_TRACE_TIME
+	lightfs_tb_check(&tb);
+#endif
+	if (old_size < pos)
+		pagecache_isize_extended(inode, old_size, pos);
+
+	if (i_size_changed) {
+		mark_inode_dirty(inode);
+	}
+	unlock_page(page);
+	put_page(page);
+#ifdef CALL_TRACE_TIME
+	lightfs_tb_check(&tb);
+	lightfs_tb_print(__func__, &tb);
+#endif
+	return copied;
+}
+
+/* Called before freeing a page - it writes back the dirty page.
+ *
+ * To prevent redirtying the page, it is kept locked during the whole
+ * operation.
+ */
+static int lightfs_launder_page(struct page *page)
+{
+	printk(KERN_CRIT "laundering page.\n");
+	BUG();
+}
+
+// pages per batch of O_DIRECT: one GET_MULTI or one txn (< LIGHTFS_TXN_LIMIT)
+#define LIGHTFS_DIO_PAGES 256
+
+static ssize_t lightfs_direct_read(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct inode *inode = file_inode(iocb->ki_filp);
+	struct lightfs_sb_info *sbi = inode->i_sb->s_fs_info;
+	loff_t pos = iocb->ki_pos, size = i_size_read(inode);
+	struct page **pages;
+	DB_TXN *txn;
+	ssize_t len, done = 0;
+	size_t start, copied;
+	unsigned nr_pages, i;
+	int ret = 0;
+
+	if (pos >= size)
+		return 0;
+
+	// blocks of this file still in running txns are not visible to GETs
+	lightfs_bstore_txn_sync(READ_ONCE(LIGHTFS_I(inode)->last_txn_id));
+
+	pages = kmalloc_array(LIGHTFS_DIO_PAGES, sizeof(struct page *), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	while (iov_iter_count(iter) && pos < size) {
+		len = iov_iter_get_pages(iter, pages, round_up(size - pos, PAGE_SIZE),
+		                         LIGHTFS_DIO_PAGES, &start);
+		if (len <= 0) {
+			ret = len;
+			break;
+		}
+		nr_pages = len >> PAGE_SHIFT;
+
+		lightfs_get_read_lock(LIGHTFS_I(inode));
+		TXN_GOTO_LABEL(retry);
+		lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_READONLY);
+		ret = lightfs_bstore_scan_user_pages(sbi->data_db, txn, inode,
+		                                     block_get_num_by_position(pos),
+		                                     pages, nr_pages);
+		if (ret) {
+			DBOP_JUMP_ON_CONFLICT(ret, retry);
+			lightfs_bstore_txn_abort(txn);
+		} else {
+			ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+			COMMIT_JUMP_ON_CONFLICT(ret, retry);
+		}
+		lightfs_put_read_lock(LIGHTFS_I(inode));
+
+		for (i = 0; i < nr_pages; i++) {
+			if (!ret && iter_is_iovec(iter))
+				set_page_dirty_lock(pages[i]);
+			put_page(pages[i]);
+		}
+		if (ret)
+			break;
+
+		copied = min_t(loff_t, len, size - pos);
+		iov_iter_advance(iter, copied);
+		done += copied;
+		pos += copied;
+	}
+	kfree(pages);
+
+	return done ? done : ret;
+}
+
+static int
+lightfs_direct_write_pages(struct lightfs_sb_info *sbi, struct inode *inode,
+                           loff_t pos, struct page **pages, unsigned nr_pages)
+{
+	uint64_t block_num = block_get_num_by_position(pos);
+	DBT data_dbt;
+	DB_TXN *txn;
+	uint32_t txn_id;
+	unsigned i;
+	char *buf;
+	int ret;
+
+	ret = alloc_data_dbt_from_inode(&data_dbt, inode, block_num);
+	if (ret)
+		return ret;
+
+	TXN_GOTO_LABEL(retry);
+	lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_MAY_WRITE);
+	for (i = 0; i < nr_pages; i++) {
+		lightfs_data_key_set_blocknum(data_dbt.data, data_dbt.size, block_num + i);
+		// DATA_SET copies the block into the txn, the user page is not kept
+		buf = kmap(pages[i]);
+		ret = lightfs_bstore_put(sbi->data_db, &data_dbt, txn, buf, PAGE_SIZE, 0);
+		kunmap(pages[i]);
+		if (ret)
+			break;
+	}
+	if (ret) {
+		DBOP_JUMP_ON_CONFLICT(ret, retry);
+		lightfs_bstore_txn_abort(txn);
+	} else {
+		ret = lightfs_bstore_txn_commit_id(txn, DB_TXN_NOSYNC, &txn_id);
+		COMMIT_JUMP_ON_CONFLICT(ret, retry);
+		lightfs_inode_txn_update(inode, txn_id);
+	}
+	dbt_destroy(&data_dbt);
+
+	return ret;
+}
+
+static ssize_t lightfs_direct_write(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct inode *inode = file_inode(iocb->ki_filp);
+	struct lightfs_sb_info *sbi = inode->i_sb->s_fs_info;
+	loff_t pos = iocb->ki_pos;
+	struct page **pages;
+	ssize_t len, done = 0;
+	size_t start;
+	unsigned nr_pages, i;
+	int ret = 0;
+
+	pages = kmalloc_array(LIGHTFS_DIO_PAGES, sizeof(struct page *), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	// direct reads run without i_rwsem, let those in flight finish first
+	inode_dio_wait(inode);
+	while (iov_iter_count(iter)) {
+		len = iov_iter_get_pages(iter, pages, iov_iter_count(iter),
+		                         LIGHTFS_DIO_PAGES, &start);
+		if (len <= 0) {
+			ret = len;
+			break;
+		}
+		nr_pages = len >> PAGE_SHIFT;
+
+		lightfs_get_read_lock(LIGHTFS_I(inode));
+		ret = lightfs_direct_write_pages(sbi, inode, pos, pages, nr_pages);
+		lightfs_put_read_lock(LIGHTFS_I(inode));
+
+		for (i = 0; i < nr_pages; i++)
+			put_page(pages[i]);
+		if (ret)
+			break;
 
-	if (i_size_changed) {
-		mark_inode_dirty(inode);
+		iov_iter_advance(iter, len);
+		done += len;
+		pos += len;
 	}
-	unlock_page(page);
-	put_page(page);
-#ifdef CALL_TRACE_TIME
-	lightfs_tb_check(&tb);
-	lightfs_tb_print(__func__, &tb);
+	kfree(pages);
+
+	if (done) {
+		/*
+		 * The caller drops the cached pages after we return, so a
+		 * buffered read must find the blocks on the device. Read-ahead
+		 * windows issued before the sync are dropped too.
+		 */
+		lightfs_bstore_txn_sync(READ_ONCE(LIGHTFS_I(inode)->last_txn_id));
+#ifdef READA
+		lightfs_reada_cancel(inode, true);
 #endif
-	return copied;
+	}
+
+	return done ? done : ret;
 }
 
-/* Called before freeing a page - it writes back the dirty page.
- *
- * To prevent redirtying the page, it is kept locked during the whole
- * operation.
+/*
+ * Page-aligned O_DIRECT I/O goes to the device from the user pages. For
+ * anything else we return 0 and the generic code falls back to the page
+ * cache. The generic code also writes back and drops cached pages of the
+ * range around this call.
  */
-static int lightfs_launder_page(struct page *page)
+static ssize_t lightfs_direct_IO(struct kiocb *iocb, struct iov_iter *iter)
 {
-	printk(KERN_CRIT "laundering page.\n");
-	BUG();
+	struct inode *inode = file_inode(iocb->ki_filp);
+	ssize_t ret;
+
+	if ((iocb->ki_pos | iov_iter_alignment(iter)) & ~PAGE_MASK)
+		return 0;
+
+	if (iov_iter_rw(iter) == READ) {
+		inode_dio_begin(inode);
+		ret = lightfs_direct_read(iocb, iter);
+		inode_dio_end(inode);
+		return ret;
+	}
+	// writes hold i_rwsem like truncate and fallocate
+	return lightfs_direct_write(iocb, iter);
 }
 
 static int lightfs_rename(struct inode *old_dir, struct dentry *old_dentry,
@@ -1218,6 +1701,7 @@ static int lightfs_rename(struct inode *old_dir, struct dentry *old_dentry,
 	    *new_inode_meta_dbt;
 	struct lightfs_metadata old_meta;
 	DB_TXN *txn;
+	uint32_t txn_id;
 #ifdef CALL_TRACE_TIME
 	struct time_break tb; 
 	lightfs_tb_init(&tb);
@@ -1249,6 +1733,13 @@ static int lightfs_rename(struct inode *old_dir, struct dentry *old_dentry,
 		goto abort;
 	}
 
+	if (S_ISDIR(old_inode->i_mode)) {
+		// its cache entry is dropped below, read its children first
+		ret = lightfs_bstore_meta_load_dir(sbi->meta_db, txn, old_inode);
+		if (ret)
+			goto abort;
+	}
+
 	if (new_inode) { // New file already exists
 		if (S_ISDIR(old_inode->i_mode)) { // and it is a directory
 			if (!S_ISDIR(new_inode->i_mode)) { // and it is a file
@@ -1291,8 +1782,11 @@ static int lightfs_rename(struct inode *old_dir, struct dentry *old_dentry,
 		goto abort1;
 	}
 
-	ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+	ret = lightfs_bstore_txn_commit_id(txn, DB_TXN_NOSYNC, &txn_id);
 	COMMIT_JUMP_ON_CONFLICT(ret, retry);
+	lightfs_inode_txn_update(old_inode, txn_id);
+	lightfs_inode_txn_update(old_dir, txn_id);
+	lightfs_inode_txn_update(new_dir, txn_id);
 
 	dbt_destroy(old_meta_dbt);
 	dbt_copy(old_meta_dbt, &new_meta_dbt);
@@ -1370,15 +1864,31 @@ static int lightfs_readdir(struct file *file, struct dir_context *ctx)
 	}
 
 	if (ctx->pos == 2) {
+		lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_READONLY);
+		ret = lightfs_bstore_meta_load_dir(sbi->meta_db, txn, inode);
+		lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+		if (ret)
+			return ret;
 		dir_ctx = kmalloc(sizeof(struct readdir_ctx), GFP_NOIO); 
+		if (!dir_ctx)
+			return -ENOMEM;
+		dir_ctx->emit_cnt = 0;
+#ifndef DISABLE_DCACHE
+		// every child is cached now, list them from the dcache in
+		// batches without a cursor
+		dir_ctx->cursor = NULL;
+		dir_ctx->pos = 4;
+		dir_ctx->batch_len = dir_ctx->batch_off = 0;
+		dir_ctx->batch_end = false;
+		dir_ctx->last_name[0] = '\0';
+		ctx->pos = (loff_t)dir_ctx;
+#else
 		ret = sbi->cache_db->cursor(sbi->cache_db, txn, &cursor, LIGHTFS_META_CURSOR);
 		if (ret) {
 			kfree(dir_ctx);
 			return 0;
 		}
 		dir_ctx->cursor = cursor;
-		dir_ctx->emit_cnt = 0;
-#ifdef DISABLE_DCACHE
 		lightfs_bstore_txn_begin(dbi->db_env, NULL, &txn, TXN_READONLY);
 		ret = sbi->meta_db->cursor(sbi->meta_db, txn, &dcursor, LIGHTFS_META_CURSOR);
 		dir_ctx->dcursor = dcursor;
@@ -1394,7 +1904,8 @@ static int lightfs_readdir(struct file *file, struct dir_context *ctx)
 		dir_ctx = (struct readdir_ctx *)(ctx->pos);
 		if (dir_ctx->pos == 0) { // all cache hit
 			//lightfs_error(__func__, "dcache free!!!! dir_ctx: %px, dir_ctx->pos: %d, dir->cursor: %p, emit_cnt: %d\n", dir_ctx, dir_ctx->pos, dir_ctx->cursor, dir_ctx->emit_cnt);
-			dir_ctx->cursor->c_close(dir_ctx->cursor);
+			if (dir_ctx->cursor)
+				dir_ctx->cursor->c_close(dir_ctx->cursor);
 #ifdef DISABLE_DCACHE
 			dir_ctx->dcursor->c_close(dir_ctx->dcursor);
 			lightfs_bstore_txn_commit(dir_ctx->txn, DB_TXN_NOSYNC);
@@ -1430,7 +1941,10 @@ static int lightfs_readdir(struct file *file, struct dir_context *ctx)
 		}
 	}
 
-	ret = lightfs_bstore_meta_readdir(sbi->meta_db, meta_dbt, txn, ctx, inode, dir_ctx);
+	if (dir_ctx->pos == 4) // listing from the dcache
+		ret = lightfs_bstore_meta_readdir_cached(sbi->meta_db, meta_dbt, ctx, dir_ctx);
+	else
+		ret = lightfs_bstore_meta_readdir(sbi->meta_db, meta_dbt, txn, ctx, inode, dir_ctx);
 
 #ifdef CALL_TRACE_TIME
 	lightfs_tb_check(&tb);
@@ -1439,15 +1953,18 @@ static int lightfs_readdir(struct file *file, struct dir_context *ctx)
 	return ret;
 }
 
+/*
+ * Writeback and write_inode commit ordinary (group committed) txns and
+ * record their ids in the inode, fsync only waits for the newest of them
+ * to be acked. fdatasync skips the metadata unless it is I_DIRTY_DATASYNC
+ * (i_size and the like). Writeback errors since the last fsync of this
+ * file are reported at the end.
+ */
 static int
 lightfs_fsync(struct file *file, loff_t start, loff_t end, int datasync)
 {
-	int ret;
-	struct lightfs_sb_info *sbi = file_inode(file)->i_sb->s_fs_info;
+	int ret, err;
 	struct inode *inode = file_inode(file);
-	DBT *meta_dbt;
-	struct lightfs_metadata meta;
-	DB_TXN *txn;
 #ifdef CALL_TRACE_TIME
 	struct time_break tb; 
 	lightfs_tb_init(&tb);
@@ -1460,29 +1977,22 @@ lightfs_fsync(struct file *file, loff_t start, loff_t end, int datasync)
 
 	//ret = generic_file_fsync(file, start, end, datasync);
 	ret = filemap_fdatawrite_range(file->f_mapping, start, end);
+	if (ret)
+		goto out;
 
-	if (!ret && !datasync) {
-		meta_dbt = lightfs_get_read_lock(LIGHTFS_I(inode));
-		lightfs_copy_metadata_from_inode(&meta, inode);
-		TXN_GOTO_LABEL(retry);
-#ifdef GROUP_COMMIT
-		lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_SYNC_WRITE);
-		//lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_MAY_WRITE);
-		ret = lightfs_bstore_meta_put(sbi->meta_db, meta_dbt, txn, &meta, inode, false);
-#else
-		lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_MAY_WRITE);
-		ret = lightfs_bstore_meta_sync_put(sbi->meta_db, meta_dbt, txn, &meta, inode, false);
-#endif
-		if (ret) {
-			DBOP_JUMP_ON_CONFLICT(ret, retry);
-			lightfs_bstore_txn_abort(txn);
-		} else {
-			ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
-			COMMIT_JUMP_ON_CONFLICT(ret, retry);
-		}
-		lightfs_put_read_lock(LIGHTFS_I(inode));
+	if (!datasync || (inode->i_state & I_DIRTY_DATASYNC)) {
+		ret = sync_inode_metadata(inode, 1);
+		if (ret)
+			goto out;
 	}
 
+	ret = lightfs_bstore_txn_sync(READ_ONCE(LIGHTFS_I(inode)->last_txn_id));
+
+out:
+	err = file_check_and_advance_wb_err(file);
+	if (!ret)
+		ret = err;
+
 #ifdef CALL_TRACE_TIME
 	lightfs_tb_check(&tb);
 	lightfs_tb_print(__func__, &tb);
@@ -1490,6 +2000,216 @@ lightfs_fsync(struct file *file, loff_t start, loff_t end, int datasync)
 	return ret;
 }
 
+// read page index into the cache, zero [from, to) of it and leave it to
+// writeback
+static int
+lightfs_dirty_page(struct inode *inode, pgoff_t index, unsigned from, unsigned to)
+{
+	struct page *page;
+
+	page = read_mapping_page(inode->i_mapping, index, NULL);
+	if (IS_ERR(page))
+		return PTR_ERR(page);
+	lock_page(page);
+	if (from < to)
+		zero_user_segment(page, from, to);
+	set_page_dirty(page);
+	unlock_page(page);
+	put_page(page);
+
+	return 0;
+}
+
+/*
+ * Zero [start, end) of a file below i_size. Partial blocks at the edges
+ * are zeroed in the page cache, whole blocks are dropped from the cache
+ * and deleted with DEL_MULTI, so they read back as holes.
+ */
+static int lightfs_punch_hole(struct inode *inode, loff_t start, loff_t end)
+{
+	struct lightfs_sb_info *sbi = inode->i_sb->s_fs_info;
+	loff_t size = i_size_read(inode);
+	loff_t first = round_up(start, PAGE_SIZE);
+	loff_t last = (end == size) ? round_up(end, PAGE_SIZE) : round_down(end, PAGE_SIZE);
+	int ret = 0;
+
+	// an O_DIRECT read in flight could still return the old blocks
+	inode_dio_wait(inode);
+	if (first > last)
+		return lightfs_dirty_page(inode, start >> PAGE_SHIFT,
+		                          start & ~PAGE_MASK, end & ~PAGE_MASK);
+	if (start < first)
+		ret = lightfs_dirty_page(inode, start >> PAGE_SHIFT,
+		                         start & ~PAGE_MASK, PAGE_SIZE);
+	if (!ret && last < end)
+		ret = lightfs_dirty_page(inode, last >> PAGE_SHIFT, 0, end - last);
+	if (ret || first == last)
+		return ret;
+
+	truncate_pagecache_range(inode, first, last - 1);
+	lightfs_get_read_lock(LIGHTFS_I(inode));
+	ret = lightfs_bstore_del_range(sbi->data_db, inode,
+	                               block_get_num_by_position(first),
+	                               (last - first) >> PAGE_SHIFT);
+	lightfs_put_read_lock(LIGHTFS_I(inode));
+#ifdef READA
+	lightfs_reada_cancel(inode, true);
+#endif
+
+	return ret;
+}
+
+/*
+ * Preallocation only moves i_size (unless FALLOC_FL_KEEP_SIZE): blocks
+ * that were never written read back as zeroes, so nothing is stored.
+ * PUNCH_HOLE and ZERO_RANGE both delete the range.
+ */
+static long
+lightfs_fallocate(struct file *file, int mode, loff_t offset, loff_t len)
+{
+	struct inode *inode = file_inode(file);
+	loff_t end = offset + len;
+	loff_t size;
+	int ret = 0;
+
+#ifdef CALL_TRACE
+	lightfs_error(__func__, "path: %s\n", file->f_path.dentry->d_name.name);
+#endif
+
+	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE))
+		return -EOPNOTSUPP;
+
+	inode_lock(inode);
+	size = i_size_read(inode);
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && end > size) {
+		ret = inode_newsize_ok(inode, end);
+		if (ret)
+			goto out;
+	}
+
+	if ((mode & (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE)) && offset < size) {
+		ret = lightfs_punch_hole(inode, offset, min(end, size));
+		if (ret)
+			goto out;
+	}
+
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && end > size) {
+		// the tail of the old last block may still hold truncated data
+		if (size & ~PAGE_MASK) {
+			ret = lightfs_dirty_page(inode, size >> PAGE_SHIFT,
+			                         size & ~PAGE_MASK, PAGE_SIZE);
+			if (ret)
+				goto out;
+		}
+		i_size_write(inode, end);
+		pagecache_isize_extended(inode, size, end);
+	} else if (!(mode & (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE)))
+		goto out;
+
+	inode->i_mtime = inode->i_ctime = current_time(inode);
+	mark_inode_dirty(inode);
+out:
+	inode_unlock(inode);
+
+	return ret;
+}
+
+static ssize_t lightfs_file_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+#ifdef READA
+	struct file *file = iocb->ki_filp;
+	struct reada_entry *ra_entry;
+	loff_t pos = iocb->ki_pos;
+	ssize_t ret;
+
+	if ((iocb->ki_flags & IOCB_DIRECT) || !iov_iter_count(to))
+		return generic_file_read_iter(iocb, to);
+
+	// keep reada_windows windows in flight ahead of a sequential reader
+	if (lightfs_reada_stream(file, pos, iov_iter_count(to)))
+		while ((ra_entry = lightfs_reada_next(file)))
+			lightfs_reada_submit(file_inode(file), ra_entry);
+	ret = generic_file_read_iter(iocb, to);
+	if (ret > 0)
+		lightfs_reada_consume(file_inode(file), pos, ret);
+	return ret;
+#else
+	return generic_file_read_iter(iocb, to);
+#endif
+}
+
+/*
+ * SEEK_DATA/SEEK_HOLE walk the data keys of the file. Dirty pages are
+ * written back and their txns synced first, so zero pages are holes and
+ * every stored block is visible to the iteration.
+ */
+static loff_t lightfs_llseek(struct file *file, loff_t offset, int whence)
+{
+	struct inode *inode = file_inode(file);
+	struct lightfs_sb_info *sbi = inode->i_sb->s_fs_info;
+	uint64_t block_num;
+	loff_t size, pos;
+	DB_TXN *txn;
+	int ret;
+
+	if (whence != SEEK_DATA && whence != SEEK_HOLE) {
+		pos = generic_file_llseek(file, offset, whence);
+#ifdef READA
+		if (pos >= 0)
+			lightfs_reada_seek(file, pos);
+#endif
+		return pos;
+	}
+
+	inode_lock_shared(inode);
+	size = i_size_read(inode);
+	if (offset < 0 || offset >= size) {
+		ret = -ENXIO;
+		goto out;
+	}
+	ret = filemap_write_and_wait(inode->i_mapping);
+	if (ret)
+		goto out;
+	lightfs_bstore_txn_sync(READ_ONCE(LIGHTFS_I(inode)->last_txn_id));
+
+	lightfs_get_read_lock(LIGHTFS_I(inode));
+	TXN_GOTO_LABEL(retry);
+	lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_READONLY);
+	ret = lightfs_bstore_seek(sbi->data_db, txn, inode,
+	                          block_get_num_by_position(offset), whence, &block_num);
+	if (ret) {
+		DBOP_JUMP_ON_CONFLICT(ret, retry);
+		lightfs_bstore_txn_abort(txn);
+	} else {
+		ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+		COMMIT_JUMP_ON_CONFLICT(ret, retry);
+	}
+	lightfs_put_read_lock(LIGHTFS_I(inode));
+	if (ret)
+		goto out;
+
+	if (whence == SEEK_DATA && !block_num) {
+		ret = -ENXIO;
+		goto out;
+	}
+	pos = max_t(loff_t, offset, (loff_t)(block_num - 1) << PAGE_SHIFT);
+	if (pos >= size) {
+		if (whence == SEEK_DATA) {
+			ret = -ENXIO;
+			goto out;
+		}
+		pos = size;
+	}
+	pos = vfs_setpos(file, pos, inode->i_sb->s_maxbytes);
+	inode_unlock_shared(inode);
+
+	return pos;
+out:
+	inode_unlock_shared(inode);
+
+	return ret;
+}
+
 static int
 lightfs_mknod(struct inode *dir, struct dentry *dentry, umode_t mode, dev_t rdev)
 {
@@ -1501,6 +2221,7 @@ lightfs_mknod(struct inode *dir, struct dentry *dentry, umode_t mode, dev_t rdev
 	DBT *dir_meta_dbt, meta_dbt;
 	ino_t ino;
 	DB_TXN *txn;
+	uint32_t txn_id;
 #ifdef CALL_TRACE_TIME
 	struct time_break tb; 
 	lightfs_tb_init(&tb);
@@ -1566,8 +2287,10 @@ err_free_dbt:
 		iput(inode);
 		goto out;
 	}
-	ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+	ret = lightfs_bstore_txn_commit_id(txn, DB_TXN_NOSYNC, &txn_id);
 	COMMIT_JUMP_ON_CONFLICT(ret, retry);
+	lightfs_inode_txn_update(inode, txn_id);
+	lightfs_inode_txn_update(dir, txn_id);
 
 #ifdef CALL_TRACE_TIME
 	lightfs_tb_check(&tb);
@@ -1664,6 +2387,7 @@ lightfs_symlink(struct inode *dir, struct dentry *dentry, const char *symname)
 	size_t len = strlen(symname);
 	ino_t ino;
 	DB_TXN *txn;
+	uint32_t txn_id;
 #ifdef CALL_TRACE_TIME
 	struct time_break tb; 
 	lightfs_tb_init(&tb);
@@ -1722,8 +2446,10 @@ abort:
 	if (ret)
 		goto abort;
 
-	ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+	ret = lightfs_bstore_txn_commit_id(txn, DB_TXN_NOSYNC, &txn_id);
 	COMMIT_JUMP_ON_CONFLICT(ret, retry);
+	lightfs_inode_txn_update(inode, txn_id);
+	lightfs_inode_txn_update(dir, txn_id);
 
 	d_instantiate(dentry, inode);
 	dbt_destroy(&data_dbt);
@@ -1761,6 +2487,7 @@ static int lightfs_unlink(struct inode *dir, struct dentry *dentry)
 		struct lightfs_sb_info *sbi = inode->i_sb->s_fs_info;
 		DBT indirect_dbt;
 		DB_TXN *txn;
+		uint32_t txn_id;
 		pr_info("WATH\n");
 
 		ret = alloc_child_meta_dbt_from_inode(&indirect_dbt, dir, dentry->d_name.name);
@@ -1773,8 +2500,9 @@ static int lightfs_unlink(struct inode *dir, struct dentry *dentry)
 			DBOP_JUMP_ON_CONFLICT(ret, retry);
 			lightfs_bstore_txn_abort(txn);
 		} else {
-			ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+			ret = lightfs_bstore_txn_commit_id(txn, DB_TXN_NOSYNC, &txn_id);
 			COMMIT_JUMP_ON_CONFLICT(ret, retry);
+			lightfs_inode_txn_update(dir, txn_id);
 		}
 		dbt_destroy(&indirect_dbt);
 out:
@@ -1839,7 +2567,16 @@ lightfs_lookup(struct inode *dir, struct dentry *dentry, unsigned int flags)
 	lightfs_tb_check(&tb);
 #endif
 
-	r = lightfs_bstore_meta_get(sbi->meta_db, &meta_dbt, txn, &meta);
+reload:
+	r = lightfs_bstore_meta_load_dir(sbi->meta_db, txn, dir);
+	if (r)
+		goto abort;
+	r = lightfs_bstore_meta_lookup(sbi->meta_db, &meta_dbt, txn, &meta);
+#ifdef CACHE_SHRINK
+	// the shrinker dropped the children in between
+	if (r == -ENOENT && !lightfs_ht_cache_dir_is_loaded(dir_meta_dbt))
+		goto reload;
+#endif
 	if (r == -ENOENT) {
 		inode = NULL;
 		dbt_destroy(&meta_dbt);
@@ -1931,6 +2668,7 @@ static int lightfs_setattr(struct dentry *dentry, struct iattr *iattr)
 		if (iattr->ia_size >= size) {
 			goto skip_txn;
 		}
+		inode_dio_wait(inode);
 		block_num = block_get_num_by_position(iattr->ia_size);
 		block_off = block_get_off_by_position(iattr->ia_size);
 
@@ -1942,6 +2680,10 @@ static int lightfs_setattr(struct dentry *dentry, struct iattr *iattr)
 
 skip_txn:
 		i_size_write(inode, iattr->ia_size);
+#ifdef READA
+		// windows past the new size must not fill pages
+		lightfs_reada_cancel(inode, true);
+#endif
 	}
 
 	setattr_copy(inode, iattr);
@@ -2142,6 +2884,7 @@ lightfs_write_inode(struct inode *inode, struct writeback_control *wbc)
 {
 	int ret = 0;
 	DB_TXN *txn;
+	uint32_t txn_id;
 	DBT *meta_dbt;
 	struct lightfs_metadata meta;
 	struct lightfs_sb_info *sbi = inode->i_sb->s_fs_info;
@@ -2175,8 +2918,9 @@ lightfs_write_inode(struct inode *inode, struct writeback_control *wbc)
 		DBOP_JUMP_ON_CONFLICT(ret, retry);
 		lightfs_bstore_txn_abort(txn);
 	} else {
-		ret = lightfs_bstore_txn_commit(txn, DB_TXN_NOSYNC);
+		ret = lightfs_bstore_txn_commit_id(txn, DB_TXN_NOSYNC, &txn_id);
 		COMMIT_JUMP_ON_CONFLICT(ret, retry);
+		lightfs_inode_txn_update(inode, txn_id);
 	}
 
 	lightfs_put_read_lock(LIGHTFS_I(inode));
@@ -2233,6 +2977,9 @@ static void lightfs_evict_inode(struct inode *inode)
 	lightfs_put_read_lock(LIGHTFS_I(inode));
 
 no_delete:
+#ifdef READA
+	lightfs_reada_cancel(inode, true);
+#endif
 	truncate_inode_pages(&inode->i_data, 0);
 
 	invalidate_inode_buffers(inode);
@@ -2257,6 +3004,7 @@ static void lightfs_put_super(struct super_block *sb)
 #ifdef CALL_TRACE
 	lightfs_error(__func__, "\n");
 #endif
+	flush_work(&sbi->s_ino_work);
 	sync_filesystem(sb);
 
 	sb->s_fs_info = NULL;
@@ -2306,6 +3054,116 @@ static int lightfs_dir_release(struct inode *inode, struct file *filp)
 	return 0;
 }
 
+/*
+ * A random mmap fault would read one page per device round trip: the
+ * VFS skips mmap readahead for MADV_RANDOM mappings and once a mapping
+ * misses too often. Read the missing pages of the aligned block around
+ * the fault with one GET_MULTI instead, filemap_map_pages then maps the
+ * neighbours without faulting on them.
+ */
+static void lightfs_fault_around(struct vm_fault *vmf)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	struct inode *inode = mapping->host;
+	gfp_t gfp = readahead_gfp_mask(mapping);
+	struct lightfs_io *lightfs_io;
+	struct page *page;
+	pgoff_t start, end, index;
+	loff_t size;
+
+	if (vma->vm_flags & VM_SEQ_READ)
+		return;
+	if (!(vma->vm_flags & VM_RAND_READ) && file->f_ra.ra_pages &&
+	    file->f_ra.mmap_miss <= MMAP_LOTSAMISS)
+		return;
+	size = i_size_read(inode);
+	if (!size)
+		return;
+
+	start = max(round_down(vmf->pgoff, FAULT_AROUND_CNT), vma->vm_pgoff);
+	end = min3(round_down(vmf->pgoff, FAULT_AROUND_CNT) + FAULT_AROUND_CNT,
+	           vma->vm_pgoff + vma_pages(vma),
+	           (pgoff_t)((size - 1) >> PAGE_SHIFT) + 1);
+	if (vmf->pgoff >= end)
+		return;
+
+	lightfs_io = lightfs_io_alloc(end - start);
+	if (!lightfs_io)
+		return;
+	for (index = start; index < end; index++) {
+		page = __page_cache_alloc(gfp);
+		if (!page)
+			break;
+		// cached or being read by a readahead window
+		if (add_to_page_cache_lru(page, mapping, index, gfp)) {
+			put_page(page);
+			continue;
+		}
+		lightfs_io_add_page(lightfs_io, page);
+		put_page(page);
+	}
+	if (lightfs_io->lightfs_vcnt) {
+		lightfs_read_io(inode, lightfs_io);
+		// filemap_fault counts the page read here as a hit, keep the
+		// mmap readahead off for this file
+		file->f_ra.mmap_miss++;
+	}
+	lightfs_io_free(lightfs_io);
+}
+
+static int lightfs_filemap_fault(struct vm_fault *vmf)
+{
+	struct file *file = vmf->vma->vm_file;
+	struct page *page;
+
+	page = find_get_page(file->f_mapping, vmf->pgoff);
+	if (page)
+		put_page(page);
+	else
+		lightfs_fault_around(vmf);
+
+	return filemap_fault(vmf);
+}
+
+// the page goes to writeback like a written one, fsync and msync wait
+// for the txn that wrote it
+static int lightfs_page_mkwrite(struct vm_fault *vmf)
+{
+	struct page *page = vmf->page;
+	struct inode *inode = file_inode(vmf->vma->vm_file);
+	int ret = VM_FAULT_LOCKED;
+
+	sb_start_pagefault(inode->i_sb);
+	file_update_time(vmf->vma->vm_file);
+	lock_page(page);
+	if (page->mapping != inode->i_mapping ||
+	    page_offset(page) >= i_size_read(inode)) {
+		unlock_page(page);
+		ret = VM_FAULT_NOPAGE;
+		goto out;
+	}
+	set_page_dirty(page);
+	wait_for_stable_page(page);
+out:
+	sb_end_pagefault(inode->i_sb);
+	return ret;
+}
+
+static const struct vm_operations_struct lightfs_file_vm_ops = {
+	.fault			= lightfs_filemap_fault,
+	.map_pages		= filemap_map_pages,
+	.page_mkwrite		= lightfs_page_mkwrite,
+};
+
+static int lightfs_file_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	file_accessed(file);
+	vma->vm_ops = &lightfs_file_vm_ops;
+	return 0;
+}
+
 static const struct address_space_operations lightfs_aops = {
 	.readpage		= lightfs_readpage,
 	.readpages		= lightfs_readpages,
@@ -2314,15 +3172,24 @@ static const struct address_space_operations lightfs_aops = {
 	.write_begin		= lightfs_write_begin,
 	.write_end		= lightfs_write_end,
 	.launder_page		= lightfs_launder_page,
+	.direct_IO		= lightfs_direct_IO,
 	.set_page_dirty = __set_page_dirty_nobuffers,
+#ifdef READA
+	.freepage		= lightfs_reada_freepage,
+#endif
 };
 
 static const struct file_operations lightfs_file_file_operations = {
-	.llseek			= generic_file_llseek,
+	.llseek			= lightfs_llseek,
 	.fsync			= lightfs_fsync,
-	.read_iter		= generic_file_read_iter,
+	.fallocate		= lightfs_fallocate,
+	.read_iter		= lightfs_file_read_iter,
 	.write_iter		= generic_file_write_iter,
-	.mmap			= generic_file_mmap,
+	.mmap			= lightfs_file_mmap,
+#ifdef READA
+	.open			= lightfs_reada_open,
+	.release		= lightfs_reada_release,
+#endif
 };
 
 static const struct file_operations lightfs_dir_file_operations = {
@@ -2410,16 +3277,16 @@ lightfs_setup_inode(struct super_block *sb, DBT *meta_dbt,
 	dbt_copy(&lightfs_inode->meta_dbt, meta_dbt);
 	init_rwsem(&lightfs_inode->key_lock);
 #ifdef READA
-	lightfs_inode->ra_entry = NULL;
-	//lightfs_inode->reada_state = READA_EMPTY;
 	spin_lock_init(&lightfs_inode->reada_spin);
 	INIT_LIST_HEAD(&lightfs_inode->ra_list);
 	lightfs_inode->ra_entry_cnt = 0;
-	lightfs_inode->last_block_start = lightfs_inode->last_block_len = 0;
+	lightfs_inode->ra_gen = 0;
 	lightfs_inode->is_lookuped = 0;
 #endif
 	INIT_LIST_HEAD(&lightfs_inode->rename_locked);
 	lightfs_inode->lightfs_flags = 0;
+	// a txn of an evicted instance may still be in flight
+	lightfs_inode->last_txn_id = lightfs_bstore_txn_last_id();
 #ifdef CALL_TRACE_TIME
 	lightfs_tb_check(&tb);
 #endif
@@ -2485,7 +3352,7 @@ static int lightfs_fill_super(struct super_block *sb, void *data, int silent)
 {
 	int ret;
 	int cpu;
-	ino_t ino = LIGHTFS_INO_CUR;
+	ino_t ino;
 	struct inode *root;
 	struct lightfs_metadata meta;
 	struct lightfs_sb_info *sbi;
@@ -2501,6 +3368,9 @@ static int lightfs_fill_super(struct super_block *sb, void *data, int silent)
 	sbi->s_lightfs_info = alloc_percpu(struct lightfs_info);
 	if (!sbi->s_lightfs_info)
 		goto err;
+	spin_lock_init(&sbi->s_ino_lock);
+	INIT_WORK(&sbi->s_ino_work, lightfs_ino_lease_work);
+	init_waitqueue_head(&sbi->s_ino_wq);
 
 	sb->s_fs_info = sbi;
 	sb_set_blocksize(sb, LIGHTFS_BSTORE_BLOCKSIZE);
@@ -2515,30 +3385,38 @@ static int lightfs_fill_super(struct super_block *sb, void *data, int silent)
 	TXN_GOTO_LABEL(retry);
 	lightfs_bstore_txn_begin(sbi->db_env, NULL, &txn, TXN_MAY_WRITE);
 	dbt_setup(&root_dbt, &root_meta_key, SIZEOF_ROOT_META_KEY);
+	// on a used device, the root is read back and its children are
+	// loaded into the cache on first access
 	ret = lightfs_bstore_meta_get(sbi->meta_db, &root_dbt, txn, &meta);
+	if (ret == -ENOENT) {
+		lightfs_setup_metadata(&meta, 0755 | S_IFDIR, 0, 0,
+		                    LIGHTFS_ROOT_INO);
+		ret = lightfs_bstore_meta_put(sbi->meta_db,
+		                           &root_dbt,
+		                           txn, &meta, NULL, true);
+	}
+	if (!ret)
+		ret = lightfs_bstore_get_ino(sbi->meta_db, txn, &ino);
 	if (ret) {
-		if (ret == -ENOENT) {
-			lightfs_setup_metadata(&meta, 0755 | S_IFDIR, 0, 0,
-			                    LIGHTFS_ROOT_INO);
-			ret = lightfs_bstore_meta_put(sbi->meta_db,
-			                           &root_dbt,
-			                           txn, &meta, NULL, true);
-		}
-		if (ret) {
-			DBOP_JUMP_ON_CONFLICT(ret, retry);
-			lightfs_bstore_txn_abort(txn);
-			goto err;
-		}
+		DBOP_JUMP_ON_CONFLICT(ret, retry);
+		lightfs_bstore_txn_abort(txn);
+		goto err;
 	}
 	ret = lightfs_bstore_txn_commit(txn, DB_TXN_SYNC);
 	COMMIT_JUMP_ON_CONFLICT(ret, retry);
 
-	sbi->s_nr_cpus = 0;
+	// every ino below the stored one may be in use (leased before a
+	// crash), so allocation restarts there and skips the rest
 	for_each_possible_cpu(cpu) {
-		(per_cpu_ptr(sbi->s_lightfs_info, cpu))->next_ino = ino + cpu;
-		(per_cpu_ptr(sbi->s_lightfs_info, cpu))->max_ino = LIGHTFS_INO_MAX;
-		sbi->s_nr_cpus++;
+		(per_cpu_ptr(sbi->s_lightfs_info, cpu))->next_ino = ino;
+		(per_cpu_ptr(sbi->s_lightfs_info, cpu))->max_ino = ino;
+		(per_cpu_ptr(sbi->s_lightfs_info, cpu))->lease = LIGHTFS_INO_LEASE_MIN;
+		(per_cpu_ptr(sbi->s_lightfs_info, cpu))->refill_time = jiffies;
 	}
+	sbi->s_ino_next = ino;
+	sbi->s_ino_committed = ino;
+	sbi->s_ino_target = ino + LIGHTFS_INO_PREFETCH;
+	schedule_work(&sbi->s_ino_work);
 
 	root = lightfs_setup_inode(sb, &root_dbt, &meta);
 	if (IS_ERR(root)) {
@@ -2555,6 +3433,7 @@ static int lightfs_fill_super(struct super_block *sb, void *data, int silent)
 	return 0;
 
 err_close:
+	flush_work(&sbi->s_ino_work);
 	lightfs_bstore_env_close(sbi);
 err:
 	if (sbi) {
@@ -2615,14 +3494,37 @@ int init_lightfs_fs(void)
 		goto out_free_inode_cachep;
 	}
 
+	lightfs_wb_workq = alloc_workqueue("lightfs_wb",
+	                                   WQ_MEM_RECLAIM | WQ_UNBOUND,
+	                                   LIGHTFS_WB_WORKERS);
+	if (!lightfs_wb_workq) {
+		printk(KERN_ERR "LIGHTFS ERROR: Failed to initialize writeback workqueue.\n");
+		ret = -ENOMEM;
+		goto out_free_writepages_cachep;
+	}
+
+#ifdef READA
+	ret = lightfs_reada_init();
+	if (ret) {
+		printk(KERN_ERR "LIGHTFS ERROR: Failed to initialize readahead workqueue.\n");
+		goto out_free_wb_workq;
+	}
+#endif
+
 	ret = register_filesystem(&lightfs_fs_type);
 	if (ret) {
 		printk(KERN_ERR "LIGHTFS ERROR: Failed to register filesystem\n");
-		goto out_free_writepages_cachep;
+		goto out_free_reada;
 	}
 
 	return 0;
 
+out_free_reada:
+#ifdef READA
+	lightfs_reada_exit();
+#endif
+out_free_wb_workq:
+	destroy_workqueue(lightfs_wb_workq);
 out_free_writepages_cachep:
 	kmem_cache_destroy(lightfs_writepages_cachep);
 out_free_inode_cachep:
@@ -2635,6 +3537,11 @@ void exit_lightfs_fs(void)
 {
 	unregister_filesystem(&lightfs_fs_type);
 
+#ifdef READA
+	lightfs_reada_exit();
+#endif
+	destroy_workqueue(lightfs_wb_workq);
+
 	kmem_cache_destroy(lightfs_writepages_cachep);
 
 	kmem_cache_destroy(lightfs_inode_cachep);
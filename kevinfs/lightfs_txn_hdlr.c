@@ -105,8 +105,19 @@ static inline void lightfs_txn_buf_free(DB_TXN_BUF *txn_buf) {
 	if (txn_buf->key)
 		kfree(txn_buf->key);
 	if (txn_buf->buf) {
+		// a page that was never transferred is still under writeback
 		if (txn_buf->type == LIGHTFS_META_SET) {
 			kmem_cache_free(lightfs_meta_buf_cachep, txn_buf->buf);
+		} else if (txn_buf->type == LIGHTFS_DATA_SET_WB ||
+		           txn_buf->type == LIGHTFS_DATA_DEL) { // page, zero page
+			end_page_writeback((struct page *)txn_buf->buf);
+		} else if (txn_buf->type == LIGHTFS_DATA_EXT_WB) {
+			struct page **pages = (struct page **)txn_buf->buf;
+			int i;
+
+			for (i = 0; i < txn_buf->off; i++)
+				end_page_writeback(pages[i]);
+			kfree(pages);
 		} else {
 			kmem_cache_free(lightfs_buf_cachep, txn_buf->buf); // TMP
 		}
@@ -204,7 +215,7 @@ static inline void lightfs_dbc_init(void *dbc)
 static inline void lightfs_dbc_free(DBC *dbc)
 {
 	if (dbc->io_tag != -1) {
-		cheeze_free_io(dbc->io_tag);
+		lightfs_io_free_buf(dbc->io_tag);
 	}
 	kmem_cache_free(lightfs_dbc_cachep, dbc);	
 }
@@ -315,6 +326,10 @@ int lightfs_bstore_txn_get(DB *db, DB_TXN *txn, DBT *key, DBT *value, uint32_t o
 		ret = DB_NOTFOUND;
 	} else {
 		//value->size = txn_buf->ret;
+#ifdef COMPRESS
+		if (type == LIGHTFS_DATA_GET && value->size == PAGE_SIZE)
+			lightfs_decomp_page(value->data);
+#endif
 	}
 
 	lightfs_txn_buf_free(txn_buf);
@@ -322,6 +337,53 @@ int lightfs_bstore_txn_get(DB *db, DB_TXN *txn, DBT *key, DBT *value, uint32_t o
 	return ret;
 }
 
+/*
+ * Async version of lightfs_bstore_txn_get(): returns once the get is
+ * submitted. ga, key and value->data must stay alive until ga completes;
+ * ga->cb (may be NULL) runs on the io completion path, callers that
+ * need the result in their own context use lightfs_get_async_wait().
+ */
+int lightfs_bstore_txn_get_async(DB *db, DB_TXN *txn, DBT *key, DBT *value, uint32_t off, enum lightfs_req_type type, struct lightfs_get_async *ga)
+{
+	DB_TXN_BUF *txn_buf;
+
+	txn_buf = kmem_cache_alloc(lightfs_txn_buf_cachep, GFP_NOIO);
+	lightfs_txn_buf_init(txn_buf);
+	txn_buf->txn_id = txn->txn_id;
+	txn_buf->db = db;
+	txn_buf_setup(txn_buf, value->data, off, value->size, type);
+	copy_txn_buf_key_from_dbt(txn_buf, key);
+
+	ga->txn_buf = txn_buf;
+	ga->ret = 0;
+	init_completion(&ga->done);
+
+	return txn_hdlr->db_io->get_async(db, txn_buf, ga);
+}
+
+// called by the io layer once txn_buf->ret is set
+void lightfs_bstore_txn_get_end(struct lightfs_get_async *ga)
+{
+	DB_TXN_BUF *txn_buf = ga->txn_buf;
+
+	if (txn_buf->ret == DB_NOTFOUND) {
+		ga->ret = DB_NOTFOUND;
+	} else {
+#ifdef COMPRESS
+		if (txn_buf->type == LIGHTFS_DATA_GET && txn_buf->len == PAGE_SIZE)
+			lightfs_decomp_page(txn_buf->buf);
+#endif
+	}
+	txn_buf->buf = NULL;
+	txn_buf->key = NULL;
+	lightfs_txn_buf_free(txn_buf);
+	ga->txn_buf = NULL;
+
+	if (ga->cb)
+		ga->cb(ga);
+	complete(&ga->done);
+}
+
 int lightfs_bstore_txn_get_multi(DB *db, DB_TXN *txn, DBT *key, uint32_t cnt, YDB_CALLBACK_FUNCTION f, void *extra, enum lightfs_req_type type)
 {
 	DB_TXN_BUF *txn_buf;
@@ -381,10 +443,11 @@ int lightfs_bstore_txn_get_multi(DB *db, DB_TXN *txn, DBT *key, uint32_t cnt, YD
 	buf = txn_buf->buf;
 	for (i = 0; i < cnt; i++) {
 		lightfs_data_key_set_blocknum(data_key, key->size, block_num++);
+		// already decompressed by get_multi
 		dbt_setup(&value, buf + (i * PAGE_SIZE), PAGE_SIZE);
 		f(key, &value, extra);
 	}
-	cheeze_free_io(txn_buf->ret);
+	lightfs_io_free_buf(txn_buf->ret);
 free_out:
 	txn_buf->buf = NULL;
 	txn_buf->key = NULL;
@@ -513,7 +576,7 @@ int lightfs_bstore_dbc_c_get(DBC *dbc, DBT *key, DBT *value, uint32_t flags)
 		}
 		copy_txn_buf_key_from_dbt(txn_buf, key);
 		if (dbc->io_tag != -1) {
-			cheeze_free_io(dbc->io_tag);
+			lightfs_io_free_buf(dbc->io_tag);
 			dbc->io_tag = -1;
 		}
 		ret = txn_hdlr->db_io->iter(dbc->dbp, dbc, txn_buf); 
@@ -681,10 +744,10 @@ int lightfs_bstore_txn_insert(DB *db, DB_TXN *txn, const DBT *key, const DBT *va
 	alloc_txn_buf_key_from_dbt(txn_buf, key);
 
 	
-	if (value) { // SET, SEQ_SET, UPDATE
+	if (value && type != LIGHTFS_DATA_DEL) { // SET, SEQ_SET, UPDATE
 		if (type == LIGHTFS_META_SET) {
 			txn_buf->buf = (char*)kmem_cache_alloc(lightfs_meta_buf_cachep, GFP_NOIO);	
-		} else if (type == LIGHTFS_DATA_SET_WB) {
+		} else if (type == LIGHTFS_DATA_SET_WB || type == LIGHTFS_DATA_EXT_WB) {
 			txn_buf->buf = value->data;
 		} else {
 			txn_buf->buf = (char*)kmem_cache_alloc(lightfs_buf_cachep, GFP_NOIO); // TMP
@@ -699,12 +762,15 @@ int lightfs_bstore_txn_insert(DB *db, DB_TXN *txn, const DBT *key, const DBT *va
 		} else if (type == LIGHTFS_DATA_SET_WB) {
 			txn_buf->type = type;
 			txn_buf->off = 0;
+		} else if (type == LIGHTFS_DATA_EXT_WB) { // off: cnt of pages
+			txn_buf->type = type;
+			txn_buf->off = value->size >> PAGE_SHIFT;
 		} else { // UPDATE
 			txn_buf_setup_cpy(txn_buf, value->data, off, value->size, type);
 			txn_buf->update = value->size;
 		}
 
-		txn_buf->len = 4096;
+		txn_buf->len = (type == LIGHTFS_DATA_EXT_WB) ? value->size : 4096;
 #ifdef TXN_BUFFER
 		spin_lock_irqsave(&txn_hdlr->txn_spin, irqflags);
 		if ( (old_txn_buf = lightfs_txn_buffer_put(&txn_hdlr->txn_buffer, txn_buf)) ) {
@@ -728,7 +794,8 @@ int lightfs_bstore_txn_insert(DB *db, DB_TXN *txn, const DBT *key, const DBT *va
 		}
 #endif
 	} else { // DEL, DEL_MULTI ==> off: cnt of objects
-		txn_buf_setup(txn_buf, NULL, off, PAGE_SIZE * off, type);
+		// a DATA_DEL value is a zero page, its writeback ends on transfer
+		txn_buf_setup(txn_buf, value ? value->data : NULL, off, PAGE_SIZE * off, type);
 		txn->cnt++;
 		txn->size += calc_txn_buf_size(txn_buf);
 		list_add_tail(&txn_buf->txn_buf_list, &txn->txn_buf_list);
@@ -754,10 +821,15 @@ int lightfs_bstore_txn_insert(DB *db, DB_TXN *txn, const DBT *key, const DBT *va
 	return 0;
 }
 
-int lightfs_bstore_txn_commit(DB_TXN *txn, uint32_t flags)
+/*
+ * *txn_id is the id to pass to lightfs_bstore_txn_sync, 0 when there is
+ * nothing to wait for (empty, read-only or already synced txn).
+ */
+int lightfs_bstore_txn_commit_id(DB_TXN *txn, uint32_t flags, uint32_t *txn_id)
 {
 	unsigned long irqflags;
 
+	*txn_id = 0;
 	spin_lock_irqsave(&txn_hdlr->txn_spin, irqflags);
 
 	if (!txn->cnt) {
@@ -792,6 +864,7 @@ int lightfs_bstore_txn_commit(DB_TXN *txn, uint32_t flags)
 	} else {
 		txn_hdlr->txn_cnt++;
 		txn->txn_id = txn_hdlr->txn_id++;
+		*txn_id = txn->txn_id;
 		list_add_tail(&(txn->txn_list), &txn_hdlr->txn_list);
 
 		txn->state |= TXN_COMMITTED;
@@ -803,6 +876,126 @@ int lightfs_bstore_txn_commit(DB_TXN *txn, uint32_t flags)
 	return 0;
 }
 
+int lightfs_bstore_txn_commit(DB_TXN *txn, uint32_t flags)
+{
+	uint32_t txn_id;
+
+	return lightfs_bstore_txn_commit_id(txn, flags, &txn_id);
+}
+
+/*
+ * A txn is durable once no txn list, open group or live c_txn can still
+ * hold it. A c_txn is destroyed only after its transfer is acked, and
+ * c_txn->txn_id is the first txn id of its group, so a group counts as
+ * pending until every c_txn of it (and its COMMIT) is acked.
+ */
+static bool lightfs_txn_is_durable(TXNID_T txn_id)
+{
+	DB_C_TXN *c_txn;
+	DB_TXN *txn;
+	unsigned long irqflags;
+	bool ret = false;
+
+	spin_lock_irqsave(&txn_hdlr->txn_spin, irqflags);
+	if (!list_empty(&txn_hdlr->txn_list)) {
+		txn = list_first_entry(&txn_hdlr->txn_list, DB_TXN, txn_list);
+		if (!txn_id_before(txn_id, txn->txn_id))
+			goto out;
+	}
+	if (!list_empty(&txn_hdlr->sync_txn_list)) {
+		txn = list_first_entry(&txn_hdlr->sync_txn_list, DB_TXN, txn_list);
+		if (!txn_id_before(txn_id, txn->txn_id))
+			goto out;
+	}
+	if (txn_hdlr->running_c_txn_id &&
+	    !txn_id_before(txn_id, txn_hdlr->running_c_txn_id))
+		goto out;
+	list_for_each_entry(c_txn, &txn_hdlr->ordered_c_txn_list, c_txn_list) {
+		if (c_txn->cnt && !txn_id_before(txn_id, c_txn->txn_id))
+			goto out;
+	}
+	list_for_each_entry(c_txn, &txn_hdlr->orderless_c_txn_list, c_txn_list) {
+		if (c_txn->cnt && !txn_id_before(txn_id, c_txn->txn_id))
+			goto out;
+	}
+	ret = true;
+out:
+	spin_unlock_irqrestore(&txn_hdlr->txn_spin, irqflags);
+	return ret;
+}
+
+uint32_t lightfs_bstore_txn_last_id(void)
+{
+	return READ_ONCE(txn_hdlr->txn_id) - 1;
+}
+
+/*
+ * The last txn id up to which every committed txn reached the device,
+ * without waiting: one before the oldest txn lightfs_txn_is_durable would
+ * still find pending.
+ */
+uint32_t lightfs_bstore_txn_durable_id(void)
+{
+	DB_C_TXN *c_txn;
+	DB_TXN *txn;
+	unsigned long irqflags;
+	TXNID_T oldest;
+
+	spin_lock_irqsave(&txn_hdlr->txn_spin, irqflags);
+	oldest = txn_hdlr->txn_id;
+	if (!list_empty(&txn_hdlr->txn_list)) {
+		txn = list_first_entry(&txn_hdlr->txn_list, DB_TXN, txn_list);
+		if (txn_id_before(txn->txn_id, oldest))
+			oldest = txn->txn_id;
+	}
+	if (!list_empty(&txn_hdlr->sync_txn_list)) {
+		txn = list_first_entry(&txn_hdlr->sync_txn_list, DB_TXN, txn_list);
+		if (txn_id_before(txn->txn_id, oldest))
+			oldest = txn->txn_id;
+	}
+	if (txn_hdlr->running_c_txn_id &&
+	    txn_id_before(txn_hdlr->running_c_txn_id, oldest))
+		oldest = txn_hdlr->running_c_txn_id;
+	list_for_each_entry(c_txn, &txn_hdlr->ordered_c_txn_list, c_txn_list) {
+		if (c_txn->cnt && txn_id_before(c_txn->txn_id, oldest))
+			oldest = c_txn->txn_id;
+	}
+	list_for_each_entry(c_txn, &txn_hdlr->orderless_c_txn_list, c_txn_list) {
+		if (c_txn->cnt && txn_id_before(c_txn->txn_id, oldest))
+			oldest = c_txn->txn_id;
+	}
+	spin_unlock_irqrestore(&txn_hdlr->txn_spin, irqflags);
+
+	return oldest - 1;
+}
+
+static inline void lightfs_txn_sync_wake(void)
+{
+	if (wq_has_sleeper(&txn_hdlr->txn_sync_wq))
+		wake_up_all(&txn_hdlr->txn_sync_wq);
+}
+
+/*
+ * Wait until txn_id reached the device (fsync). The handler is kicked so
+ * the running c_txn is closed and sent now, not after TXN_FLUSH_TIME.
+ */
+int lightfs_bstore_txn_sync(uint32_t txn_id)
+{
+	unsigned long irqflags;
+
+	if (!txn_id || lightfs_txn_is_durable(txn_id))
+		return 0;
+
+	spin_lock_irqsave(&txn_hdlr->txn_spin, irqflags);
+	txn_hdlr->flush_req = true;
+	spin_unlock_irqrestore(&txn_hdlr->txn_spin, irqflags);
+	wake_up(&txn_hdlr->wq);
+
+	wait_event(txn_hdlr->txn_sync_wq, lightfs_txn_is_durable(txn_id));
+
+	return 0;
+}
+
 int lightfs_bstore_txn_abort(DB_TXN *txn)
 {
 	return 0;
@@ -844,6 +1037,7 @@ static int lightfs_c_txn_destroy(DB_C_TXN *c_txn)
 	spin_lock_irqsave(&txn_hdlr->txn_spin, flag);
 	list_del(&c_txn->c_txn_list);
 	spin_unlock_irqrestore(&txn_hdlr->txn_spin, flag);
+	lightfs_txn_sync_wake();
 
 	while (!list_empty(&c_txn->txn_list)) {
 		txn = list_first_entry(&c_txn->txn_list, DB_TXN, txn_list);
@@ -1212,6 +1406,9 @@ static bool lightfs_txn_hdlr_check_state(void)
 	//if (cnt > SOFT_TXN_LIMIT / 10) {
 	if (cnt > 320) {
 		ret = true;
+	} else if (txn_hdlr->flush_req) {
+		txn_hdlr->flush_req = false;
+		ret = true;
 	} else {
 		if (txn_hdlr->syncing_cnt) {
 			ret = true;
@@ -1450,12 +1647,22 @@ int lightfs_txn_hdlr_init(void)
 	txn_hdlr->commit_workq = alloc_workqueue("commit_queue", WQ_MEM_RECLAIM | WQ_UNBOUND, 0);
 
 	lightfs_error(__func__, "lightfs_io_create\n");
-	lightfs_io_create(&txn_hdlr->db_io);
+	ret = lightfs_io_create(&txn_hdlr->db_io);
+	if (ret)
+		goto out_destroy_workqs;
 
 	txn_hdlr->tsk = (struct task_struct *)kthread_run(lightfs_txn_hdlr_run, NULL, "lightfs_txn_hdlr");
 
 	return 0;
 
+out_destroy_workqs:
+	for (i = 0; i < CONCURRENT_CNT; i++) {
+		if (txn_hdlr->workqs[i])
+			destroy_workqueue(txn_hdlr->workqs[i]);
+	}
+	kfree(txn_hdlr->workqs);
+	lightfs_queue_exit(txn_hdlr->workq_tags);
+	destroy_workqueue(txn_hdlr->commit_workq);
 out_free_dbc_buf_cachep:
 	kmem_cache_destroy(lightfs_dbc_buf_cachep);
 out_free_dbc_cachep:
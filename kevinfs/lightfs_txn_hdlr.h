@@ -25,6 +25,7 @@ static inline void txn_hdlr_alloc(struct __lightfs_txn_hdlr **__txn_hdlr)
 	_txn_hdlr->running_c_txn_cnt = 0;
 	init_waitqueue_head(&_txn_hdlr->wq);
 	init_waitqueue_head(&_txn_hdlr->txn_wq);
+	init_waitqueue_head(&_txn_hdlr->txn_sync_wq);
 	INIT_LIST_HEAD(&_txn_hdlr->txn_list);
 	INIT_LIST_HEAD(&_txn_hdlr->sync_txn_list);
 	INIT_LIST_HEAD(&_txn_hdlr->ordered_c_txn_list);
@@ -45,11 +46,18 @@ static inline void txn_hdlr_alloc(struct __lightfs_txn_hdlr **__txn_hdlr)
 	init_rwsem(&_txn_hdlr->txn_buffer_sem);
 	spin_lock_init(&_txn_hdlr->txn_buffer_spin);
 	_txn_hdlr->current_workq_id = 0;
+	_txn_hdlr->flush_req = false;
 	*__txn_hdlr = _txn_hdlr;
 	_txn_hdlr->running = 1;
 	
 }
 
+// txn ids wrap around
+static inline bool txn_id_before(TXNID_T a, TXNID_T b)
+{
+	return (int32_t)(a - b) < 0;
+}
+
 static inline void c_txn_list_alloc(DB_C_TXN_LIST **c_txn_list, DB_C_TXN *c_txn)
 {
 	*c_txn_list = kmalloc(sizeof(DB_C_TXN_LIST), GFP_NOIO);
@@ -152,6 +160,8 @@ int lightfs_txn_hdlr_init(void);
 int lightfs_txn_hdlr_destroy(void);
 int lightfs_bstore_txn_insert(DB *, DB_TXN *, const DBT *, const DBT *, uint32_t, enum lightfs_req_type);
 int lightfs_bstore_txn_get(DB *, DB_TXN *, DBT *, DBT *, uint32_t, enum lightfs_req_type);
+int lightfs_bstore_txn_get_async(DB *, DB_TXN *, DBT *, DBT *, uint32_t, enum lightfs_req_type, struct lightfs_get_async *);
+void lightfs_bstore_txn_get_end(struct lightfs_get_async *);
 int lightfs_bstore_txn_get_multi(DB *, DB_TXN *, DBT *, uint32_t, YDB_CALLBACK_FUNCTION, void *, enum lightfs_req_type);
 int lightfs_bstore_txn_get_multi_reada(DB *, DB_TXN *, DBT *, uint32_t, void *, enum lightfs_req_type);
 int lightfs_bstore_txn_sync_put(DB *, DB_TXN *, DBT *, DBT *, uint32_t, enum lightfs_req_type);
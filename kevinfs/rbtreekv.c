@@ -204,7 +204,8 @@ int db_get(DB *db, DB_TXN *txnid, DBT *key, DBT *data, uint32_t flags)
 		//lightfs_error(__func__, "NOT FOUND\n");
 		return DB_NOTFOUND;
 	}
-	memcpy(data->data, node->val.data, data->size);
+	// a compressed value is shorter than the buffer
+	memcpy(data->data, node->val.data, min_t(uint32_t, data->size, node->val.size));
 #ifdef RB_LOCK
 	mutex_unlock(&rb_lock);
 #endif
@@ -213,6 +214,55 @@ int db_get(DB *db, DB_TXN *txnid, DBT *key, DBT *data, uint32_t flags)
 	return node->val.size;
 }
 
+// like db_get, but from byte off of the value
+int db_get_off(DB *db, DBT *key, DBT *data, uint32_t off)
+{
+	struct rb_kv_node *node;
+	int ret;
+
+#ifdef RB_LOCK
+	mutex_lock(&rb_lock);
+#endif
+	node = find_val_with_key(db, key);
+	if (node == NULL || node->val.size <= off) {
+#ifdef RB_LOCK
+		mutex_unlock(&rb_lock);
+#endif
+		return DB_NOTFOUND;
+	}
+	ret = node->val.size - off;
+	memcpy(data->data, node->val.data + off, min_t(uint32_t, data->size, ret));
+#ifdef RB_LOCK
+	mutex_unlock(&rb_lock);
+#endif
+
+	return ret;
+}
+
+// cut a value down to size bytes
+int db_trunc(DB *db, DBT *key, uint32_t size)
+{
+	struct rb_kv_node *node;
+
+#ifdef RB_LOCK
+	mutex_lock(&rb_lock);
+#endif
+	node = find_val_with_key(db, key);
+	if (node == NULL) {
+#ifdef RB_LOCK
+		mutex_unlock(&rb_lock);
+#endif
+		return DB_NOTFOUND;
+	}
+	if (node->val.size > size)
+		node->val.size = size;
+#ifdef RB_LOCK
+	mutex_unlock(&rb_lock);
+#endif
+
+	return 0;
+}
+
 int db_del(DB *db, DB_TXN *txnid, DBT *key, uint32_t flags)
 {
 	struct rb_kv_node *node;
@@ -7,6 +7,8 @@ int db_env_create(DB_ENV **envp, uint32_t flags);
 int db_create(DB **db, DB_ENV *env, uint32_t flags);
 int db_env_close(DB_ENV *env, uint32_t flag);
 int db_get(DB *db, DB_TXN *txnid, DBT *key, DBT *data, uint32_t flags);
+int db_get_off(DB *db, DBT *key, DBT *data, uint32_t off);
+int db_trunc(DB *db, DBT *key, uint32_t size);
 int db_del(DB *db, DB_TXN *txnid, DBT *key, uint32_t flags);
 int db_put(DB *db, DB_TXN *txnid, DBT *key, DBT *data, uint32_t flags);
 int db_close(DB *db, uint32_t flag);